@@ -2,10 +2,9 @@
 """
 Run the NUMA-STREAM benchmark multiple times while logging NUMA statistics.
 
-For each run we invoke numa_stat_logger in "-r" mode so it collects data while
-the benchmark executes. The logger is started in an isolated working directory,
-which keeps each raw CSV separate. After a run finishes we append its samples
-to an aggregate CSV that includes two extra columns:
+One numa_stat_logger runs in session mode ("-s") for the whole sweep. Each
+benchmark run is bracketed by start/stop commands, and the logger writes its
+samples straight into the aggregate CSV with two extra columns:
     - mem_policy: textual description of the NUMA policy used for this run
     - stream_run: 1-based run index so samples can be grouped later
 """
@@ -16,7 +15,7 @@ import argparse
 import subprocess
 import sys
 from pathlib import Path
-from typing import Dict, List, Sequence, Tuple
+from typing import Dict, List, Sequence
 import re
 
 
@@ -28,7 +27,6 @@ POLICY_COMMANDS: Dict[str, List[str]] = {
     "preferred_node0": ["numactl", "--preferred=0"],
 }
 
-LOGGER_OUTPUT = "stream_numa_stat_log.csv"
 STREAM_HEADER = "Function      Rate (MB/s)   Avg time     Min time     Max time"
 STREAM_ROW_RE = re.compile(
     r"^(?P<function>[A-Za-z]+):\s+"
@@ -115,7 +113,7 @@ def parse_args() -> argparse.Namespace:
         "--output-dir",
         type=Path,
         default=Path("stream_run_outputs"),
-        help="Directory where per-run logs and the aggregate CSV are stored.",
+        help="Directory of the per-run working directories and the aggregate CSV.",
     )
     parser.add_argument(
         "--aggregate-file",
@@ -129,15 +127,40 @@ def parse_args() -> argparse.Namespace:
         default=Path("stream_run_outputs/stream_feature_log.csv"),
         help="CSV file that collects STREAM benchmark summaries per run.",
     )
+    parser.add_argument(
+        "--mbm",
+        action="store_true",
+        help=(
+            "Also log memory bandwidth per node from resctrl MBM "
+            "(node_N_mbm_*_bytes_per_sec), sampled every --interval."
+        ),
+    )
     return parser.parse_args()
 
 
-def detect_numa_nodes() -> int:
+def detect_numa_nodes() -> List[int]:
+    """Node IDs with memory, as listed by the kernel (e.g. "0-1,4-5").
+
+    IDs can be sparse, so they are read from the node list rather than by
+    counting node* directories.
+    """
     node_root = Path("/sys/devices/system/node")
-    nodes = sorted(node_root.glob("node[0-9]*"))
+    for name in ("has_memory", "online"):
+        path = node_root / name
+        if path.is_file():
+            break
+    else:
+        raise RuntimeError(f"No NUMA node list found under {node_root}")
+
+    nodes: List[int] = []
+    for part in path.read_text().strip().split(","):
+        if not part:
+            continue
+        lo, _, hi = part.partition("-")
+        nodes.extend(range(int(lo), int(hi or lo) + 1))
     if not nodes:
-        raise RuntimeError(f"No NUMA nodes detected under {node_root}")
-    return len(nodes)
+        raise RuntimeError(f"No NUMA nodes listed in {path}")
+    return nodes
 
 
 def ensure_binaries(stream_path: Path, logger_path: Path) -> None:
@@ -153,77 +176,90 @@ def ensure_binaries(stream_path: Path, logger_path: Path) -> None:
         )
 
 
+class LoggerSession:
+    """One numa_stat_logger in session mode (-s) for all runs.
+
+    The logger labels every row with mem_policy and stream_run itself, so
+    nothing has to be re-read or rewritten after a run.
+    """
+
+    def __init__(
+        self,
+        logger_path: Path,
+        numa_nodes: List[int],
+        interval: float,
+        aggregate_csv: Path,
+        extra_args: Sequence[str] = (),
+    ) -> None:
+        aggregate_csv.parent.mkdir(parents=True, exist_ok=True)
+        self.proc = subprocess.Popen(
+            [
+                str(logger_path),
+                "--nodes",
+                ",".join(map(str, numa_nodes)),
+                "--output",
+                str(aggregate_csv),
+                "--run-column",
+                "stream_run",
+                *extra_args,
+                "auto",
+                str(interval),
+                "-s",
+            ],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+            text=True,
+            bufsize=1,
+        )
+
+    def command(self, line: str) -> str:
+        self.proc.stdin.write(line + "\n")
+        self.proc.stdin.flush()
+        reply = self.proc.stdout.readline().strip()
+        if not reply.startswith("ok"):
+            raise RuntimeError(
+                f"numa_stat_logger: '{line}' -> {reply or 'no reply'}")
+        return reply
+
+    def close(self) -> None:
+        if self.proc.poll() is None:
+            self.command("quit")
+            self.proc.stdin.close()
+        if self.proc.wait() != 0:
+            raise RuntimeError(
+                f"numa_stat_logger exited with status {self.proc.returncode}")
+
+
 def run_once(
+    session: LoggerSession,
     run_index: int,
     policy_name: str,
-    interval: float,
-    numa_count: int,
     stream_path: Path,
-    logger_path: Path,
     run_dir: Path,
-) -> Tuple[Path, str]:
+) -> str:
     run_dir.mkdir(parents=True, exist_ok=True)
     stream_cmd = [str(stream_path)]
 
-    logger_cmd = [
-        str(logger_path),
-        str(numa_count),
-        str(interval),
-        "-r",
-        *stream_cmd,
-    ]
-
     print(
         f"[run {run_index}] policy={policy_name} -> collecting NUMA stats ...",
         flush=True,
     )
-    result = subprocess.run(
-        logger_cmd,
-        check=True,
-        cwd=run_dir,
-        capture_output=True,
-        text=True,
-    )
+    session.command(f"start {run_index} {policy_name}")
+    try:
+        result = subprocess.run(
+            stream_cmd,
+            check=True,
+            cwd=run_dir,
+            capture_output=True,
+            text=True,
+        )
+    finally:
+        session.command("stop")
     if result.stdout:
         print(result.stdout, end="")
     if result.stderr:
         print(result.stderr, file=sys.stderr, end="")
-    return run_dir / LOGGER_OUTPUT, result.stdout or ""
-
-
-def append_with_metadata(
-    run_csv: Path,
-    aggregate_csv: Path,
-    policy_name: str,
-    run_index: int,
-) -> None:
-    if not run_csv.is_file():
-        raise FileNotFoundError(f"Expected logger output at {run_csv}")
-
-    raw_lines = run_csv.read_text(encoding="utf-8").strip().splitlines()
-    if not raw_lines:
-        print(f"[run {run_index}] warning: {run_csv} is empty, skipping.")
-        return
-
-    base_header = raw_lines[0]
-    rows = raw_lines[1:]
-    augmented_header = f"{base_header},mem_policy,stream_run"
-
-    aggregate_csv.parent.mkdir(parents=True, exist_ok=True)
-    if not aggregate_csv.exists():
-        aggregate_csv.write_text(augmented_header + "\n", encoding="utf-8")
-    else:
-        with aggregate_csv.open("r", encoding="utf-8") as existing:
-            existing_header = existing.readline().rstrip("\n")
-        if existing_header != augmented_header:
-            raise RuntimeError(
-                f"Aggregate header mismatch.\n"
-                f"Existing: {existing_header}\nExpected: {augmented_header}"
-            )
-
-    with aggregate_csv.open("a", encoding="utf-8") as dest:
-        for row in rows:
-            dest.write(f"{row},{policy_name},{run_index}\n")
+    return result.stdout or ""
 
 
 def parse_stream_results(stream_output: str) -> List[Dict[str, float]]:
@@ -330,30 +366,37 @@ def main() -> int:
         return 1
 
     print(
-        f"Detected {numa_nodes} NUMA nodes. "
+        f"Detected NUMA nodes {','.join(map(str, numa_nodes))}. "
         f"Running {args.runs} STREAM iterations starting at run {args.start_run}.",
         flush=True,
     )
 
-    for offset in range(args.runs):
-        run_index = args.start_run + offset
-        policy_name = policies[(run_index - 1) % len(policies)]
-        run_dir = args.output_dir / f"run_{run_index:02d}"
-        run_csv_path, stream_stdout = run_once(
-            run_index,
-            policy_name,
-            args.interval,
-            numa_nodes,
-            args.stream_binary.resolve(),
-            args.logger_binary.resolve(),
-            run_dir,
-        )
-        append_with_metadata(run_csv_path, aggregate_file,
-                             policy_name, run_index)
-        stream_results = parse_stream_results(stream_stdout)
-        append_stream_results(
-            stream_results, stream_results_file, policy_name, run_index
-        )
+    extra_args = ["--mbm", "--mbm-interval", str(args.interval)] if args.mbm else []
+    session = LoggerSession(
+        args.logger_binary.resolve(),
+        numa_nodes,
+        args.interval,
+        aggregate_file,
+        extra_args,
+    )
+    try:
+        for offset in range(args.runs):
+            run_index = args.start_run + offset
+            policy_name = policies[(run_index - 1) % len(policies)]
+            run_dir = args.output_dir / f"run_{run_index:02d}"
+            stream_stdout = run_once(
+                session,
+                run_index,
+                policy_name,
+                args.stream_binary.resolve(),
+                run_dir,
+            )
+            stream_results = parse_stream_results(stream_stdout)
+            append_stream_results(
+                stream_results, stream_results_file, policy_name, run_index
+            )
+    finally:
+        session.close()
 
     print(f"All runs complete. Aggregated CSV: {aggregate_file}")
     return 0
@@ -0,0 +1,98 @@
+"""
+Per-run node features and policy one-hots, shared by
+STREAM/preprocess_stream_log.py and rocksdb/preprocess_rocksdb_log.py.
+"""
+
+from __future__ import annotations
+
+import re
+from typing import List, NamedTuple, Sequence
+
+import numpy as np
+import pandas as pd
+
+
+NODE_COLUMN = re.compile(r"node_(\d+)_mem_used$")
+
+FIRST_TOUCH_ALIASES = {"default", "first_touch", "first-touch", "firsttouch"}
+INTERLEAVE_ALIASES = {"interleave", "interleave_all", "interleave-all"}
+
+# Per-node features in output order; each is written for every node.
+NODE_FEATURES = (
+    "usage",
+    "trend",
+    "min_usage",
+    "max_usage",
+    "volatility",
+    "free_pages_change",
+)
+
+
+class NodeArrays(NamedTuple):
+    """Per-node counters of the log as [node][sample] arrays: one
+    contiguous row per node, in the order of `nodes`."""
+    nodes: List[int]
+    mem_used: np.ndarray
+    mem_total: np.ndarray
+    nr_free_pages: np.ndarray
+
+
+def node_arrays(df: pd.DataFrame) -> NodeArrays:
+    """Build the arrays for every node the logger wrote columns for."""
+    nodes = sorted(int(m.group(1)) for m in map(NODE_COLUMN.match, df.columns) if m)
+    if not nodes:
+        raise ValueError("Input CSV has no node_N_mem_used columns")
+
+    def counter(name: str) -> np.ndarray:
+        columns = [f"node_{node}_{name}" for node in nodes]
+        for col in columns:
+            if col not in df.columns:
+                raise ValueError(f"Input CSV is missing required '{col}' column")
+        return np.ascontiguousarray(df[columns].to_numpy().T)
+
+    return NodeArrays(nodes, counter("mem_used"), counter("mem_total"),
+                      counter("nr_free_pages"))
+
+
+def node_features(arrays: NodeArrays, runs: np.ndarray,
+                  last_rows: np.ndarray) -> pd.DataFrame:
+    """Per-run usage features of every node, indexed by run.
+
+    Each feature is one operation over all nodes at once: usage is a single
+    [node][sample] division, and each aggregate a single groupby pass over
+    the node-major block (pandas keeps DataFrame blocks as [column][row],
+    so the arrays are used as they are).
+    """
+    usage = arrays.mem_used / arrays.mem_total
+    by_run = pd.DataFrame(usage.T, columns=arrays.nodes).groupby(runs)
+    free = pd.DataFrame(arrays.nr_free_pages.T, columns=arrays.nodes).groupby(runs)
+    last_usage = pd.DataFrame(usage[:, last_rows].T, columns=arrays.nodes,
+                              index=runs[last_rows])
+
+    per_feature = {
+        "usage": last_usage,
+        "trend": by_run.last() - by_run.first(),
+        "min_usage": by_run.min(),
+        "max_usage": by_run.max(),
+        "volatility": by_run.std(),
+        "free_pages_change": free.last() - free.first(),
+    }
+    return pd.DataFrame({
+        f"node_{node}_{feature}": per_feature[feature][node]
+        for feature in NODE_FEATURES
+        for node in arrays.nodes
+    })
+
+
+def policy_one_hots(policy: pd.Series, nodes: Sequence[int]) -> pd.DataFrame:
+    """first-touch, interleave and a preferred_N column per node."""
+    policy = policy.astype(str).str.strip().str.lower()
+    hots = {
+        "first-touch": policy.isin(FIRST_TOUCH_ALIASES).astype(int),
+        "interleave": policy.isin(INTERLEAVE_ALIASES).astype(int),
+    }
+    for node in nodes:
+        aliases = {f"preferred_node{node}", f"preferred_{node}",
+                   f"preferred{node}", f"preferred-{node}"}
+        hots[f"preferred_{node}"] = policy.isin(aliases).astype(int)
+    return pd.DataFrame(hots, index=policy.index)
@@ -3,12 +3,11 @@
 from __future__ import annotations
 
 import argparse
+import numpy as np
 import pandas as pd
 from pathlib import Path
-import re
 import subprocess
 import sys
-from typing import Dict, List, Sequence, Tuple
 
 
 def parse_args() -> argparse.Namespace:
@@ -31,6 +30,11 @@ def parse_args() -> argparse.Namespace:
     return parser.parse_args()
 
 
+# The shared feature code lives in data_collection/.
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent))
+from numa_features import node_arrays, node_features, policy_one_hots  # noqa: E402
+
+
 def main() -> int:
     args = parse_args()
 
@@ -38,129 +42,41 @@ def main() -> int:
     df = pd.read_csv(args.input_csv)
 
     # Validate required columns early
-    required = ['run_index', 'mem_policy', 'timestamp']
+    required = ['run_index', 'mem_policy', 'timestamp', 'numa_pages_migrated']
     for col in required:
         if col not in df.columns:
             raise ValueError(f"Input CSV is missing required '{col}' column")
 
-    # Normalize policy names
-    policy = df['mem_policy'].astype(str).str.strip().str.lower()
-
-    # --- One-hot encode memory policies ---
-    first_touch_aliases = {"default",
-                           "first_touch", "first-touch", "firsttouch"}
-    interleave_aliases = {"interleave", "interleave_all", "interleave-all"}
-    preferred0_aliases = {"preferred_node0",
-                          "preferred_0", "preferred0", "preferred-0"}
-    preferred1_aliases = {"preferred_node1",
-                          "preferred_1", "preferred1", "preferred-1"}
-
-    # Prepare 1-hot columns at full df resolution
-    # Take only the last row per run later.
-    df['first-touch'] = policy.isin(first_touch_aliases).astype(int)
-    df['interleave'] = policy.isin(interleave_aliases).astype(int)
-    df['preferred_0'] = policy.isin(preferred0_aliases).astype(int)
-    df['preferred_1'] = policy.isin(preferred1_aliases).astype(int)
-
-    # --- Compute per-run aggregates once ---
-    # Usage trends and statistics
-    usage_temp = pd.DataFrame()
-    usage_temp['node_0_usage'] = df['node_0_mem_used'] / df['node_0_mem_total']
-    usage_temp['node_1_usage'] = df['node_1_mem_used'] / df['node_1_mem_total']
-    usage_temp['run_index'] = df['run_index']
-
-    trends = usage_temp.groupby('run_index').agg(
-        node_0_start=('node_0_usage', 'first'),
-        node_0_end=('node_0_usage', 'last'),
-        node_0_min_usage=('node_0_usage', 'min'),
-        node_0_max_usage=('node_0_usage', 'max'),
-        node_0_volatility=('node_0_usage', 'std'),
-        node_1_start=('node_1_usage', 'first'),
-        node_1_end=('node_1_usage', 'last'),
-        node_1_min_usage=('node_1_usage', 'min'),
-        node_1_max_usage=('node_1_usage', 'max'),
-        node_1_volatility=('node_1_usage', 'std'),
-    )
-
-    trends['node_0_trend'] = trends['node_0_end'] - trends['node_0_start']
-    trends['node_1_trend'] = trends['node_1_end'] - trends['node_1_start']
-
-    # Free pages change
-    free_pages = df.groupby('run_index').agg(
-        node_0_free_start=('node_0_nr_free_pages', 'first'),
-        node_0_free_end=('node_0_nr_free_pages', 'last'),
-        node_1_free_start=('node_1_nr_free_pages', 'first'),
-        node_1_free_end=('node_1_nr_free_pages', 'last'),
-    )
-
-    free_pages['node_0_free_pages_change'] = (
-        free_pages['node_0_free_end'] - free_pages['node_0_free_start']
-    )
-    free_pages['node_1_free_pages_change'] = (
-        free_pages['node_1_free_end'] - free_pages['node_1_free_start']
-    )
+    arrays = node_arrays(df)
+    runs = df['run_index'].to_numpy()
 
-    # Total migration
-    if 'numa_pages_migrated' not in df.columns:
-        raise ValueError(
-            "Input CSV is missing required 'numa_pages_migrated' column")
+    # Position of the last row of each run, in log order.
+    last_rows = np.flatnonzero(~df.duplicated('run_index', keep='last').to_numpy())
+    last = df.iloc[last_rows].reset_index(drop=True)
 
-    migration = df.groupby('run_index').agg(
-        migration_start=('numa_pages_migrated', 'first'),
-        migration_end=('numa_pages_migrated', 'last'),
-    )
-    migration['total_page_migrations'] = (
-        migration['migration_end'] - migration['migration_start']
-    )
+    # --- Per-run aggregates ---
+    features = node_features(arrays, runs, last_rows)
 
-    # --- Extract only the last row per run ---
-    last = df.groupby('run_index').tail(1).reset_index(drop=True)
+    migration = df.groupby('run_index')['numa_pages_migrated'].agg(['first', 'last'])
+    total_page_migrations = migration['last'] - migration['first']
 
-    # Compute last-sample usage
-    last['node_0_usage'] = last['node_0_mem_used'] / last['node_0_mem_total']
-    last['node_1_usage'] = last['node_1_mem_used'] / last['node_1_mem_total']
-
-    # Compute run_timestep: last timestamp minus start timestamp
+    # run_timestep: last timestamp minus start timestamp
     run_start = df.groupby('run_index')['timestamp'].min()
-    last['run_timestep'] = last['timestamp'] - last['run_index'].map(run_start)
-
-    # --- Merge in the per-run aggregates ---
-    out = last.merge(trends, on='run_index', how='left')
-    out = out.merge(
-        free_pages[['node_0_free_pages_change', 'node_1_free_pages_change']],
-        on='run_index',
-        how='left'
-    )
-    out = out.merge(
-        migration[['total_page_migrations']],
-        on='run_index',
-        how='left'
-    )
 
-    # --- Select and order columns ---
-    column_order = [
-        'run_index',
-        'run_timestep',
-        'node_0_usage',
-        'node_1_usage',
-        'node_0_trend',
-        'node_1_trend',
-        'node_0_min_usage',
-        'node_1_min_usage',
-        'node_0_max_usage',
-        'node_1_max_usage',
-        'node_0_volatility',
-        'node_1_volatility',
-        'node_0_free_pages_change',
-        'node_1_free_pages_change',
-        'total_page_migrations',
-        'first-touch',
-        'interleave',
-        'preferred_0',
-        'preferred_1',
-    ]
-
-    out = out[column_order]
+    # --- One row per run, columns grouped by feature, then node ---
+    out = pd.DataFrame({
+        'run_index': last['run_index'],
+        'run_timestep': last['timestamp'] - last['run_index'].map(run_start),
+    })
+    out = pd.concat([
+        out,
+        features.loc[last['run_index']].reset_index(drop=True),
+        pd.DataFrame({
+            'total_page_migrations':
+                last['run_index'].map(total_page_migrations),
+        }),
+        policy_one_hots(last['mem_policy'], arrays.nodes),
+    ], axis=1)
 
     print(out.head())
 
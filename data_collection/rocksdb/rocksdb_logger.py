@@ -9,7 +9,7 @@ from pathlib import Path
 import re
 import subprocess
 import sys
-from typing import Dict, List, Sequence, Tuple
+from typing import Dict, List, Sequence
 from venv import logger
 
 POLICY_COMMANDS: Dict[str, List[str]] = {
@@ -18,7 +18,6 @@ POLICY_COMMANDS: Dict[str, List[str]] = {
     "preferred_node0": ["numactl", "--preferred=0"],
 }
 
-LOGGER_OUTPUT = "numa_stat_log.csv"
 ROCKS_DB_FUNCTIONS = (
     "fillrandom", "readseq", "readrandom", "readtocache", "readwhilescanning"
 )
@@ -127,33 +126,29 @@ def append_suffix_to_path(path: Path, suffix: str) -> Path:
     return path.with_name(new_name)
 
 
-def detect_numa_nodes() -> int:
-    command = "ls -d /sys/devices/system/node/node* | wc -l"
+def detect_numa_nodes() -> List[int]:
+    """Node IDs with memory, as listed by the kernel (e.g. "0-1,4-5").
 
-    try:
-        result = subprocess.run(
-            command,
-            shell=True,
-            check=True,
-            capture_output=True,
-            text=True
-        )
-        count_str = result.stdout.strip()
-        if not count_str:
-            return 0
-        return int(count_str)
+    IDs can be sparse, so they are read from the node list rather than by
+    counting node* directories.
+    """
+    node_root = Path("/sys/devices/system/node")
+    for name in ("has_memory", "online"):
+        path = node_root / name
+        if path.is_file():
+            break
+    else:
+        raise RuntimeError(f"No NUMA node list found under {node_root}")
 
-    except subprocess.CalledProcessError as e:
-        print(
-            f"Error running NUMA detection command (Exit Status {e.returncode}):")
-        print(f"Stderr: {e.stderr.strip()}")
-        return None
-    except FileNotFoundError:
-        print("System shell or necessary command ('ls', 'wc') not found.")
-        return None
-    except Exception as e:
-        print(f"An unexpected error occurred: {e}")
-        return None
+    nodes: List[int] = []
+    for part in path.read_text().strip().split(","):
+        if not part:
+            continue
+        lo, _, hi = part.partition("-")
+        nodes.extend(range(int(lo), int(hi or lo) + 1))
+    if not nodes:
+        raise RuntimeError(f"No NUMA nodes listed in {path}")
+    return nodes
 
 
 def ensure_binaries(db_bench_path: Path, logger_path: Path) -> None:
@@ -205,76 +200,86 @@ def generate_num_intervals(
     return num_list
 
 
-def run_benchmark_and_logger(
+class LoggerSession:
+    """One numa_stat_logger in session mode (-s) for all runs.
+
+    Every run is bracketed by start/stop commands, and the logger writes the
+    mem_policy and run_index columns itself, straight into the raw CSV.
+    """
+
+    def __init__(
+        self,
+        logger_path: Path,
+        numa_nodes: List[int],
+        interval: float,
+        raw_file: Path,
+    ) -> None:
+        raw_file.parent.mkdir(parents=True, exist_ok=True)
+        self.proc = subprocess.Popen(
+            [
+                str(logger_path),
+                "--nodes",
+                ",".join(map(str, numa_nodes)),
+                "--output",
+                str(raw_file),
+                "--run-column",
+                "run_index",
+                "auto",
+                str(interval),
+                "-s",
+            ],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+            text=True,
+            bufsize=1,
+        )
+
+    def command(self, line: str) -> str:
+        self.proc.stdin.write(line + "\n")
+        self.proc.stdin.flush()
+        reply = self.proc.stdout.readline().strip()
+        if not reply.startswith("ok"):
+            raise RuntimeError(
+                f"numa_stat_logger: '{line}' -> {reply or 'no reply'}")
+        return reply
+
+    def close(self) -> None:
+        if self.proc.poll() is None:
+            self.command("quit")
+            self.proc.stdin.close()
+        if self.proc.wait() != 0:
+            raise RuntimeError(
+                f"numa_stat_logger exited with status {self.proc.returncode}")
+
+
+def run_benchmark(
+    session: LoggerSession,
     run_index: int,
     policy_name: str,
-    interval: float,
-    numa_count: int,
     db_bench_helper_path: Path,
     db_bench_num_iter: int,
-    logger_path: Path,
     run_dir: Path,
-) -> Tuple[Path, str]:
+) -> str:
     run_dir.mkdir(parents=True, exist_ok=True)
 
-    logger_cmd = [
-        str(logger_path),
-        str(numa_count),
-        str(interval),
-        "-r",
-        str(db_bench_helper_path.resolve()),
-        str(db_bench_num_iter)
-    ]
-
     print(
         f"[run {run_index}] policy={policy_name} -> collecting NUMA stats ...",
         flush=True,
     )
 
-    result = subprocess.run(
-        logger_cmd,
-        check=True,
-        cwd=run_dir,
-        capture_output=True,
-        text=True,
-    )
-
-    return run_dir / LOGGER_OUTPUT, result.stdout or ""
-
-
-def append_with_metadata(
-    run_file: Path,
-    raw_file: Path,
-    policy_name: str,
-    run_index: int,
-) -> None:
-    if not run_file.is_file():
-        raise FileNotFoundError(f"Expected logger output at {run_file}")
-
-    raw_lines = run_file.read_text(encoding="utf-8").strip().splitlines()
-    if not raw_lines:
-        print(f"[run {run_index}] warning: {run_file} is empty, skipping.")
-        return
-
-    base_header = raw_lines[0]
-    rows = raw_lines[1:]
-    augmented_header = f"{base_header},mem_policy,run_index"
-
-    raw_file.parent.mkdir(parents=True, exist_ok=True)
-    if not raw_file.exists():
-        raw_file.write_text(augmented_header + "\n", encoding="utf-8")
-    else:
-        with raw_file.open("r", encoding="utf-8") as existing:
-            existing_header = existing.readline().rstrip("\n")
-        if existing_header != augmented_header:
-            raise RuntimeError(
-                f"Aggregate header mismatch.\n"
-                f"Existing: {existing_header}\nExpected: {augmented_header}"
-            )
+    session.command(f"start {run_index} {policy_name}")
+    try:
+        result = subprocess.run(
+            [str(db_bench_helper_path.resolve()), str(db_bench_num_iter)],
+            check=True,
+            cwd=run_dir,
+            capture_output=True,
+            text=True,
+        )
+    finally:
+        session.command("stop")
 
-    with raw_file.open("a", encoding="utf-8") as dest:
-        for row in rows:
-            dest.write(f"{row},{policy_name},{run_index}\n")
+    return result.stdout or ""
 
 
 def parse_benchmark_results(db_bench_output: str) -> List[Dict[str, float]]:
@@ -380,33 +385,38 @@ def main() -> int:
         return 1
 
     print(
-        f"Detected {numa_nodes} NUMA nodes. "
+        f"Detected NUMA nodes {','.join(map(str, numa_nodes))}. "
         f"Running {args.runs} STREAM iterations starting at run {args.start_run}.",
         flush=True,
     )
 
     db_bench_num_iter = generate_num_intervals(args.runs)
 
-    for offset in range(args.runs):
-        run_index = args.start_run + offset
-        policy_name = policies[(run_index - 1) % len(policies)]
-        run_dir = args.output_dir / f"run_{run_index:02d}"
-
-        run_csv_path, db_bench_stdout = run_benchmark_and_logger(
-            run_index,
-            policy_name,
-            args.interval,
-            numa_nodes,
-            args.db_bench_helper_script.expanduser(),
-            db_bench_num_iter[offset],
-            args.logger_binary.expanduser(),
-            run_dir,
-        )
-        append_with_metadata(run_csv_path.resolve(),
-                             raw_file, policy_name, run_index)
-        benchmark_results = parse_benchmark_results(db_bench_stdout)
-        append_benchmark_results(
-            benchmark_results, aggregate_benchmark_file, policy_name, run_index)
+    session = LoggerSession(
+        args.logger_binary.expanduser(),
+        numa_nodes,
+        args.interval,
+        raw_file,
+    )
+    try:
+        for offset in range(args.runs):
+            run_index = args.start_run + offset
+            policy_name = policies[(run_index - 1) % len(policies)]
+            run_dir = args.output_dir / f"run_{run_index:02d}"
+
+            db_bench_stdout = run_benchmark(
+                session,
+                run_index,
+                policy_name,
+                args.db_bench_helper_script.expanduser(),
+                db_bench_num_iter[offset],
+                run_dir,
+            )
+            benchmark_results = parse_benchmark_results(db_bench_stdout)
+            append_benchmark_results(
+                benchmark_results, aggregate_benchmark_file, policy_name, run_index)
+    finally:
+        session.close()
 
     print(f"All runs complete. Raw CSV: {raw_file}")
     return 0
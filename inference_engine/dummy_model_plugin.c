@@ -0,0 +1,44 @@
+// In-process counterpart of dummy_model.sh for numa_stat_logger --policy:
+//
+//   cc -O2 -shared -fPIC -I../src dummy_model_plugin.c -o dummy_model_plugin.so
+//   ../src/numa_stat_logger --policy plugin:./dummy_model_plugin.so auto 0.1 -r ./dummy_executable_benchmark.sh
+//
+// Like the script it always answers mode 1; it also shows how a model finds
+// its input columns once at init and reads them from every sample.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "policy_plugin.h"
+
+struct model {
+    int numa_hit_col;
+    uint64_t numa_hit;      // last value read, the model's only input
+};
+
+int numa_policy_init(const struct numa_policy_sample* schema, void** state)
+{
+    struct model* m = calloc(1, sizeof(*m));
+    if (!m)
+        return -1;
+    m->numa_hit_col = -1;
+    for (int i = 0; i < schema->ncols; i++)
+        if (strcmp(schema->names[i], "node_0_numa_hit") == 0)
+            m->numa_hit_col = i;
+    *state = m;
+    return 0;
+}
+
+int numa_policy_decide(const struct numa_policy_sample* sample, void* state)
+{
+    struct model* m = state;
+    if (m->numa_hit_col >= 0)
+        m->numa_hit = sample->cells[m->numa_hit_col].u;
+    return 1;
+}
+
+void numa_policy_fini(void* state)
+{
+    free(state);
+}
@@ -0,0 +1,27 @@
+#ifndef CELL_H
+#define CELL_H
+
+#include <stdint.h>
+
+// One output value. Every column is 8 bytes wide; its type says how to
+// read it.
+enum cell_type {
+    CELL_U64,
+    CELL_I64,
+    CELL_F64,
+    CELL_LABEL,     // index into the schema's label table; CSV writes the text
+};
+
+union cell {
+    uint64_t u;
+    int64_t i;
+    double f;
+};
+
+// One output row: a CLOCK_REALTIME timestamp followed by its cells.
+struct record {
+    int64_t ts_ns;
+    union cell cells[];
+};
+
+#endif
@@ -0,0 +1,266 @@
+#include "cgroup.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stat_file.h"
+#include "stat_parse.h"
+
+// memory.numa_stat lines look like "anon N0=1234 N1=5678".
+static const char* const numa_keys[CGROUP_NUMA_KEYS] = {
+    "anon",
+    "file",
+    "anon_thp",
+    "shmem",
+};
+#define NUMA_KEYS CGROUP_NUMA_KEYS
+
+// memory.stat is "key value"; keys the kernel does not have stay 0.
+static const struct stat_key memstat_keys[] = {
+    { "anon", 0 * sizeof(uint64_t) },
+    { "file", 1 * sizeof(uint64_t) },
+    { "numa_pages_migrated", 2 * sizeof(uint64_t) },
+    { "numa_hint_faults", 3 * sizeof(uint64_t) },
+    { "pgpromote_success", 4 * sizeof(uint64_t) },
+    { "pgdemote_kswapd", 5 * sizeof(uint64_t) },
+    { "pgdemote_direct", 6 * sizeof(uint64_t) },
+};
+static const char* const memstat_columns[] = {
+    "cg_anon_bytes",
+    "cg_file_bytes",
+    "cg_numa_pages_migrated",
+    "cg_numa_hint_faults",
+    "cg_pgpromote_success",
+    "cg_pgdemote_kswapd",
+    "cg_pgdemote_direct",
+};
+#define MEMSTAT_KEYS (int)(sizeof(memstat_keys) / sizeof(memstat_keys[0]))
+
+// Column order: NUMA_KEYS values per node, the memory.stat values, then
+// cg_valid.
+struct cgroup {
+    const struct node_set* nodes;
+    char mount[PATH_MAX];
+    char path[PATH_MAX];        // relative to mount in auto mode
+    struct stat_file numa_stat;
+    struct stat_file memstat;
+    struct stat_parser parser;
+
+    // auto mode: /proc/<pid>/cgroup of the attached process.
+    int follow;
+    struct stat_file proc_cgroup;
+};
+
+// Where cgroup2 is mounted: /sys/fs/cgroup, or /sys/fs/cgroup/unified on
+// hybrid hosts.
+static int find_mount(char* mount, size_t size)
+{
+    FILE* fp = fopen("/proc/self/mountinfo", "r");
+    if (!fp) {
+        perror("/proc/self/mountinfo");
+        return -1;
+    }
+
+    char line[4096];
+    int found = 0;
+    while (!found && fgets(line, sizeof(line), fp)) {
+        // id parent major:minor root mountpoint options... - fstype ...
+        char point[PATH_MAX];
+        const char* sep = strstr(line, " - ");
+        if (sep && strncmp(sep + 3, "cgroup2 ", 8) == 0 &&
+            sscanf(line, "%*s %*s %*s %*s %4095s", point) == 1) {
+            snprintf(mount, size, "%s", point);
+            found = 1;
+        }
+    }
+    fclose(fp);
+    if (!found)
+        fprintf(stderr, "No cgroup2 file system is mounted\n");
+    return found ? 0 : -1;
+}
+
+static void close_group(struct cgroup* g)
+{
+    stat_file_close(&g->numa_stat);
+    stat_file_close(&g->memstat);
+}
+
+static int open_group(struct cgroup* g, const char* dir)
+{
+    char path[PATH_MAX + 32];
+    close_group(g);
+
+    snprintf(path, sizeof(path), "%s/memory.numa_stat", dir);
+    if (stat_file_open(&g->numa_stat, path) != 0) {
+        perror(path);
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/memory.stat", dir);
+    if (stat_file_open(&g->memstat, path) != 0) {
+        perror(path);
+        close_group(g);
+        return -1;
+    }
+    return 0;
+}
+
+// In auto mode, switch to the attached process's current cgroup if it has
+// moved since the last sample. Only a move costs any allocation.
+static void follow_process(struct cgroup* g)
+{
+    if (stat_file_read(&g->proc_cgroup) != 0)
+        return;
+
+    const char* rel = strstr(g->proc_cgroup.buf, "0::");
+    if (!rel || (rel != g->proc_cgroup.buf && rel[-1] != '\n'))
+        return;
+    rel += 3;
+    size_t len = strcspn(rel, "\n");
+    if (len >= sizeof(g->path) || (strncmp(g->path, rel, len) == 0 && g->path[len] == '\0'))
+        return;
+
+    memcpy(g->path, rel, len);
+    g->path[len] = '\0';
+    char dir[2 * PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s%s", g->mount, strcmp(g->path, "/") == 0 ? "" : g->path);
+    open_group(g, dir);
+}
+
+void cgroup_parse_numa_stat(const char* buf, const struct node_set* nodes, union cell* out)
+{
+    for (const char* line = buf; *line;) {
+        const char* eol = strchr(line, '\n');
+        if (!eol)
+            eol = line + strlen(line);
+        size_t klen = strcspn(line, " \n");
+
+        for (int k = 0; k < NUMA_KEYS; k++) {
+            if (strlen(numa_keys[k]) != klen || memcmp(line, numa_keys[k], klen) != 0)
+                continue;
+            for (const char* p = line + klen; p < eol;) {
+                char* end;
+                if (*p != 'N') {
+                    p++;
+                    continue;
+                }
+                long id = strtol(p + 1, &end, 10);
+                if (*end != '=') {
+                    p = end;
+                    continue;
+                }
+                uint64_t v = strtoull(end + 1, &end, 10);
+                int idx = node_set_index(nodes, (int)id);
+                if (idx >= 0)
+                    out[idx * NUMA_KEYS + k].u = v;
+                p = end;
+            }
+            break;
+        }
+        line = *eol ? eol + 1 : eol;
+    }
+}
+
+// While the group cannot be read (not attached yet, or a followed group
+// that failed to open or was removed) the row has zeros and cg_valid 0.
+static void cgroup_sample(struct collector* c, union cell* out)
+{
+    struct cgroup* g = c->priv;
+    if (g->follow)
+        follow_process(g);
+
+    int per_node = g->nodes->count * NUMA_KEYS;
+    for (int i = 0; i < c->ncols; i++)
+        out[i].u = 0;
+    if (g->numa_stat.fd < 0 || g->memstat.fd < 0 ||
+        stat_file_read(&g->numa_stat) != 0 || stat_file_read(&g->memstat) != 0)
+        return;
+
+    uint64_t v[MEMSTAT_KEYS] = { 0 };
+    cgroup_parse_numa_stat(g->numa_stat.buf, g->nodes, out);
+    stat_parser_run(&g->parser, g->memstat.buf, v);
+    for (int k = 0; k < MEMSTAT_KEYS; k++)
+        out[per_node + k].u = v[k];
+    out[per_node + MEMSTAT_KEYS].u = 1;
+}
+
+static void cgroup_destroy(struct collector* c)
+{
+    struct cgroup* g = c->priv;
+    if (!g)
+        return;
+    close_group(g);
+    stat_file_close(&g->proc_cgroup);
+    stat_parser_free(&g->parser);
+    free(g);
+    c->priv = NULL;
+}
+
+void cgroup_attach(struct collector* c, pid_t pid)
+{
+    struct cgroup* g = c->priv;
+    if (!g->follow)
+        return;
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/cgroup", (int)pid);
+    stat_file_close(&g->proc_cgroup);
+    g->path[0] = '\0';
+    if (stat_file_open(&g->proc_cgroup, path) != 0)
+        perror(path);
+    else
+        follow_process(g);
+}
+
+int cgroup_create(struct collector* c, struct log_schema* ls, const char* path,
+    const struct node_set* nodes, uint64_t period)
+{
+    collector_init(c, "cgroup", period);
+    c->sample = cgroup_sample;
+    c->destroy = cgroup_destroy;
+
+    struct cgroup* g = calloc(1, sizeof(*g));
+    if (!g)
+        return -1;
+    c->priv = g;
+    g->nodes = nodes;
+    g->numa_stat.fd = -1;
+    g->memstat.fd = -1;
+    g->proc_cgroup.fd = -1;
+    if (stat_parser_init(&g->parser, memstat_keys, MEMSTAT_KEYS) != 0)
+        return -1;
+
+    if (find_mount(g->mount, sizeof(g->mount)) != 0)
+        return -1;
+    g->follow = strcmp(path, "auto") == 0;
+    if (!g->follow) {
+        // Groups are named relative to the cgroup2 mount, "/" being the root
+        // group; a path that already starts with the mount is accepted too.
+        size_t mlen = strlen(g->mount);
+        if (strncmp(path, g->mount, mlen) == 0 && (path[mlen] == '/' || path[mlen] == '\0'))
+            path += mlen;
+        while (*path == '/')
+            path++;
+
+        char dir[2 * PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s%s%s", g->mount, *path ? "/" : "", path);
+        if (open_group(g, dir) != 0)
+            return -1;
+    }
+
+    char name[LOG_NAME_MAX];
+    for (int i = 0; i < nodes->count; i++) {
+        for (int k = 0; k < NUMA_KEYS; k++) {
+            snprintf(name, sizeof(name), "cg_node_%d_%s_bytes", nodes->ids[i], numa_keys[k]);
+            if (collector_add_column(c, ls, name, CELL_U64) < 0)
+                return -1;
+        }
+    }
+    for (int k = 0; k < MEMSTAT_KEYS; k++)
+        if (collector_add_column(c, ls, memstat_columns[k], CELL_U64) < 0)
+            return -1;
+    if (collector_add_column(c, ls, "cg_valid", CELL_U64) < 0)
+        return -1;
+    return collector_finish(c);
+}
@@ -0,0 +1,26 @@
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <sys/types.h>
+
+#include "collector.h"
+#include "nodes.h"
+
+// Memory accounting of one cgroup v2 group: per-node anon, file, anon_thp
+// and shmem bytes from memory.numa_stat, and the group's totals and page
+// migration counters from memory.stat. path is a group relative to the
+// cgroup2 mount ("/" is the root group), or "auto" for the cgroup of the
+// process given to cgroup_attach(), which is followed if the process moves.
+int cgroup_create(struct collector* c, struct log_schema* ls, const char* path,
+    const struct node_set* nodes, uint64_t period);
+void cgroup_attach(struct collector* c, pid_t pid);
+
+// Values per node taken from memory.numa_stat, in the order anon, file,
+// anon_thp, shmem.
+#define CGROUP_NUMA_KEYS 4
+
+// Store the memory.numa_stat text in buf into out, CGROUP_NUMA_KEYS cells
+// per node of nodes; cells of keys or nodes not in buf are left alone.
+void cgroup_parse_numa_stat(const char* buf, const struct node_set* nodes, union cell* out);
+
+#endif
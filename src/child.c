@@ -0,0 +1,122 @@
+#define _GNU_SOURCE
+#include "child.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "placement.h"
+
+extern char** environ;
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+static int pidfd_open(pid_t pid)
+{
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+// Start argv with posix_spawn (a vfork-style clone on glibc, so nothing of
+// the logger is copied). The command gets the placement `place`, when
+// given: it is applied to the calling thread just for the spawn, which
+// the child inherits. SIGCHLD is only blocked (for the signalfd fallback)
+// when pidfds are unavailable; the child always starts with it unblocked.
+int child_spawn(struct child* c, char** argv, const struct placement* place)
+{
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+
+    int probe = pidfd_open(getpid());
+    sigset_t chld, old;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, NULL, &old);
+
+    if (probe >= 0) {
+        close(probe);
+    }
+    else {
+        c->use_signalfd = 1;
+        sigprocmask(SIG_BLOCK, &chld, NULL);
+        c->fd = signalfd(-1, &chld, SFD_CLOEXEC | SFD_NONBLOCK);
+        if (c->fd < 0) {
+            perror("signalfd");
+            return -1;
+        }
+    }
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &old);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    struct placement self;
+    int saved = 0, err = 0;
+    if (place) {
+        saved = placement_get(&self) == 0;
+        if (!saved || placement_apply(place) != 0)
+            err = -1;
+    }
+    if (err == 0) {
+        err = posix_spawnp(&c->pid, argv[0], NULL, &attr, argv, environ);
+        if (err != 0)
+            fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+    }
+    if (saved && placement_apply(&self) != 0)
+        err = -1;
+    posix_spawnattr_destroy(&attr);
+    if (err != 0) {
+        c->pid = -1;
+        return -1;
+    }
+
+    if (!c->use_signalfd) {
+        c->fd = pidfd_open(c->pid);
+        if (c->fd < 0) {
+            perror("pidfd_open");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Called when the descriptor is readable. Returns 1 once the child exited.
+int child_handle(struct child* c)
+{
+    if (c->use_signalfd) {
+        struct signalfd_siginfo si;
+        while (read(c->fd, &si, sizeof(si)) == sizeof(si))
+            ;
+    }
+
+    pid_t ret = waitpid(c->pid, &c->status, WNOHANG);
+    if (ret == c->pid || (ret < 0 && errno == ECHILD))
+        c->exited = 1;
+    return c->exited;
+}
+
+void child_wait(struct child* c)
+{
+    if (c->pid > 0 && !c->exited) {
+        while (waitpid(c->pid, &c->status, 0) < 0 && errno == EINTR)
+            ;
+        c->exited = 1;
+    }
+}
+
+void child_close(struct child* c)
+{
+    if (c->fd >= 0)
+        close(c->fd);
+    c->fd = -1;
+}
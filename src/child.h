@@ -0,0 +1,24 @@
+#ifndef CHILD_H
+#define CHILD_H
+
+#include <sys/types.h>
+
+struct placement;
+
+// The command run in -r mode. Its exit is delivered as a readable file
+// descriptor: a pidfd where the kernel supports it, otherwise a signalfd
+// for SIGCHLD.
+struct child {
+    pid_t pid;
+    int fd;
+    int use_signalfd;
+    int exited;
+    int status;
+};
+
+int child_spawn(struct child* c, char** argv, const struct placement* place);
+int child_handle(struct child* c);
+void child_wait(struct child* c);
+void child_close(struct child* c);
+
+#endif
@@ -0,0 +1,64 @@
+#include "collector.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void collector_init(struct collector* c, const char* name, uint64_t period)
+{
+    memset(c, 0, sizeof(*c));
+    c->name = name;
+    c->period = period ? period : 1;
+    c->first_col = -1;
+}
+
+// Columns of one collector must be added back to back.
+int collector_add_column(struct collector* c, struct log_schema* ls,
+    const char* name, enum cell_type type)
+{
+    int col = log_schema_add(ls, name, type);
+    if (col < 0)
+        return -1;
+    if (c->first_col < 0)
+        c->first_col = col;
+    c->ncols++;
+    return col;
+}
+
+// Allocate the last-value buffer once all columns are known.
+int collector_finish(struct collector* c)
+{
+    c->last = calloc(c->ncols ? c->ncols : 1, sizeof(union cell));
+    return c->last ? 0 : -1;
+}
+
+// Refresh the collector on its own ticks and copy its latest values into
+// the row. Returns 1 if it was refreshed.
+int collector_run(struct collector* c, uint64_t tick, union cell* cells)
+{
+    int due = tick % c->period == 0;
+    if (due)
+        c->sample(c, c->last);
+    collector_fill(c, cells);
+    return due;
+}
+
+// Copy the latest values without sampling.
+void collector_fill(const struct collector* c, union cell* cells)
+{
+    memcpy(&cells[c->first_col], c->last, sizeof(union cell) * c->ncols);
+}
+
+void collector_free(struct collector* c)
+{
+    if (c->destroy)
+        c->destroy(c);
+    free(c->last);
+    c->last = NULL;
+}
+
+uint64_t collector_period_ticks(double period_sec, double interval_sec)
+{
+    double ticks = llround(period_sec / interval_sec);
+    return ticks < 1 ? 1 : (uint64_t)ticks;
+}
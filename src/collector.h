@@ -0,0 +1,34 @@
+#ifndef COLLECTOR_H
+#define COLLECTOR_H
+
+#include <stdint.h>
+
+#include "cell.h"
+#include "logfmt.h"
+
+// An extra source of columns that is more expensive than the core counters
+// and therefore sampled every `period` ticks only. Between its samples the
+// last values are repeated in every row.
+struct collector {
+    const char* name;
+    uint64_t period;
+    int first_col;
+    int ncols;
+    union cell* last;
+    void* priv;
+
+    void (*sample)(struct collector* c, union cell* out);
+    void (*destroy)(struct collector* c);
+};
+
+void collector_init(struct collector* c, const char* name, uint64_t period);
+int collector_add_column(struct collector* c, struct log_schema* ls,
+    const char* name, enum cell_type type);
+int collector_finish(struct collector* c);
+int collector_run(struct collector* c, uint64_t tick, union cell* cells);
+void collector_fill(const struct collector* c, union cell* cells);
+void collector_free(struct collector* c);
+
+uint64_t collector_period_ticks(double period_sec, double interval_sec);
+
+#endif
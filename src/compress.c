@@ -0,0 +1,245 @@
+#define _GNU_SOURCE
+#include "compress.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+#define DEFAULT_FRAME_ROWS 1000
+
+// lz4 input is fed in chunks of this size, so one chunk always fits the
+// output buffer.
+#define LZ4_CHUNK (64 * 1024)
+
+int compress_parse(const char* spec, struct compress_spec* z)
+{
+    const char* colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+
+    if (len == 4 && strncmp(spec, "zstd", 4) == 0) {
+        z->kind = COMPRESS_ZSTD;
+        z->level = 3;
+    }
+    else if (len == 3 && strncmp(spec, "lz4", 3) == 0) {
+        z->kind = COMPRESS_LZ4;
+        z->level = 0;
+    }
+    else if (len == 4 && strncmp(spec, "none", 4) == 0) {
+        z->kind = COMPRESS_NONE;
+        return 0;
+    }
+    else {
+        fprintf(stderr, "Unknown --compress '%s' (expected zstd[:level] or lz4[:level])\n", spec);
+        return -1;
+    }
+
+    if (colon) {
+        char* end;
+        long level = strtol(colon + 1, &end, 10);
+        if (*end || colon[1] == '\0') {
+            fprintf(stderr, "Invalid --compress level: %s\n", colon + 1);
+            return -1;
+        }
+        z->level = (int)level;
+    }
+
+#ifndef HAVE_ZSTD
+    if (z->kind == COMPRESS_ZSTD) {
+        fprintf(stderr, "numa_stat_logger was built without zstd (rebuild with make ZSTD=1)\n");
+        return -1;
+    }
+#endif
+#ifndef HAVE_LZ4
+    if (z->kind == COMPRESS_LZ4) {
+        fprintf(stderr, "numa_stat_logger was built without lz4 (rebuild with make LZ4=1)\n");
+        return -1;
+    }
+#endif
+    if (!z->frame_rows)
+        z->frame_rows = DEFAULT_FRAME_ROWS;
+    return 0;
+}
+
+const char* compress_suffix(enum compress_kind kind)
+{
+    if (kind == COMPRESS_ZSTD)
+        return ".zst";
+    if (kind == COMPRESS_LZ4)
+        return ".lz4";
+    return "";
+}
+
+#if defined(HAVE_ZSTD) || defined(HAVE_LZ4)
+static int put_raw(struct compressor* z, size_t n)
+{
+    if (n && fwrite(z->buf, 1, n, z->raw) != n) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+#ifdef HAVE_LZ4
+static void lz4_prefs(const struct compressor* z, LZ4F_preferences_t* prefs)
+{
+    memset(prefs, 0, sizeof(*prefs));
+    prefs->frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+    prefs->compressionLevel = z->level;
+}
+#endif
+
+static ssize_t z_write(void* cookie, const char* data, size_t size)
+{
+    struct compressor* z = cookie;
+
+#ifdef HAVE_ZSTD
+    if (z->kind == COMPRESS_ZSTD) {
+        ZSTD_inBuffer in = { data, size, 0 };
+        while (in.pos < in.size) {
+            ZSTD_outBuffer out = { z->buf, z->cap, 0 };
+            size_t ret = ZSTD_compressStream2(z->ctx, &out, &in, ZSTD_e_continue);
+            if (ZSTD_isError(ret) || put_raw(z, out.pos) != 0) {
+                errno = EIO;
+                return -1;
+            }
+        }
+        z->in_frame = 1;
+        return (ssize_t)size;
+    }
+#endif
+#ifdef HAVE_LZ4
+    if (z->kind == COMPRESS_LZ4) {
+        if (!z->in_frame) {
+            LZ4F_preferences_t prefs;
+            lz4_prefs(z, &prefs);
+            size_t n = LZ4F_compressBegin(z->ctx, z->buf, z->cap, &prefs);
+            if (LZ4F_isError(n) || put_raw(z, n) != 0) {
+                errno = EIO;
+                return -1;
+            }
+            z->in_frame = 1;
+        }
+        for (size_t off = 0; off < size; off += LZ4_CHUNK) {
+            size_t len = size - off < LZ4_CHUNK ? size - off : LZ4_CHUNK;
+            size_t n = LZ4F_compressUpdate(z->ctx, z->buf, z->cap, data + off, len, NULL);
+            if (LZ4F_isError(n) || put_raw(z, n) != 0) {
+                errno = EIO;
+                return -1;
+            }
+        }
+        return (ssize_t)size;
+    }
+#endif
+    (void)z;
+    (void)data;
+    (void)size;
+    errno = EINVAL;
+    return -1;
+}
+
+// Close the current frame, if any, and push it to the file.
+int compress_end_frame(struct compressor* z)
+{
+    if (!z->in_frame)
+        return 0;
+
+#ifdef HAVE_ZSTD
+    if (z->kind == COMPRESS_ZSTD) {
+        ZSTD_inBuffer in = { NULL, 0, 0 };
+        size_t remaining;
+        do {
+            ZSTD_outBuffer out = { z->buf, z->cap, 0 };
+            remaining = ZSTD_compressStream2(z->ctx, &out, &in, ZSTD_e_end);
+            if (ZSTD_isError(remaining) || put_raw(z, out.pos) != 0)
+                return -1;
+        } while (remaining != 0);
+    }
+#endif
+#ifdef HAVE_LZ4
+    if (z->kind == COMPRESS_LZ4) {
+        size_t n = LZ4F_compressEnd(z->ctx, z->buf, z->cap, NULL);
+        if (LZ4F_isError(n) || put_raw(z, n) != 0)
+            return -1;
+    }
+#endif
+    z->in_frame = 0;
+    return fflush(z->raw) == 0 ? 0 : -1;
+}
+
+static void free_ctx(struct compressor* z)
+{
+#ifdef HAVE_ZSTD
+    if (z->kind == COMPRESS_ZSTD && z->ctx)
+        ZSTD_freeCCtx(z->ctx);
+#endif
+#ifdef HAVE_LZ4
+    if (z->kind == COMPRESS_LZ4 && z->ctx)
+        LZ4F_freeCompressionContext(z->ctx);
+#endif
+    z->ctx = NULL;
+}
+
+static int z_close(void* cookie)
+{
+    struct compressor* z = cookie;
+    int ret = compress_end_frame(z);
+
+    free_ctx(z);
+    free(z->buf);
+    if (fclose(z->raw) != 0)
+        ret = -1;
+    memset(z, 0, sizeof(*z));
+    return ret;
+}
+
+// Wrap raw in a compressing stream. Closing the returned stream closes the
+// last frame and raw.
+FILE* compress_open(struct compressor* z, FILE* raw, const struct compress_spec* spec)
+{
+    memset(z, 0, sizeof(*z));
+    z->kind = spec->kind;
+    z->level = spec->level;
+    z->raw = raw;
+
+#ifdef HAVE_ZSTD
+    if (z->kind == COMPRESS_ZSTD) {
+        z->cap = ZSTD_CStreamOutSize();
+        z->ctx = ZSTD_createCCtx();
+        if (z->ctx)
+            ZSTD_CCtx_setParameter(z->ctx, ZSTD_c_compressionLevel, spec->level);
+    }
+#endif
+#ifdef HAVE_LZ4
+    if (z->kind == COMPRESS_LZ4) {
+        LZ4F_cctx* ctx = NULL;
+        LZ4F_preferences_t prefs;
+        lz4_prefs(z, &prefs);
+        if (!LZ4F_isError(LZ4F_createCompressionContext(&ctx, LZ4F_VERSION)))
+            z->ctx = ctx;
+        z->cap = LZ4F_compressBound(LZ4_CHUNK, &prefs) + LZ4F_HEADER_SIZE_MAX;
+    }
+#endif
+
+    if (z->ctx)
+        z->buf = malloc(z->cap);
+    FILE* fp = NULL;
+    if (z->ctx && z->buf) {
+        cookie_io_functions_t io = { .write = z_write, .close = z_close };
+        fp = fopencookie(z, "w", io);
+    }
+    if (!fp) {
+        fprintf(stderr, "Failed to set up %s compression\n", spec->kind == COMPRESS_ZSTD ? "zstd" : "lz4");
+        free_ctx(z);
+        free(z->buf);
+        z->buf = NULL;
+    }
+    return fp;
+}
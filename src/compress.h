@@ -0,0 +1,40 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum compress_kind {
+    COMPRESS_NONE,
+    COMPRESS_ZSTD,      // built with make ZSTD=1
+    COMPRESS_LZ4,       // built with make LZ4=1
+};
+
+// --compress zstd[:level] | lz4[:level], with a frame closed every
+// frame_rows rows.
+struct compress_spec {
+    enum compress_kind kind;
+    int level;
+    uint64_t frame_rows;
+};
+
+// Streaming compressor behind a stdio stream (fopencookie), so the output
+// stage writes to it like to any file. Everything up to the last closed
+// frame can be decompressed, even if the logger dies.
+struct compressor {
+    enum compress_kind kind;
+    int level;
+    FILE* raw;
+    void* ctx;
+    int in_frame;
+    unsigned char* buf;
+    size_t cap;
+};
+
+int compress_parse(const char* spec, struct compress_spec* z);
+const char* compress_suffix(enum compress_kind kind);
+FILE* compress_open(struct compressor* z, FILE* raw, const struct compress_spec* spec);
+int compress_end_frame(struct compressor* z);
+
+#endif
@@ -0,0 +1,234 @@
+#include "counters.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct default_counter {
+    enum counter_source src;
+    const char* key;
+    const char* name;
+};
+
+// The columns the logger has always written, in their original order.
+static const struct default_counter default_counters[] = {
+    { SRC_NODE_MEMINFO, "MemTotal", "mem_total" },
+    { SRC_NODE_MEMINFO, "MemUsed", "mem_used" },
+    { SRC_NODE_VMSTAT, "nr_free_pages", NULL },
+    { SRC_NODE_VMSTAT, "numa_hit", NULL },
+    { SRC_NODE_VMSTAT, "numa_miss", NULL },
+    { SRC_NODE_VMSTAT, "numa_foreign", NULL },
+    { SRC_NODE_VMSTAT, "numa_interleave", NULL },
+    { SRC_NODE_VMSTAT, "numa_local", NULL },
+    { SRC_NODE_VMSTAT, "numa_other", NULL },
+    { SRC_SYS_VMSTAT, "numa_pte_updates", NULL },
+    { SRC_SYS_VMSTAT, "numa_huge_pte_updates", NULL },
+    { SRC_SYS_VMSTAT, "numa_pages_migrated", NULL },
+    { SRC_SYS_VMSTAT, "pgmigrate_success", NULL },
+    { SRC_SYS_VMSTAT, "pgmigrate_fail", NULL },
+    { SRC_SYS_VMSTAT, "thp_migration_success", NULL },
+    { SRC_SYS_VMSTAT, "thp_migration_fail", NULL },
+    { SRC_SYS_VMSTAT, "thp_migration_split", NULL },
+};
+
+static const char* source_names[SRC_COUNT] = {
+    [SRC_NODE_MEMINFO] = "node_meminfo",
+    [SRC_NODE_VMSTAT] = "node_vmstat",
+    [SRC_SYS_VMSTAT] = "vmstat",
+    [SRC_SYS_MEMINFO] = "meminfo",
+};
+
+void counter_set_init(struct counter_set* cs)
+{
+    memset(cs, 0, sizeof(*cs));
+}
+
+int counter_source_per_node(enum counter_source src)
+{
+    return src == SRC_NODE_MEMINFO || src == SRC_NODE_VMSTAT;
+}
+
+const char* counter_source_name(enum counter_source src)
+{
+    return source_names[src];
+}
+
+int counter_set_add(struct counter_set* cs, enum counter_source src,
+    const char* key, const char* name)
+{
+    if (!name || !*name)
+        name = key;
+    if (!*key || strlen(key) >= COUNTER_KEY_MAX || strlen(name) >= COUNTER_NAME_MAX) {
+        fprintf(stderr, "Invalid counter: %s:%s\n", source_names[src], key);
+        return -1;
+    }
+
+    // Adding the same counter twice is a no-op so "default" can be combined
+    // with a list that repeats some of the default counters. The same key
+    // under another column name, or two counters writing one column, is a
+    // mistake in the list.
+    for (int other = 0; other < SRC_COUNT; other++) {
+        if (counter_source_per_node(other) != counter_source_per_node(src))
+            continue;
+        for (int i = 0; i < cs->count[other]; i++) {
+            const struct counter* c = &cs->counters[other][i];
+            int same_key = other == (int)src && strcmp(c->key, key) == 0;
+            int same_name = strcmp(c->name, name) == 0;
+            if (same_key && same_name)
+                return 0;
+            if (same_key) {
+                fprintf(stderr, "Counter %s:%s is listed as both %s and %s\n",
+                    source_names[src], key, c->name, name);
+                return -1;
+            }
+            if (same_name) {
+                fprintf(stderr, "Column %s is used by both %s:%s and %s:%s\n",
+                    name, source_names[other], c->key, source_names[src], key);
+                return -1;
+            }
+        }
+    }
+
+    if (cs->count[src] == cs->cap[src]) {
+        int cap = cs->cap[src] ? cs->cap[src] * 2 : 16;
+        struct counter* grown = realloc(cs->counters[src], sizeof(struct counter) * cap);
+        if (!grown) {
+            fprintf(stderr, "Failed to allocate counter list\n");
+            return -1;
+        }
+        cs->counters[src] = grown;
+        cs->cap[src] = cap;
+    }
+
+    struct counter* c = &cs->counters[src][cs->count[src]++];
+    snprintf(c->key, sizeof(c->key), "%s", key);
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    return 0;
+}
+
+int counter_set_add_defaults(struct counter_set* cs)
+{
+    int n = (int)(sizeof(default_counters) / sizeof(default_counters[0]));
+    for (int i = 0; i < n; i++) {
+        const struct default_counter* d = &default_counters[i];
+        if (counter_set_add(cs, d->src, d->key, d->name) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+// One entry is "default" or "<source>:<key>[=<column>]".
+static int add_entry(struct counter_set* cs, char* entry)
+{
+    if (strcmp(entry, "default") == 0)
+        return counter_set_add_defaults(cs);
+
+    char* colon = strchr(entry, ':');
+    if (!colon) {
+        fprintf(stderr, "Counter '%s' is not <source>:<key>[=<column>]\n", entry);
+        return -1;
+    }
+    *colon = '\0';
+    char* key = colon + 1;
+    char* name = strchr(key, '=');
+    if (name)
+        *name++ = '\0';
+
+    for (int src = 0; src < SRC_COUNT; src++) {
+        if (strcmp(entry, source_names[src]) == 0)
+            return counter_set_add(cs, (enum counter_source)src, key, name);
+    }
+
+    fprintf(stderr, "Unknown counter source '%s' (expected node_meminfo, node_vmstat, vmstat or meminfo)\n", entry);
+    return -1;
+}
+
+static int parse_list(struct counter_set* cs, char* text)
+{
+    char* p = text;
+    while (*p) {
+        while (*p && (isspace((unsigned char)*p) || *p == ','))
+            p++;
+        if (*p == '#') {
+            while (*p && *p != '\n')
+                p++;
+            continue;
+        }
+        if (!*p)
+            break;
+
+        char* entry = p;
+        while (*p && !isspace((unsigned char)*p) && *p != ',' && *p != '#')
+            p++;
+        char end = *p;
+        *p = '\0';
+        if (add_entry(cs, entry) != 0)
+            return -1;
+        *p = end;
+        if (end == '#')
+            continue;
+        if (end)
+            p++;
+    }
+    return 0;
+}
+
+static char* read_file(const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    if (!fp)
+        return NULL;
+
+    size_t cap = 4096, len = 0;
+    char* text = malloc(cap);
+    while (text) {
+        size_t n = fread(text + len, 1, cap - len - 1, fp);
+        len += n;
+        if (len < cap - 1)
+            break;
+        char* grown = realloc(text, cap * 2);
+        if (!grown) {
+            free(text);
+            text = NULL;
+            break;
+        }
+        text = grown;
+        cap *= 2;
+    }
+    fclose(fp);
+    if (text)
+        text[len] = '\0';
+    return text;
+}
+
+// spec is either a path to a counters file (one entry per line, '#'
+// comments) or an inline comma-separated list of entries. On failure the
+// set is left empty.
+int counter_set_parse(struct counter_set* cs, const char* spec)
+{
+    char* text = read_file(spec);
+    if (!text && !strchr(spec, ':') && strcmp(spec, "default") != 0) {
+        perror(spec);
+        return -1;
+    }
+    if (!text)
+        text = strdup(spec);
+    if (!text) {
+        fprintf(stderr, "Failed to allocate counter list\n");
+        return -1;
+    }
+
+    int ret = parse_list(cs, text);
+    free(text);
+    if (ret != 0)
+        counter_set_free(cs);
+    return ret;
+}
+
+void counter_set_free(struct counter_set* cs)
+{
+    for (int src = 0; src < SRC_COUNT; src++)
+        free(cs->counters[src]);
+    memset(cs, 0, sizeof(*cs));
+}
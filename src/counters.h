@@ -0,0 +1,40 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#define COUNTER_KEY_MAX 64
+#define COUNTER_NAME_MAX 64
+
+// Where a counter is read from. The order here is also the column order of
+// the output: all per-node meminfo columns, then all per-node vmstat
+// columns, then the system-wide ones.
+enum counter_source {
+    SRC_NODE_MEMINFO,
+    SRC_NODE_VMSTAT,
+    SRC_SYS_VMSTAT,
+    SRC_SYS_MEMINFO,
+    SRC_COUNT
+};
+
+struct counter {
+    char key[COUNTER_KEY_MAX];
+    char name[COUNTER_NAME_MAX];
+};
+
+// The runtime column schema: the selected counters, grouped by source.
+struct counter_set {
+    struct counter* counters[SRC_COUNT];
+    int count[SRC_COUNT];
+    int cap[SRC_COUNT];
+};
+
+void counter_set_init(struct counter_set* cs);
+int counter_set_add_defaults(struct counter_set* cs);
+int counter_set_add(struct counter_set* cs, enum counter_source src,
+    const char* key, const char* name);
+int counter_set_parse(struct counter_set* cs, const char* spec);
+void counter_set_free(struct counter_set* cs);
+
+int counter_source_per_node(enum counter_source src);
+const char* counter_source_name(enum counter_source src);
+
+#endif
@@ -0,0 +1,52 @@
+#define _GNU_SOURCE
+#include "cpulist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "stat_file.h"
+
+// Parse a kernel CPU list such as "0-15,32-47" into a CPU set.
+int cpulist_parse(const char* s, cpu_set_t* set)
+{
+    CPU_ZERO(set);
+    int count = 0;
+    while (*s && *s != '\n') {
+        char* end;
+        long lo = strtol(s, &end, 10);
+        long hi = lo;
+        if (end == s || lo < 0)
+            return -1;
+        s = end;
+        if (*s == '-') {
+            hi = strtol(s + 1, &end, 10);
+            if (end == s + 1 || hi < lo)
+                return -1;
+            s = end;
+        }
+        for (long cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++, count++)
+            CPU_SET(cpu, set);
+        if (*s == ',')
+            s++;
+    }
+    return count;
+}
+
+// Read a CPU list file; -1 if it cannot be read.
+int cpulist_read(const char* path, cpu_set_t* set)
+{
+    struct stat_file sf;
+    if (stat_file_open(&sf, path) != 0)
+        return -1;
+    int n = stat_file_read(&sf) == 0 ? cpulist_parse(sf.buf, set) : -1;
+    stat_file_close(&sf);
+    return n;
+}
+
+// The CPUs of a node; memory-only nodes have none.
+int node_cpus(int node_id, cpu_set_t* set)
+{
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node_id);
+    return cpulist_read(path, set);
+}
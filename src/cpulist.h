@@ -0,0 +1,11 @@
+#ifndef CPULIST_H
+#define CPULIST_H
+
+// Needs _GNU_SOURCE for cpu_set_t.
+#include <sched.h>
+
+int cpulist_parse(const char* s, cpu_set_t* set);
+int cpulist_read(const char* path, cpu_set_t* set);
+int node_cpus(int node_id, cpu_set_t* set);
+
+#endif
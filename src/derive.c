@@ -0,0 +1,152 @@
+#include "derive.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// spec is a comma-separated subset of abs, delta and rate.
+int derive_parse_emit(const char* spec, unsigned* emit)
+{
+    unsigned mask = 0;
+    const char* p = spec;
+
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        if (len == 3 && strncmp(p, "abs", 3) == 0)
+            mask |= EMIT_ABS;
+        else if (len == 5 && strncmp(p, "delta", 5) == 0)
+            mask |= EMIT_DELTA;
+        else if (len == 4 && strncmp(p, "rate", 4) == 0)
+            mask |= EMIT_RATE;
+        else if (len > 0) {
+            fprintf(stderr, "Unknown --emit value '%.*s' (expected abs, delta or rate)\n", (int)len, p);
+            return -1;
+        }
+        p += len;
+        if (*p == ',')
+            p++;
+    }
+
+    if (!mask) {
+        fprintf(stderr, "--emit needs at least one of abs, delta or rate\n");
+        return -1;
+    }
+    *emit = mask;
+    return 0;
+}
+
+int derive_init(struct derive* d, int nvalues, unsigned emit)
+{
+    memset(d, 0, sizeof(*d));
+    d->nvalues = nvalues;
+    d->emit = emit;
+    for (unsigned kind = EMIT_ABS; kind <= EMIT_RATE; kind <<= 1) {
+        if (emit & kind)
+            d->ncols += nvalues;
+    }
+
+    size_t n = nvalues ? nvalues : 1;
+    d->buf[0] = calloc(n, sizeof(uint64_t));
+    d->buf[1] = calloc(n, sizeof(uint64_t));
+    d->read_time = calloc(n, sizeof(double));
+    d->last_rate = calloc(n, sizeof(double));
+    if (!d->buf[0] || !d->buf[1] || !d->read_time || !d->last_rate) {
+        derive_free(d);
+        return -1;
+    }
+    return 0;
+}
+
+// The buffer to sample into. It starts out holding the previous sample, so
+// a counter that could not be read this time keeps its last value.
+uint64_t* derive_values(struct derive* d)
+{
+    uint64_t* cur = d->buf[d->cur];
+    memcpy(cur, d->buf[d->cur ^ 1], sizeof(uint64_t) * d->nvalues);
+    return cur;
+}
+
+// Rates of values that were not read on this tick; see struct derive.
+static void tiered_rates(struct derive* d, double now, const unsigned char* fresh, union cell* cells)
+{
+    const uint64_t* cur = d->buf[d->cur];
+    const uint64_t* prev = d->buf[d->cur ^ 1];
+
+    for (int i = 0; i < d->nvalues; i++) {
+        if (fresh[i]) {
+            double dt = now - d->read_time[i];
+            d->last_rate[i] = d->have_prev && dt > 0 ? (double)(int64_t)(cur[i] - prev[i]) / dt : 0.0;
+            d->read_time[i] = now;
+        }
+        cells[i].f = d->last_rate[i];
+    }
+}
+
+// Fill one output row from the current sample (now is a monotonic time in
+// seconds), then flip the buffers. The first row has zero deltas and rates.
+// fresh, if not NULL, says which values were read on this tick.
+void derive_row(struct derive* d, double now, const unsigned char* fresh, union cell* cells)
+{
+    const uint64_t* cur = d->buf[d->cur];
+    const uint64_t* prev = d->buf[d->cur ^ 1];
+    double dt = d->have_prev ? now - d->prev_time : 0.0;
+    int c = 0;
+
+    if (d->emit & EMIT_ABS) {
+        for (int i = 0; i < d->nvalues; i++)
+            cells[c++].u = cur[i];
+    }
+    if (d->emit & EMIT_DELTA) {
+        for (int i = 0; i < d->nvalues; i++)
+            cells[c++].i = d->have_prev ? (int64_t)(cur[i] - prev[i]) : 0;
+    }
+    if ((d->emit & EMIT_RATE) && fresh) {
+        tiered_rates(d, now, fresh, &cells[c]);
+    }
+    else if (d->emit & EMIT_RATE) {
+        for (int i = 0; i < d->nvalues; i++)
+            cells[c++].f = dt > 0 ? (double)(int64_t)(cur[i] - prev[i]) / dt : 0.0;
+    }
+
+    d->have_prev = 1;
+    d->prev_time = now;
+    d->cur ^= 1;
+}
+
+// Map an output column to the sampled value it derives from.
+int derive_column(const struct derive* d, int col, enum cell_type* type, const char** suffix)
+{
+    static const struct {
+        unsigned kind;
+        enum cell_type type;
+        const char* suffix;
+    } kinds[] = {
+        { EMIT_ABS, CELL_U64, "" },
+        { EMIT_DELTA, CELL_I64, "_delta" },
+        { EMIT_RATE, CELL_F64, "_rate" },
+    };
+
+    for (int k = 0; k < 3; k++) {
+        if (!(d->emit & kinds[k].kind))
+            continue;
+        if (col < d->nvalues) {
+            *type = kinds[k].type;
+            *suffix = kinds[k].suffix;
+            return col;
+        }
+        col -= d->nvalues;
+    }
+    return -1;
+}
+
+void derive_free(struct derive* d)
+{
+    free(d->buf[0]);
+    free(d->buf[1]);
+    free(d->read_time);
+    free(d->last_rate);
+    d->buf[0] = NULL;
+    d->buf[1] = NULL;
+    d->read_time = NULL;
+    d->last_rate = NULL;
+}
@@ -0,0 +1,44 @@
+#ifndef DERIVE_H
+#define DERIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cell.h"
+
+#define EMIT_ABS   0x1
+#define EMIT_DELTA 0x2
+#define EMIT_RATE  0x4
+
+// Turns raw counter samples into output cells: absolute values, per-interval
+// deltas and per-second rates. Samples live in a double buffer so deltas are
+// always taken against the previous sample.
+//
+// Output columns are grouped by kind: all absolute columns, then all
+// deltas (<name>_delta), then all rates (<name>_rate).
+//
+// Values that are not re-read on every tick have a zero delta between
+// reads, and their rate is taken over the time since their previous read
+// and then repeated until the next one.
+struct derive {
+    int nvalues;
+    unsigned emit;
+    int ncols;
+
+    uint64_t* buf[2];
+    int cur;
+    int have_prev;
+    double prev_time;
+
+    double* read_time;      // per value, for tiered sources
+    double* last_rate;
+};
+
+int derive_parse_emit(const char* spec, unsigned* emit);
+int derive_init(struct derive* d, int nvalues, unsigned emit);
+uint64_t* derive_values(struct derive* d);
+void derive_row(struct derive* d, double now, const unsigned char* fresh, union cell* cells);
+int derive_column(const struct derive* d, int col, enum cell_type* type, const char** suffix);
+void derive_free(struct derive* d);
+
+#endif
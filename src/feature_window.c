@@ -0,0 +1,143 @@
+#include "feature_window.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int find_value(const struct sampler* s, const char* name)
+{
+    char buf[LOG_NAME_MAX];
+    for (int i = 0; i < s->nvalues; i++) {
+        sampler_column_name(s, i, buf, sizeof(buf));
+        if (strcmp(buf, name) == 0)
+            return i;
+    }
+    fprintf(stderr, "Features need the '%s' counter (see --counters)\n", name);
+    return -1;
+}
+
+static const char* const node_feature_names[NODE_FEATURES] = {
+    "usage", "trend", "min_usage", "max_usage", "volatility", "free_pages_change",
+};
+
+int features_init(struct feature_set* fs, const struct sampler* s, uint32_t window)
+{
+    const struct node_set* nodes = s->nodes;
+
+    memset(fs, 0, sizeof(*fs));
+    fs->nnodes = nodes->count;
+    fs->window = window;
+    fs->nvalues = fs->nnodes * NODE_FEATURES + 2;
+
+    fs->names = calloc(fs->nvalues, sizeof(*fs->names));
+    fs->values = calloc(fs->nvalues, sizeof(double));
+    fs->used_col = calloc(fs->nnodes, sizeof(int));
+    fs->total_col = calloc(fs->nnodes, sizeof(int));
+    fs->free_col = calloc(fs->nnodes, sizeof(int));
+    fs->usage = calloc(fs->nnodes, sizeof(struct rolling));
+    fs->free_pages = calloc(fs->nnodes, sizeof(struct rolling));
+    if (!fs->names || !fs->values || !fs->used_col || !fs->total_col || !fs->free_col ||
+        !fs->usage || !fs->free_pages || rolling_init(&fs->migrated, window) != 0)
+        return -1;
+
+    char name[LOG_NAME_MAX];
+    for (int i = 0; i < fs->nnodes; i++) {
+        int id = nodes->ids[i];
+        snprintf(name, sizeof(name), "node_%d_mem_used", id);
+        fs->used_col[i] = find_value(s, name);
+        snprintf(name, sizeof(name), "node_%d_mem_total", id);
+        fs->total_col[i] = find_value(s, name);
+        snprintf(name, sizeof(name), "node_%d_nr_free_pages", id);
+        fs->free_col[i] = find_value(s, name);
+        if (fs->used_col[i] < 0 || fs->total_col[i] < 0 || fs->free_col[i] < 0)
+            return -1;
+        if (rolling_init(&fs->usage[i], window) != 0 || rolling_init(&fs->free_pages[i], window) != 0)
+            return -1;
+
+        for (int k = 0; k < NODE_FEATURES; k++)
+            snprintf(fs->names[i * NODE_FEATURES + k], LOG_NAME_MAX, "node_%d_%s", id, node_feature_names[k]);
+    }
+    fs->migrated_col = find_value(s, "numa_pages_migrated");
+    if (fs->migrated_col < 0)
+        return -1;
+    snprintf(fs->names[fs->nvalues - 2], LOG_NAME_MAX, "total_page_migrations");
+    snprintf(fs->names[fs->nvalues - 1], LOG_NAME_MAX, "run_timestep");
+    return 0;
+}
+
+// Log every feature as an F64 column; returns the first column's index.
+int features_add_columns(const struct feature_set* fs, struct log_schema* ls)
+{
+    int first = -1;
+    for (int i = 0; i < fs->nvalues; i++) {
+        int col = log_schema_add(ls, fs->names[i], CELL_F64);
+        if (col < 0)
+            return -1;
+        if (i == 0)
+            first = col;
+    }
+    return first;
+}
+
+// Add one sample and recompute every feature.
+void features_update(struct feature_set* fs, int64_t ts_ns, const uint64_t* values)
+{
+    if (!fs->started) {
+        fs->start_ns = ts_ns;
+        fs->started = 1;
+    }
+
+    double* v = fs->values;
+    for (int i = 0; i < fs->nnodes; i++) {
+        struct rolling* u = &fs->usage[i];
+        struct rolling* f = &fs->free_pages[i];
+        rolling_push(u, (double)values[fs->used_col[i]] / (double)values[fs->total_col[i]]);
+        rolling_push(f, (double)values[fs->free_col[i]]);
+
+        v[0] = u->last;
+        v[1] = u->last - u->first;
+        v[2] = u->min;
+        v[3] = u->max;
+        v[4] = rolling_std(u);
+        v[5] = f->last - f->first;
+        v += NODE_FEATURES;
+    }
+
+    rolling_push(&fs->migrated, (double)values[fs->migrated_col]);
+    v[0] = fs->migrated.last - fs->migrated.first;
+    v[1] = (ts_ns - fs->start_ns) * 1e-9;
+}
+
+void features_fill(const struct feature_set* fs, union cell* out)
+{
+    for (int i = 0; i < fs->nvalues; i++)
+        out[i].f = fs->values[i];
+}
+
+// Start a new run: windows restart and run_timestep counts from the next row.
+void features_reset(struct feature_set* fs)
+{
+    for (int i = 0; i < fs->nnodes; i++) {
+        rolling_reset(&fs->usage[i]);
+        rolling_reset(&fs->free_pages[i]);
+    }
+    rolling_reset(&fs->migrated);
+    fs->started = 0;
+}
+
+void features_free(struct feature_set* fs)
+{
+    for (int i = 0; i < fs->nnodes && fs->usage && fs->free_pages; i++) {
+        rolling_free(&fs->usage[i]);
+        rolling_free(&fs->free_pages[i]);
+    }
+    rolling_free(&fs->migrated);
+    free(fs->names);
+    free(fs->values);
+    free(fs->used_col);
+    free(fs->total_col);
+    free(fs->free_col);
+    free(fs->usage);
+    free(fs->free_pages);
+    memset(fs, 0, sizeof(*fs));
+}
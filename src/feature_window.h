@@ -0,0 +1,51 @@
+#ifndef FEATURE_WINDOW_H
+#define FEATURE_WINDOW_H
+
+#include <stdint.h>
+
+#include "logfmt.h"
+#include "rolling.h"
+#include "sampler.h"
+
+// The features of the preprocessing scripts, computed online per node:
+//
+//   node_N_usage              mem_used / mem_total
+//   node_N_trend              usage now - usage at the start of the window
+//   node_N_min_usage          min / max / sample std ("volatility") of usage
+//   node_N_max_usage
+//   node_N_volatility
+//   node_N_free_pages_change  nr_free_pages now - at the start of the window
+//
+// followed by total_page_migrations (numa_pages_migrated change) and
+// run_timestep (seconds since the reset). With window 0 they are the
+// per-run aggregates of preprocess_*_log.py, in the same floating-point
+// order as pandas' groupby, so online and offline values are identical.
+// Features are built from the raw sampler values, whatever --emit is.
+#define NODE_FEATURES 6
+
+struct feature_set {
+    int nnodes;
+    uint32_t window;
+    int nvalues;
+    char (*names)[LOG_NAME_MAX];
+    double* values;
+
+    int* used_col;
+    int* total_col;
+    int* free_col;
+    int migrated_col;
+    struct rolling* usage;
+    struct rolling* free_pages;
+    struct rolling migrated;
+    int64_t start_ns;
+    int started;
+};
+
+int features_init(struct feature_set* fs, const struct sampler* s, uint32_t window);
+int features_add_columns(const struct feature_set* fs, struct log_schema* ls);
+void features_update(struct feature_set* fs, int64_t ts_ns, const uint64_t* values);
+void features_fill(const struct feature_set* fs, union cell* out);
+void features_reset(struct feature_set* fs);
+void features_free(struct feature_set* fs);
+
+#endif
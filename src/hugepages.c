@@ -0,0 +1,176 @@
+#include "hugepages.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stat_file.h"
+#include "stat_parse.h"
+
+#define NODE_ROOT "/sys/devices/system/node"
+
+static const char* const pool_files[] = {
+    "nr_hugepages",
+    "free_hugepages",
+    "surplus_hugepages",
+};
+#define POOL_FILES (int)(sizeof(pool_files) / sizeof(pool_files[0]))
+
+static const struct stat_key meminfo_keys[] = {
+    { "AnonHugePages", 0 * sizeof(uint64_t) },
+    { "ShmemHugePages", 1 * sizeof(uint64_t) },
+    { "FilePages", 2 * sizeof(uint64_t) },
+};
+static const char* const meminfo_columns[] = {
+    "anon_huge_kb",
+    "shmem_huge_kb",
+    "file_pages_kb",
+};
+#define MEMINFO_KEYS (int)(sizeof(meminfo_keys) / sizeof(meminfo_keys[0]))
+
+// Column order per node: POOL_FILES values per page size, then the
+// meminfo values.
+struct huge_node {
+    int npools;
+    struct stat_file* pools;
+    struct stat_file meminfo;
+    struct stat_parser parser;
+};
+
+struct hugepages {
+    int nnodes;
+    struct huge_node* nodes;
+};
+
+static int cmp_kb(const void* a, const void* b)
+{
+    unsigned long x = *(const unsigned long*)a, y = *(const unsigned long*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Page sizes (in kB) with a pool on this node, smallest first.
+static int list_page_sizes(int node_id, unsigned long* kb, int max)
+{
+    char path[128];
+    snprintf(path, sizeof(path), NODE_ROOT "/node%d/hugepages", node_id);
+    DIR* dir = opendir(path);
+    if (!dir)
+        return 0;
+
+    int n = 0;
+    struct dirent* de;
+    while ((de = readdir(dir)) != NULL && n < max) {
+        unsigned long size;
+        if (sscanf(de->d_name, "hugepages-%lukB", &size) == 1)
+            kb[n++] = size;
+    }
+    closedir(dir);
+    qsort(kb, n, sizeof(*kb), cmp_kb);
+    return n;
+}
+
+static void hugepages_sample(struct collector* c, union cell* out)
+{
+    struct hugepages* h = c->priv;
+
+    for (int i = 0; i < h->nnodes; i++) {
+        struct huge_node* hn = &h->nodes[i];
+        for (int j = 0; j < hn->npools; j++) {
+            struct stat_file* sf = &hn->pools[j];
+            out->u = stat_file_read(sf) == 0 ? strtoull(sf->buf, NULL, 10) : 0;
+            out++;
+        }
+
+        uint64_t v[MEMINFO_KEYS] = { 0 };
+        if (stat_file_read(&hn->meminfo) == 0)
+            stat_parser_run(&hn->parser, hn->meminfo.buf, v);
+        for (int k = 0; k < MEMINFO_KEYS; k++)
+            (out++)->u = v[k];
+    }
+}
+
+static void hugepages_destroy(struct collector* c)
+{
+    struct hugepages* h = c->priv;
+    if (!h)
+        return;
+    for (int i = 0; i < h->nnodes; i++) {
+        struct huge_node* hn = &h->nodes[i];
+        for (int j = 0; j < hn->npools; j++)
+            stat_file_close(&hn->pools[j]);
+        free(hn->pools);
+        stat_file_close(&hn->meminfo);
+        stat_parser_free(&hn->parser);
+    }
+    free(h->nodes);
+    free(h);
+    c->priv = NULL;
+}
+
+static int open_node(struct collector* c, struct log_schema* ls, struct huge_node* hn, int id)
+{
+    char path[192], name[LOG_NAME_MAX];
+    unsigned long sizes[16];
+    int nsizes = list_page_sizes(id, sizes, 16);
+
+    hn->meminfo.fd = -1;
+    hn->pools = calloc(nsizes * POOL_FILES + 1, sizeof(struct stat_file));
+    if (!hn->pools)
+        return -1;
+
+    for (int s = 0; s < nsizes; s++) {
+        for (int f = 0; f < POOL_FILES; f++) {
+            struct stat_file* sf = &hn->pools[hn->npools];
+            snprintf(path, sizeof(path), NODE_ROOT "/node%d/hugepages/hugepages-%lukB/%s",
+                id, sizes[s], pool_files[f]);
+            if (stat_file_open(sf, path) != 0) {
+                perror(path);
+                return -1;
+            }
+            hn->npools++;
+            // nr_hugepages -> node_0_hugepages_2048kB_nr
+            snprintf(name, sizeof(name), "node_%d_hugepages_%lukB_%.*s", id, sizes[s],
+                (int)strcspn(pool_files[f], "_"), pool_files[f]);
+            if (collector_add_column(c, ls, name, CELL_U64) < 0)
+                return -1;
+        }
+    }
+
+    snprintf(path, sizeof(path), NODE_ROOT "/node%d/meminfo", id);
+    if (stat_file_open(&hn->meminfo, path) != 0) {
+        perror(path);
+        return -1;
+    }
+    if (stat_parser_init(&hn->parser, meminfo_keys, MEMINFO_KEYS) != 0)
+        return -1;
+    for (int k = 0; k < MEMINFO_KEYS; k++) {
+        snprintf(name, sizeof(name), "node_%d_%s", id, meminfo_columns[k]);
+        if (collector_add_column(c, ls, name, CELL_U64) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int hugepages_create(struct collector* c, struct log_schema* ls,
+    const struct node_set* nodes, uint64_t period)
+{
+    collector_init(c, "hugepages", period);
+    c->sample = hugepages_sample;
+    c->destroy = hugepages_destroy;
+
+    struct hugepages* h = calloc(1, sizeof(*h));
+    if (!h)
+        return -1;
+    c->priv = h;
+    h->nodes = calloc(nodes->count, sizeof(*h->nodes));
+    if (!h->nodes)
+        return -1;
+
+    for (int i = 0; i < nodes->count; i++) {
+        h->nnodes++;
+        if (open_node(c, ls, &h->nodes[i], nodes->ids[i]) != 0)
+            return -1;
+    }
+    return collector_finish(c);
+}
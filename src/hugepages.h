@@ -0,0 +1,14 @@
+#ifndef HUGEPAGES_H
+#define HUGEPAGES_H
+
+#include "collector.h"
+#include "nodes.h"
+
+// Per-node huge page accounting: nr/free/surplus of every hugetlb page
+// size under nodeN/hugepages, plus AnonHugePages, ShmemHugePages and
+// FilePages from nodeN/meminfo. The page sizes are listed once at startup;
+// samples only pread() the already open files.
+int hugepages_create(struct collector* c, struct log_schema* ls,
+    const struct node_set* nodes, uint64_t period);
+
+#endif
@@ -0,0 +1,333 @@
+#include "logfmt.h"
+
+#include <endian.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BIN_FIXED_HEADER 32
+
+int log_schema_init(struct log_schema* ls, int node_count, int ncols)
+{
+    memset(ls, 0, sizeof(*ls));
+    ls->node_count = node_count;
+    ls->ncols = ncols;
+    ls->cap = ncols ? ncols : 1;
+    ls->names = calloc(ls->cap, sizeof(*ls->names));
+    ls->types = calloc(ls->cap, 1);
+    ls->keys = calloc(ls->cap, 1);
+    if (!ls->names || !ls->types || !ls->keys) {
+        log_schema_free(ls);
+        return -1;
+    }
+    return 0;
+}
+
+// Append a column and return its index, or -1 on allocation failure.
+int log_schema_add(struct log_schema* ls, const char* name, enum cell_type type)
+{
+    if (ls->ncols == ls->cap) {
+        int cap = ls->cap * 2;
+        char (*names)[LOG_NAME_MAX] = realloc(ls->names, sizeof(*ls->names) * cap);
+        if (!names)
+            return -1;
+        ls->names = names;
+        unsigned char* types = realloc(ls->types, cap);
+        if (!types)
+            return -1;
+        ls->types = types;
+        unsigned char* keys = realloc(ls->keys, cap);
+        if (!keys)
+            return -1;
+        ls->keys = keys;
+        ls->cap = cap;
+    }
+
+    snprintf(ls->names[ls->ncols], LOG_NAME_MAX, "%s", name);
+    ls->types[ls->ncols] = type;
+    ls->keys[ls->ncols] = 0;
+    return ls->ncols++;
+}
+
+void log_schema_free(struct log_schema* ls)
+{
+    free(ls->names);
+    free(ls->types);
+    free(ls->keys);
+    free(ls->labels);
+    ls->names = NULL;
+    ls->types = NULL;
+    ls->keys = NULL;
+    ls->labels = NULL;
+    ls->ncols = 0;
+    ls->cap = 0;
+    ls->nlabels = 0;
+}
+
+// Return the index of a label, adding it if it is new; -1 if the table is
+// full or cannot be allocated.
+int log_schema_label(struct log_schema* ls, const char* label)
+{
+    for (int i = 0; i < ls->nlabels; i++)
+        if (strcmp(ls->labels[i], label) == 0)
+            return i;
+
+    if (!ls->labels) {
+        ls->labels = calloc(LOG_LABELS_MAX, sizeof(*ls->labels));
+        if (!ls->labels)
+            return -1;
+    }
+    if (ls->nlabels == LOG_LABELS_MAX) {
+        fprintf(stderr, "More than %d distinct labels\n", LOG_LABELS_MAX);
+        return -1;
+    }
+    snprintf(ls->labels[ls->nlabels], LOG_NAME_MAX, "%s", label);
+    return ls->nlabels++;
+}
+
+// Read a .labels file into the table. A missing file is not an error.
+int log_labels_load(struct log_schema* ls, const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    if (!fp)
+        return 0;
+
+    char line[LOG_NAME_MAX + 2];
+    int ret = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (log_schema_label(ls, line) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+    fclose(fp);
+    return ret;
+}
+
+int log_labels_save(const struct log_schema* ls, const char* path)
+{
+    FILE* fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    for (int i = 0; i < ls->nlabels; i++)
+        fprintf(fp, "%s\n", ls->labels[i]);
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+size_t bin_record_size(const struct log_schema* ls)
+{
+    return 8 + 8 * (size_t)ls->ncols;
+}
+
+void csv_write_header(FILE* fp, const struct log_schema* ls)
+{
+    fprintf(fp, "timestamp");
+    for (int i = 0; i < ls->ncols; i++)
+        fprintf(fp, ",%s", ls->names[i]);
+    fprintf(fp, "\n");
+}
+
+// Write one cell as CSV text, without the separator.
+void csv_write_cell(FILE* fp, const struct log_schema* ls, int col, union cell v)
+{
+    if (ls->types[col] == CELL_U64)
+        fprintf(fp, "%" PRIu64, v.u);
+    else if (ls->types[col] == CELL_I64)
+        fprintf(fp, "%" PRId64, v.i);
+    else if (ls->types[col] == CELL_LABEL) {
+        if (ls->labels && v.u < LOG_LABELS_MAX)
+            fprintf(fp, "%s", ls->labels[v.u]);
+        else
+            fprintf(fp, "%" PRIu64, v.u);
+    }
+    else
+        fprintf(fp, "%.3f", v.f);
+}
+
+void csv_write_row(FILE* fp, const struct log_schema* ls, int64_t ts_ns, const union cell* cells)
+{
+    fprintf(fp, "%" PRId64 ".%09" PRId64, ts_ns / 1000000000, ts_ns % 1000000000);
+    for (int i = 0; i < ls->ncols; i++) {
+        fputc(',', fp);
+        csv_write_cell(fp, ls, i, cells[i]);
+    }
+    fprintf(fp, "\n");
+}
+
+static void put_le32(unsigned char* p, uint32_t v)
+{
+    v = htole32(v);
+    memcpy(p, &v, 4);
+}
+
+static uint32_t get_le32(const unsigned char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return le32toh(v);
+}
+
+static void put_le64(unsigned char* p, uint64_t v)
+{
+    v = htole64(v);
+    memcpy(p, &v, 8);
+}
+
+static uint64_t get_le64(const unsigned char* p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return le64toh(v);
+}
+
+// Serialise the header into a freshly allocated buffer. Key columns get
+// LOG_KEY_COLUMN in their type byte, in tsdb logs only.
+static unsigned char* build_header(const struct log_schema* ls, const char* magic, size_t* size)
+{
+    size_t len = BIN_FIXED_HEADER;
+    for (int i = 0; i < ls->ncols; i++)
+        len += 2 + strnlen(ls->names[i], 255);
+    len = (len + 7) & ~(size_t)7;
+
+    unsigned char* h = calloc(1, len);
+    if (!h)
+        return NULL;
+
+    memcpy(h, magic, 8);
+    put_le32(h + 8, BIN_VERSION);
+    put_le32(h + 12, (uint32_t)len);
+    put_le32(h + 16, (uint32_t)ls->node_count);
+    put_le32(h + 20, (uint32_t)ls->ncols);
+    put_le32(h + 24, (uint32_t)bin_record_size(ls));
+
+    unsigned char* p = h + BIN_FIXED_HEADER;
+    for (int i = 0; i < ls->ncols; i++) {
+        size_t n = strnlen(ls->names[i], 255);
+        int key = ls->keys[i] && memcmp(magic, TSDB_MAGIC, 8) == 0;
+        *p++ = ls->types[i] | (key ? LOG_KEY_COLUMN : 0);
+        *p++ = (unsigned char)n;
+        memcpy(p, ls->names[i], n);
+        p += n;
+    }
+
+    *size = len;
+    return h;
+}
+
+int log_write_header(FILE* fp, const struct log_schema* ls, const char* magic)
+{
+    size_t len;
+    unsigned char* h = build_header(ls, magic, &len);
+    if (!h)
+        return -1;
+    int ret = fwrite(h, 1, len, fp) == len ? 0 : -1;
+    free(h);
+    return ret;
+}
+
+// Check that an existing log was written with exactly this schema, so new
+// records can be appended to it.
+int log_header_matches(FILE* fp, const struct log_schema* ls, const char* magic)
+{
+    size_t len;
+    unsigned char* want = build_header(ls, magic, &len);
+    unsigned char* have = malloc(len);
+    int ret = 0;
+
+    if (want && have && fread(have, 1, len, fp) == len)
+        ret = memcmp(want, have, len) == 0;
+    free(want);
+    free(have);
+    return ret;
+}
+
+int bin_write_header(FILE* fp, const struct log_schema* ls)
+{
+    return log_write_header(fp, ls, BIN_MAGIC);
+}
+
+int bin_header_matches(FILE* fp, const struct log_schema* ls)
+{
+    return log_header_matches(fp, ls, BIN_MAGIC);
+}
+
+// Read the header of a binary (BIN_MAGIC) or tsdb (TSDB_MAGIC) log; magic
+// says which it was.
+int log_read_header(FILE* fp, struct log_schema* ls, char magic[8])
+{
+    unsigned char fixed[BIN_FIXED_HEADER];
+    if (fread(fixed, 1, sizeof(fixed), fp) != sizeof(fixed) ||
+        (memcmp(fixed, BIN_MAGIC, 8) != 0 && memcmp(fixed, TSDB_MAGIC, 8) != 0)) {
+        fprintf(stderr, "Not a numa_stat_logger binary log\n");
+        return -1;
+    }
+    memcpy(magic, fixed, 8);
+    if (get_le32(fixed + 8) != BIN_VERSION) {
+        fprintf(stderr, "Unsupported binary log version %u\n", get_le32(fixed + 8));
+        return -1;
+    }
+
+    uint32_t len = get_le32(fixed + 12);
+    int ncols = (int)get_le32(fixed + 20);
+    if (len < BIN_FIXED_HEADER || get_le32(fixed + 24) != 8 + 8 * (uint32_t)ncols) {
+        fprintf(stderr, "Corrupt binary log header\n");
+        return -1;
+    }
+
+    unsigned char* rest = malloc(len - BIN_FIXED_HEADER + 1);
+    if (!rest || fread(rest, 1, len - BIN_FIXED_HEADER, fp) != len - BIN_FIXED_HEADER ||
+        log_schema_init(ls, (int)get_le32(fixed + 16), ncols) != 0) {
+        fprintf(stderr, "Corrupt binary log header\n");
+        free(rest);
+        return -1;
+    }
+
+    const unsigned char* p = rest;
+    const unsigned char* end = rest + (len - BIN_FIXED_HEADER);
+    for (int i = 0; i < ncols; i++) {
+        if (end - p < 2 || end - p < 2 + p[1] || p[1] >= LOG_NAME_MAX) {
+            fprintf(stderr, "Corrupt binary log header\n");
+            log_schema_free(ls);
+            free(rest);
+            return -1;
+        }
+        ls->types[i] = p[0] & ~LOG_KEY_COLUMN;
+        ls->keys[i] = (p[0] & LOG_KEY_COLUMN) != 0;
+        memcpy(ls->names[i], p + 2, p[1]);
+        ls->names[i][p[1]] = '\0';
+        p += 2 + p[1];
+    }
+
+    free(rest);
+    return 0;
+}
+
+int bin_read_header(FILE* fp, struct log_schema* ls)
+{
+    char magic[8];
+    if (log_read_header(fp, ls, magic) != 0)
+        return -1;
+    if (memcmp(magic, BIN_MAGIC, 8) != 0) {
+        fprintf(stderr, "Not a numa_stat_logger binary log\n");
+        log_schema_free(ls);
+        return -1;
+    }
+    return 0;
+}
+
+void bin_encode_record(const struct log_schema* ls, int64_t ts_ns, const union cell* cells, unsigned char* out)
+{
+    put_le64(out, (uint64_t)ts_ns);
+    for (int i = 0; i < ls->ncols; i++)
+        put_le64(out + 8 + 8 * i, cells[i].u);
+}
+
+void bin_decode_record(const struct log_schema* ls, const unsigned char* in, int64_t* ts_ns, union cell* cells)
+{
+    *ts_ns = (int64_t)get_le64(in);
+    for (int i = 0; i < ls->ncols; i++)
+        cells[i].u = get_le64(in + 8 + 8 * i);
+}
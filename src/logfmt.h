@@ -0,0 +1,70 @@
+#ifndef LOGFMT_H
+#define LOGFMT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cell.h"
+
+#define LOG_NAME_MAX 128
+#define LOG_LABELS_MAX 256
+
+#define BIN_MAGIC "NUMASTAT"
+#define TSDB_MAGIC "NUMATSDB"
+#define BIN_VERSION 1
+
+// Set in a tsdb header's type byte for columns whose change starts a block.
+#define LOG_KEY_COLUMN 0x80
+
+// Column names and types of a log, shared by the CSV and binary formats.
+// The timestamp is implicit and always comes first.
+struct log_schema {
+    int node_count;
+    int ncols;
+    int cap;
+    char (*names)[LOG_NAME_MAX];
+    unsigned char* types;
+    unsigned char* keys;    // 1 for columns that identify a run (session mode)
+
+    // Text of CELL_LABEL values, allocated on first use and never moved, so
+    // the writer thread can read labels of rows already queued.
+    char (*labels)[LOG_NAME_MAX];
+    int nlabels;
+};
+
+// Binary log layout, all integers little-endian:
+//
+//   header:  char magic[8] = "NUMASTAT"
+//            u32 version, u32 header_size, u32 node_count, u32 ncols,
+//            u32 record_size, u32 reserved
+//            ncols x { u8 type, u8 name_len, char name[name_len] }
+//            zero padding up to header_size (a multiple of 8)
+//   records: i64 timestamp_ns (CLOCK_REALTIME), ncols x 8-byte cells
+//
+// A tsdb log (tsdb.h) has the same header with magic "NUMATSDB", followed
+// by blocks instead of records.
+//
+// A CELL_LABEL cell holds the label's index; the texts are kept next to the
+// log in <log>.labels, one per line in index order.
+int log_schema_init(struct log_schema* ls, int node_count, int ncols);
+int log_schema_add(struct log_schema* ls, const char* name, enum cell_type type);
+void log_schema_free(struct log_schema* ls);
+int log_schema_label(struct log_schema* ls, const char* label);
+int log_labels_load(struct log_schema* ls, const char* path);
+int log_labels_save(const struct log_schema* ls, const char* path);
+size_t bin_record_size(const struct log_schema* ls);
+
+void csv_write_header(FILE* fp, const struct log_schema* ls);
+void csv_write_cell(FILE* fp, const struct log_schema* ls, int col, union cell v);
+void csv_write_row(FILE* fp, const struct log_schema* ls, int64_t ts_ns, const union cell* cells);
+
+int log_write_header(FILE* fp, const struct log_schema* ls, const char* magic);
+int log_header_matches(FILE* fp, const struct log_schema* ls, const char* magic);
+int log_read_header(FILE* fp, struct log_schema* ls, char magic[8]);
+int bin_write_header(FILE* fp, const struct log_schema* ls);
+int bin_read_header(FILE* fp, struct log_schema* ls);
+int bin_header_matches(FILE* fp, const struct log_schema* ls);
+void bin_encode_record(const struct log_schema* ls, int64_t ts_ns, const union cell* cells, unsigned char* out);
+void bin_decode_record(const struct log_schema* ls, const unsigned char* in, int64_t* ts_ns, union cell* cells);
+
+#endif
@@ -0,0 +1,278 @@
+#define _GNU_SOURCE
+#include "mbm.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpulist.h"
+#include "stat_file.h"
+
+#define RESCTRL_ROOT "/sys/fs/resctrl"
+#define CPU_ROOT "/sys/devices/system/cpu"
+#define MAX_DOMAINS 64
+
+// One L3 monitoring domain, mon_data/mon_L3_<id>. Its bytes count towards
+// the node of the domain's first CPU.
+struct mbm_domain {
+    int id;
+    char name[32];
+    int node;       // index in the node set, or -1
+    struct stat_file total;
+    struct stat_file local;
+};
+
+struct mbm {
+    int nnodes;
+    int ndomains;
+    struct mbm_domain domains[MAX_DOMAINS];
+    char dir[PATH_MAX];         // the group, RESCTRL_ROOT for the default
+    int auto_group;             // mbm_attach() makes a group for the process
+    int created;                // dir was made by mbm_attach()
+    uint64_t* prev;             // nnodes x { total, local }
+    uint64_t* now;
+    int64_t prev_ns;
+};
+
+static int64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int read_int(const char* path, int* v)
+{
+    FILE* fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    int ok = fscanf(fp, "%d", v) == 1;
+    fclose(fp);
+    return ok ? 0 : -1;
+}
+
+// The node of the first CPU whose level 3 cache has this id.
+static int domain_node(int l3_id, const cpu_set_t* node_sets, int nnodes)
+{
+    char path[160];
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        snprintf(path, sizeof(path), CPU_ROOT "/cpu%d", cpu);
+        if (access(path, F_OK) != 0)
+            break;
+        for (int idx = 0; idx < 8; idx++) {
+            int level, id;
+            snprintf(path, sizeof(path), CPU_ROOT "/cpu%d/cache/index%d/level", cpu, idx);
+            if (read_int(path, &level) != 0)
+                break;
+            snprintf(path, sizeof(path), CPU_ROOT "/cpu%d/cache/index%d/id", cpu, idx);
+            if (level != 3 || read_int(path, &id) != 0 || id != l3_id)
+                continue;
+            for (int i = 0; i < nnodes; i++)
+                if (CPU_ISSET(cpu, &node_sets[i]))
+                    return i;
+            return -1;
+        }
+    }
+    return -1;
+}
+
+static uint64_t read_bytes(struct stat_file* sf)
+{
+    // "Unavailable" or "Error" when the counter cannot be read.
+    return stat_file_read(sf) == 0 ? strtoull(sf->buf, NULL, 10) : 0;
+}
+
+static void read_nodes(struct mbm* m, uint64_t* out)
+{
+    memset(out, 0, sizeof(uint64_t) * 2 * m->nnodes);
+    for (int d = 0; d < m->ndomains; d++) {
+        struct mbm_domain* dom = &m->domains[d];
+        if (dom->node < 0 || dom->total.fd < 0)
+            continue;
+        out[2 * dom->node] += read_bytes(&dom->total);
+        out[2 * dom->node + 1] += read_bytes(&dom->local);
+    }
+}
+
+static void close_domains(struct mbm* m)
+{
+    for (int d = 0; d < m->ndomains; d++) {
+        stat_file_close(&m->domains[d].total);
+        stat_file_close(&m->domains[d].local);
+    }
+}
+
+// Open the counters of every domain under m->dir.
+static int open_domains(struct mbm* m)
+{
+    char path[PATH_MAX + 64];
+    close_domains(m);
+    for (int d = 0; d < m->ndomains; d++) {
+        struct mbm_domain* dom = &m->domains[d];
+        snprintf(path, sizeof(path), "%s/mon_data/%s/mbm_total_bytes", m->dir, dom->name);
+        if (stat_file_open(&dom->total, path) != 0) {
+            perror(path);
+            return -1;
+        }
+        snprintf(path, sizeof(path), "%s/mon_data/%s/mbm_local_bytes", m->dir, dom->name);
+        if (stat_file_open(&dom->local, path) != 0) {
+            perror(path);
+            return -1;
+        }
+    }
+    read_nodes(m, m->prev);
+    m->prev_ns = monotonic_ns();
+    return 0;
+}
+
+static void mbm_sample(struct collector* c, union cell* out)
+{
+    struct mbm* m = c->priv;
+    int64_t now_ns = monotonic_ns();
+    read_nodes(m, m->now);
+
+    double dt = (double)(now_ns - m->prev_ns) / 1e9;
+    for (int i = 0; i < 2 * m->nnodes; i++) {
+        // A counter that went backwards was reset, e.g. by a new group.
+        uint64_t delta = m->now[i] >= m->prev[i] ? m->now[i] - m->prev[i] : 0;
+        out[i].f = dt > 0 ? (double)delta / dt : 0;
+        m->prev[i] = m->now[i];
+    }
+    m->prev_ns = now_ns;
+}
+
+static void mbm_destroy(struct collector* c)
+{
+    struct mbm* m = c->priv;
+    if (!m)
+        return;
+    close_domains(m);
+    // Its tasks fall back to the default group.
+    if (m->created && rmdir(m->dir) != 0)
+        perror(m->dir);
+    free(m->prev);
+    free(m->now);
+    free(m);
+    c->priv = NULL;
+}
+
+// Move pid into a monitoring group of its own. Children it forks later
+// inherit the group. If the group cannot be created, the default group is
+// read instead.
+void mbm_attach(struct collector* c, pid_t pid)
+{
+    struct mbm* m = c->priv;
+    if (!m->auto_group)
+        return;
+
+    close_domains(m);
+    if (m->created)
+        rmdir(m->dir);
+    snprintf(m->dir, sizeof(m->dir), RESCTRL_ROOT "/mon_groups/numa_stat_%d", (int)pid);
+    if (mkdir(m->dir, 0755) != 0 && errno != EEXIST) {
+        perror(m->dir);
+        snprintf(m->dir, sizeof(m->dir), RESCTRL_ROOT);
+        m->created = 0;
+        open_domains(m);
+        return;
+    }
+    m->created = 1;
+
+    char path[PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s/tasks", m->dir);
+    // A pid that is gone is only reported when the write is flushed, by
+    // fclose().
+    FILE* fp = fopen(path, "w");
+    if (!fp)
+        perror(path);
+    else {
+        int bad = fprintf(fp, "%d\n", (int)pid) < 0;
+        if (fclose(fp) != 0 || bad)
+            perror(path);
+    }
+    open_domains(m);
+}
+
+static int cmp_domain(const void* a, const void* b)
+{
+    return ((const struct mbm_domain*)a)->id - ((const struct mbm_domain*)b)->id;
+}
+
+int mbm_create(struct collector* c, struct log_schema* ls, const char* group,
+    const struct node_set* nodes, uint64_t period)
+{
+    collector_init(c, "mbm", period);
+    c->sample = mbm_sample;
+    c->destroy = mbm_destroy;
+
+    struct mbm* m = calloc(1, sizeof(*m));
+    if (!m)
+        return -1;
+    c->priv = m;
+    m->nnodes = nodes->count;
+    m->prev = calloc(2 * (size_t)nodes->count, sizeof(uint64_t));
+    m->now = calloc(2 * (size_t)nodes->count, sizeof(uint64_t));
+    if (!m->prev || !m->now)
+        return -1;
+
+    DIR* dir = opendir(RESCTRL_ROOT "/mon_data");
+    if (!dir) {
+        perror(RESCTRL_ROOT "/mon_data");
+        fprintf(stderr, "Mount resctrl first: mount -t resctrl resctrl " RESCTRL_ROOT "\n");
+        return -1;
+    }
+    struct dirent* de;
+    while ((de = readdir(dir)) != NULL && m->ndomains < MAX_DOMAINS) {
+        int id;
+        if (sscanf(de->d_name, "mon_L3_%d", &id) == 1) {
+            struct mbm_domain* dom = &m->domains[m->ndomains++];
+            dom->id = id;
+            snprintf(dom->name, sizeof(dom->name), "%.31s", de->d_name);
+            dom->total.fd = dom->local.fd = -1;
+        }
+    }
+    closedir(dir);
+    qsort(m->domains, m->ndomains, sizeof(m->domains[0]), cmp_domain);
+
+    cpu_set_t* node_sets = calloc(nodes->count, sizeof(cpu_set_t));
+    if (!node_sets)
+        return -1;
+    for (int i = 0; i < nodes->count; i++)
+        if (node_cpus(nodes->ids[i], &node_sets[i]) < 0)
+            CPU_ZERO(&node_sets[i]);
+    for (int d = 0; d < m->ndomains; d++)
+        m->domains[d].node = domain_node(m->domains[d].id, node_sets, nodes->count);
+    free(node_sets);
+
+    // Until mbm_attach() an auto group reads the default group, which
+    // counts the whole system.
+    m->auto_group = group && strcmp(group, "auto") == 0;
+    if (!group || m->auto_group)
+        snprintf(m->dir, sizeof(m->dir), RESCTRL_ROOT);
+    else if (strchr(group, '/'))
+        snprintf(m->dir, sizeof(m->dir), "%s", group);
+    else {
+        snprintf(m->dir, sizeof(m->dir), RESCTRL_ROOT "/mon_groups/%s", group);
+        if (access(m->dir, F_OK) != 0)
+            snprintf(m->dir, sizeof(m->dir), RESCTRL_ROOT "/%s", group);
+    }
+    if (open_domains(m) != 0)
+        return -1;
+
+    char name[LOG_NAME_MAX];
+    for (int i = 0; i < nodes->count; i++) {
+        snprintf(name, sizeof(name), "node_%d_mbm_total_bytes_per_sec", nodes->ids[i]);
+        if (collector_add_column(c, ls, name, CELL_F64) < 0)
+            return -1;
+        snprintf(name, sizeof(name), "node_%d_mbm_local_bytes_per_sec", nodes->ids[i]);
+        if (collector_add_column(c, ls, name, CELL_F64) < 0)
+            return -1;
+    }
+    return collector_finish(c);
+}
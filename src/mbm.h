@@ -0,0 +1,19 @@
+#ifndef MBM_H
+#define MBM_H
+
+#include <sys/types.h>
+
+#include "collector.h"
+#include "nodes.h"
+
+// Memory bandwidth per node from resctrl memory bandwidth monitoring (Intel
+// RDT MBM / AMD QoS): mbm_total_bytes and mbm_local_bytes of every L3
+// monitoring domain, summed per node and logged as bytes per second. group
+// is NULL for the whole system (the default group), the name of an existing
+// group (mon_groups/<name> or a control group), or "auto" to create a
+// monitoring group for the process given to mbm_attach().
+int mbm_create(struct collector* c, struct log_schema* ls, const char* group,
+    const struct node_set* nodes, uint64_t period);
+void mbm_attach(struct collector* c, pid_t pid);
+
+#endif
@@ -0,0 +1,482 @@
+#define _GNU_SOURCE
+#include "migtrace.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/bpf.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include "cpulist.h"
+
+#define MAX_REASONS 16
+#define LAT_BUCKETS 12          // <= 1us, 2us, ... 1024us, then more
+#define MAX_NODE_SLOTS 1024
+#define REASON_NAME_MAX 64
+
+// Slots of the per-CPU value, all u64.
+enum {
+    SLOT_CALLS,
+    SLOT_PAGES,
+    SLOT_FAILED,
+    SLOT_REASON,
+    SLOT_LAT = SLOT_REASON + MAX_REASONS,
+    SLOT_NODE = SLOT_LAT + LAT_BUCKETS,
+};
+
+static const char* const tracefs_roots[] = {
+    "/sys/kernel/tracing",
+    "/sys/kernel/debug/tracing",
+};
+
+struct tp_field {
+    int offset;
+    int size;
+};
+
+struct migtrace {
+    const struct node_set* nodes;
+    int node_slots;
+    int nreasons;
+    int nslots;
+    int ncpus;
+    int counts_fd;
+    int start_fd;
+    int prog_fd[2];
+    int event_fd[2];
+    uint64_t* values;       // ncpus x nslots, as read from the map
+    uint64_t* prev;         // nslots sums at the previous tick
+};
+
+// --- Hand-assembled eBPF ---
+
+struct prog {
+    struct bpf_insn insn[256];
+    int n;
+};
+
+static void emit(struct prog* p, uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm)
+{
+    if (p->n < (int)(sizeof(p->insn) / sizeof(p->insn[0])))
+        p->insn[p->n] = (struct bpf_insn) { .code = code, .dst_reg = dst, .src_reg = src, .off = off, .imm = imm };
+    p->n++;
+}
+
+#define MOV_IMM(p, d, imm)      emit(p, BPF_ALU64 | BPF_MOV | BPF_K, d, 0, 0, imm)
+#define MOV_REG(p, d, s)        emit(p, BPF_ALU64 | BPF_MOV | BPF_X, d, s, 0, 0)
+#define ALU_IMM(p, op, d, imm)  emit(p, BPF_ALU64 | (op) | BPF_K, d, 0, 0, imm)
+#define ALU_REG(p, op, d, s)    emit(p, BPF_ALU64 | (op) | BPF_X, d, s, 0, 0)
+#define LDX(p, sz, d, s, off)   emit(p, BPF_LDX | BPF_MEM | (sz), d, s, off, 0)
+#define STX(p, sz, d, s, off)   emit(p, BPF_STX | BPF_MEM | (sz), d, s, off, 0)
+#define ST_IMM(p, sz, d, off, imm) emit(p, BPF_ST | BPF_MEM | (sz), d, 0, off, imm)
+#define JMP_IMM(p, op, d, imm, off) emit(p, BPF_JMP | (op) | BPF_K, d, 0, off, imm)
+#define CALL(p, fn)             emit(p, BPF_JMP | BPF_CALL, 0, 0, 0, fn)
+#define EXIT(p)                 emit(p, BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+static void ld_map_fd(struct prog* p, uint8_t dst, int fd)
+{
+    emit(p, BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, fd);
+    emit(p, 0, 0, 0, 0, 0);
+}
+
+// start[pid_tgid] = ktime
+static void build_start(struct prog* p, int start_fd)
+{
+    CALL(p, BPF_FUNC_get_current_pid_tgid);
+    STX(p, BPF_DW, BPF_REG_10, BPF_REG_0, -8);
+    CALL(p, BPF_FUNC_ktime_get_ns);
+    STX(p, BPF_DW, BPF_REG_10, BPF_REG_0, -16);
+    ld_map_fd(p, BPF_REG_1, start_fd);
+    MOV_REG(p, BPF_REG_2, BPF_REG_10);
+    ALU_IMM(p, BPF_ADD, BPF_REG_2, -8);
+    MOV_REG(p, BPF_REG_3, BPF_REG_10);
+    ALU_IMM(p, BPF_ADD, BPF_REG_3, -16);
+    MOV_IMM(p, BPF_REG_4, BPF_ANY);
+    CALL(p, BPF_FUNC_map_update_elem);
+    MOV_IMM(p, BPF_REG_0, 0);
+    EXIT(p);
+}
+
+// slot[index in r1, < limit] += *(u64*)(r10 + value_off), r9 = the value.
+static void add_indexed(struct prog* p, int base, int limit, int value_off)
+{
+    JMP_IMM(p, BPF_JGE, BPF_REG_1, limit, 6);
+    ALU_IMM(p, BPF_LSH, BPF_REG_1, 3);
+    ALU_REG(p, BPF_ADD, BPF_REG_1, BPF_REG_9);
+    LDX(p, BPF_DW, BPF_REG_2, BPF_REG_1, base * 8);
+    LDX(p, BPF_DW, BPF_REG_3, BPF_REG_10, value_off);
+    ALU_REG(p, BPF_ADD, BPF_REG_2, BPF_REG_3);
+    STX(p, BPF_DW, BPF_REG_1, BPF_REG_2, base * 8);
+}
+
+// Stack: -8 pid_tgid, -16 succeeded, -24 failed, -32 reason, -40 cpu node,
+// -48 constant 1, -52 counts key. r8 = latency or -1.
+static void build_end(struct prog* p, const struct migtrace* m, struct tp_field succeeded,
+    struct tp_field failed, struct tp_field reason)
+{
+    MOV_REG(p, BPF_REG_6, BPF_REG_1);
+    CALL(p, BPF_FUNC_get_current_pid_tgid);
+    STX(p, BPF_DW, BPF_REG_10, BPF_REG_0, -8);
+    CALL(p, BPF_FUNC_ktime_get_ns);
+    MOV_REG(p, BPF_REG_7, BPF_REG_0);
+    MOV_IMM(p, BPF_REG_8, -1);
+    ld_map_fd(p, BPF_REG_1, m->start_fd);
+    MOV_REG(p, BPF_REG_2, BPF_REG_10);
+    ALU_IMM(p, BPF_ADD, BPF_REG_2, -8);
+    CALL(p, BPF_FUNC_map_lookup_elem);
+    JMP_IMM(p, BPF_JEQ, BPF_REG_0, 0, 8);
+    LDX(p, BPF_DW, BPF_REG_1, BPF_REG_0, 0);
+    MOV_REG(p, BPF_REG_8, BPF_REG_7);
+    ALU_REG(p, BPF_SUB, BPF_REG_8, BPF_REG_1);
+    ld_map_fd(p, BPF_REG_1, m->start_fd);
+    MOV_REG(p, BPF_REG_2, BPF_REG_10);
+    ALU_IMM(p, BPF_ADD, BPF_REG_2, -8);
+    CALL(p, BPF_FUNC_map_delete_elem);
+
+    LDX(p, BPF_DW, BPF_REG_1, BPF_REG_6, succeeded.offset);
+    STX(p, BPF_DW, BPF_REG_10, BPF_REG_1, -16);
+    LDX(p, BPF_DW, BPF_REG_1, BPF_REG_6, failed.offset);
+    STX(p, BPF_DW, BPF_REG_10, BPF_REG_1, -24);
+    LDX(p, BPF_W, BPF_REG_1, BPF_REG_6, reason.offset);
+    STX(p, BPF_DW, BPF_REG_10, BPF_REG_1, -32);
+    CALL(p, BPF_FUNC_get_numa_node_id);
+    STX(p, BPF_DW, BPF_REG_10, BPF_REG_0, -40);
+    ST_IMM(p, BPF_DW, BPF_REG_10, -48, 1);
+
+    ST_IMM(p, BPF_W, BPF_REG_10, -52, 0);
+    ld_map_fd(p, BPF_REG_1, m->counts_fd);
+    MOV_REG(p, BPF_REG_2, BPF_REG_10);
+    ALU_IMM(p, BPF_ADD, BPF_REG_2, -52);
+    CALL(p, BPF_FUNC_map_lookup_elem);
+    JMP_IMM(p, BPF_JNE, BPF_REG_0, 0, 2);
+    MOV_IMM(p, BPF_REG_0, 0);
+    EXIT(p);
+    MOV_REG(p, BPF_REG_9, BPF_REG_0);
+
+    MOV_IMM(p, BPF_REG_1, SLOT_CALLS);
+    add_indexed(p, 0, 1, -48);
+    MOV_IMM(p, BPF_REG_1, SLOT_PAGES);
+    add_indexed(p, 0, SLOT_PAGES + 1, -16);
+    MOV_IMM(p, BPF_REG_1, SLOT_FAILED);
+    add_indexed(p, 0, SLOT_FAILED + 1, -24);
+    LDX(p, BPF_DW, BPF_REG_1, BPF_REG_10, -32);
+    add_indexed(p, SLOT_REASON, m->nreasons, -16);
+    LDX(p, BPF_DW, BPF_REG_1, BPF_REG_10, -40);
+    add_indexed(p, SLOT_NODE, m->node_slots, -16);
+
+    // Latency bucket: the first k with latency <= 1us << k.
+    JMP_IMM(p, BPF_JEQ, BPF_REG_8, -1, 2 * (LAT_BUCKETS - 1) + 1 + 7);
+    MOV_IMM(p, BPF_REG_1, 0);
+    for (int k = 0; k < LAT_BUCKETS - 1; k++) {
+        JMP_IMM(p, BPF_JLE, BPF_REG_8, 1000 << k, 2 * (LAT_BUCKETS - 1 - k) - 1);
+        ALU_IMM(p, BPF_ADD, BPF_REG_1, 1);
+    }
+    add_indexed(p, SLOT_LAT, LAT_BUCKETS, -48);
+
+    MOV_IMM(p, BPF_REG_0, 0);
+    EXIT(p);
+}
+
+static int sys_bpf(int cmd, union bpf_attr* attr)
+{
+    return (int)syscall(SYS_bpf, cmd, attr, sizeof(*attr));
+}
+
+static int load_prog(const struct prog* p, const char* what)
+{
+    static char log[65536];
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_TRACEPOINT;
+    attr.insns = (uint64_t)(uintptr_t)p->insn;
+    attr.insn_cnt = (uint32_t)p->n;
+    attr.license = (uint64_t)(uintptr_t)"GPL";
+
+    int fd = sys_bpf(BPF_PROG_LOAD, &attr);
+    if (fd >= 0)
+        return fd;
+    int err = errno;
+
+    // Load again with the verifier log to say why.
+    attr.log_buf = (uint64_t)(uintptr_t)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+    log[0] = '\0';
+    sys_bpf(BPF_PROG_LOAD, &attr);
+    fprintf(stderr, "Loading the %s program: %s%s\n%s", what, strerror(err),
+        err == EPERM ? " (needs CAP_BPF and CAP_PERFMON, or root)" : "", log);
+    return -1;
+}
+
+static int create_map(int type, int key_size, int value_size, int max_entries)
+{
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = (uint32_t)type;
+    attr.key_size = (uint32_t)key_size;
+    attr.value_size = (uint32_t)value_size;
+    attr.max_entries = (uint32_t)max_entries;
+    int fd = sys_bpf(BPF_MAP_CREATE, &attr);
+    if (fd < 0)
+        perror("bpf map create");
+    return fd;
+}
+
+// --- Tracepoint formats ---
+
+static FILE* open_event_file(const char* event, const char* file)
+{
+    char path[256];
+    for (size_t i = 0; i < sizeof(tracefs_roots) / sizeof(tracefs_roots[0]); i++) {
+        snprintf(path, sizeof(path), "%s/events/migrate/%s/%s", tracefs_roots[i], event, file);
+        FILE* fp = fopen(path, "r");
+        if (fp)
+            return fp;
+    }
+    fprintf(stderr, "No migrate:%s tracepoint; is tracefs mounted "
+        "(mount -t tracefs nodev /sys/kernel/tracing)?\n", event);
+    return NULL;
+}
+
+static int event_id(const char* event)
+{
+    FILE* fp = open_event_file(event, "id");
+    if (!fp)
+        return -1;
+    int id = -1;
+    if (fscanf(fp, "%d", &id) != 1)
+        id = -1;
+    fclose(fp);
+    return id;
+}
+
+static int find_field(const char* format, const char* name, struct tp_field* f)
+{
+    char want[64];
+    snprintf(want, sizeof(want), " %s;", name);
+    for (const char* line = format; (line = strstr(line, "field:")) != NULL; line++) {
+        const char* semi = strchr(line, ';');
+        if (!semi || semi - line < (long)strlen(want) - 1 ||
+            strncmp(semi - strlen(want) + 1, want, strlen(want)) != 0)
+            continue;
+        if (sscanf(semi + 1, " offset:%d; size:%d;", &f->offset, &f->size) == 2)
+            return 0;
+    }
+    fprintf(stderr, "migrate:mm_migrate_pages has no field %s\n", name);
+    return -1;
+}
+
+// Reason names from '__print_symbolic(REC->reason, {0, "compaction"}, ...)'.
+static int parse_reasons(const char* format, char names[][REASON_NAME_MAX], int max)
+{
+    const char* p = strstr(format, "REC->reason,");
+    if (!p)
+        return 0;
+    int n = 0;
+    const char* end = strchr(p, ')');
+    while ((p = strchr(p, '{')) != NULL && (!end || p < end)) {
+        int value;
+        if (n < max && sscanf(p, "{%d, \"%63[^\"]\"}", &value, names[n]) == 2 && value == n)
+            n++;
+        p++;
+    }
+    return n;
+}
+
+static int attach(int id, int prog_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.config = (uint64_t)id;
+    attr.sample_period = 1;
+    attr.wakeup_events = 1;
+
+    // The program runs for the tracepoint on every CPU, whatever CPU the
+    // event itself is opened on.
+    int fd = (int)syscall(SYS_perf_event_open, &attr, -1, 0, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0) {
+        perror("perf_event_open tracepoint");
+        return -1;
+    }
+    if (ioctl(fd, PERF_EVENT_IOC_SET_BPF, prog_fd) != 0 || ioctl(fd, PERF_EVENT_IOC_ENABLE, 0) != 0) {
+        perror("attach migrate tracepoint");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// --- Collector ---
+
+static void migtrace_sample(struct collector* c, union cell* out)
+{
+    struct migtrace* m = c->priv;
+    union bpf_attr attr;
+    uint32_t key = 0;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = (uint32_t)m->counts_fd;
+    attr.key = (uint64_t)(uintptr_t)&key;
+    attr.value = (uint64_t)(uintptr_t)m->values;
+    if (sys_bpf(BPF_MAP_LOOKUP_ELEM, &attr) != 0) {
+        for (int i = 0; i < c->ncols; i++)
+            out[i].u = 0;
+        return;
+    }
+
+    // Sum over CPUs, in place in the first CPU's row, then take the change.
+    uint64_t* sum = m->values;
+    for (int cpu = 1; cpu < m->ncpus; cpu++)
+        for (int s = 0; s < m->nslots; s++)
+            sum[s] += m->values[(size_t)cpu * m->nslots + s];
+    for (int s = 0; s < m->nslots; s++) {
+        uint64_t v = sum[s];
+        sum[s] = v - m->prev[s];
+        m->prev[s] = v;
+    }
+
+    int col = 0;
+    out[col++].u = sum[SLOT_CALLS];
+    out[col++].u = sum[SLOT_PAGES];
+    out[col++].u = sum[SLOT_FAILED];
+    for (int r = 0; r < m->nreasons; r++)
+        out[col++].u = sum[SLOT_REASON + r];
+    for (int b = 0; b < LAT_BUCKETS; b++)
+        out[col++].u = sum[SLOT_LAT + b];
+    for (int i = 0; i < m->nodes->count; i++) {
+        int id = m->nodes->ids[i];
+        out[col++].u = id < m->node_slots ? sum[SLOT_NODE + id] : 0;
+    }
+}
+
+static void migtrace_destroy(struct collector* c)
+{
+    struct migtrace* m = c->priv;
+    if (!m)
+        return;
+    for (int i = 0; i < 2; i++) {
+        if (m->event_fd[i] >= 0)
+            close(m->event_fd[i]);
+        if (m->prog_fd[i] >= 0)
+            close(m->prog_fd[i]);
+    }
+    if (m->counts_fd >= 0)
+        close(m->counts_fd);
+    if (m->start_fd >= 0)
+        close(m->start_fd);
+    free(m->values);
+    free(m->prev);
+    free(m);
+    c->priv = NULL;
+}
+
+static int read_format(char* buf, size_t size)
+{
+    FILE* fp = open_event_file("mm_migrate_pages", "format");
+    if (!fp)
+        return -1;
+    size_t n = fread(buf, 1, size - 1, fp);
+    buf[n] = '\0';
+    fclose(fp);
+    return 0;
+}
+
+static int possible_cpus(void)
+{
+    cpu_set_t set;
+    if (cpulist_read("/sys/devices/system/cpu/possible", &set) <= 0)
+        return -1;
+    int n = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set))
+            n = cpu + 1;
+    return n;
+}
+
+int migtrace_create(struct collector* c, struct log_schema* ls, const struct node_set* nodes)
+{
+    // Drained every tick.
+    collector_init(c, "migtrace", 1);
+    c->sample = migtrace_sample;
+    c->destroy = migtrace_destroy;
+
+    struct migtrace* m = calloc(1, sizeof(*m));
+    if (!m)
+        return -1;
+    c->priv = m;
+    m->nodes = nodes;
+    m->counts_fd = m->start_fd = -1;
+    m->prog_fd[0] = m->prog_fd[1] = m->event_fd[0] = m->event_fd[1] = -1;
+
+    static char format[16384];
+    char reasons[MAX_REASONS][REASON_NAME_MAX];
+    struct tp_field succeeded, failed, reason;
+    int start_id = event_id("mm_migrate_pages_start");
+    int end_id = event_id("mm_migrate_pages");
+    if (start_id < 0 || end_id < 0 || read_format(format, sizeof(format)) != 0 ||
+        find_field(format, "succeeded", &succeeded) != 0 || find_field(format, "failed", &failed) != 0 ||
+        find_field(format, "reason", &reason) != 0)
+        return -1;
+    if (succeeded.size != 8 || failed.size != 8 || reason.size != 4) {
+        fprintf(stderr, "Unexpected migrate:mm_migrate_pages field sizes\n");
+        return -1;
+    }
+    m->nreasons = parse_reasons(format, reasons, MAX_REASONS);
+
+    m->node_slots = nodes->max_id + 1 < MAX_NODE_SLOTS ? nodes->max_id + 1 : MAX_NODE_SLOTS;
+    m->nslots = SLOT_NODE + m->node_slots;
+    m->ncpus = possible_cpus();
+    if (m->ncpus <= 0) {
+        fprintf(stderr, "Cannot read /sys/devices/system/cpu/possible\n");
+        return -1;
+    }
+    m->values = calloc((size_t)m->ncpus * m->nslots, sizeof(uint64_t));
+    m->prev = calloc(m->nslots, sizeof(uint64_t));
+    if (!m->values || !m->prev)
+        return -1;
+
+    m->counts_fd = create_map(BPF_MAP_TYPE_PERCPU_ARRAY, 4, m->nslots * 8, 1);
+    m->start_fd = create_map(BPF_MAP_TYPE_HASH, 8, 8, 16384);
+    if (m->counts_fd < 0 || m->start_fd < 0)
+        return -1;
+
+    struct prog start = { .n = 0 }, end = { .n = 0 };
+    build_start(&start, m->start_fd);
+    build_end(&end, m, succeeded, failed, reason);
+    if ((m->prog_fd[0] = load_prog(&start, "migrate start")) < 0 ||
+        (m->prog_fd[1] = load_prog(&end, "migrate")) < 0 ||
+        (m->event_fd[0] = attach(start_id, m->prog_fd[0])) < 0 ||
+        (m->event_fd[1] = attach(end_id, m->prog_fd[1])) < 0)
+        return -1;
+
+    char name[LOG_NAME_MAX];
+    static const char* const totals[] = { "mig_calls", "mig_pages", "mig_failed" };
+    for (int i = 0; i < 3; i++)
+        if (collector_add_column(c, ls, totals[i], CELL_U64) < 0)
+            return -1;
+    for (int r = 0; r < m->nreasons; r++) {
+        snprintf(name, sizeof(name), "mig_%.63s_pages", reasons[r]);
+        if (collector_add_column(c, ls, name, CELL_U64) < 0)
+            return -1;
+    }
+    for (int b = 0; b < LAT_BUCKETS; b++) {
+        if (b < LAT_BUCKETS - 1)
+            snprintf(name, sizeof(name), "mig_lat_le_%dus", 1 << b);
+        else
+            snprintf(name, sizeof(name), "mig_lat_gt_%dus", 1 << (b - 1));
+        if (collector_add_column(c, ls, name, CELL_U64) < 0)
+            return -1;
+    }
+    for (int i = 0; i < nodes->count; i++) {
+        snprintf(name, sizeof(name), "node_%d_mig_pages", nodes->ids[i]);
+        if (collector_add_column(c, ls, name, CELL_U64) < 0)
+            return -1;
+    }
+    return collector_finish(c);
+}
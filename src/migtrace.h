@@ -0,0 +1,16 @@
+#ifndef MIGTRACE_H
+#define MIGTRACE_H
+
+#include "collector.h"
+#include "nodes.h"
+
+// Page migration detail from the migrate:mm_migrate_pages_start and
+// migrate:mm_migrate_pages tracepoints. Two small eBPF programs, built at
+// startup from the tracepoint formats (no libbpf or compiler needed), add
+// every migrate_pages() call into a per-CPU array in the kernel: calls,
+// pages migrated and failed, pages per migration reason, pages per node of
+// the CPU doing the migration and a log2 latency histogram. Each tick reads
+// the array with one syscall and logs the change since the last tick.
+int migtrace_create(struct collector* c, struct log_schema* ls, const struct node_set* nodes);
+
+#endif
@@ -0,0 +1,166 @@
+#define _GNU_SOURCE
+#include "node_sampler.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpulist.h"
+
+// Pin the calling thread to the CPUs of a node, preferring those the
+// logger is allowed on (--logger-cpus). Memory-only nodes have no CPUs;
+// their thread keeps the logger's own affinity.
+static int pin_to_node(int node_id)
+{
+    cpu_set_t set, allowed;
+    int n = node_cpus(node_id, &set);
+    if (n <= 0)
+        return 0;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(allowed), &allowed) == 0) {
+        CPU_AND(&allowed, &allowed, &set);
+        if (CPU_COUNT(&allowed) > 0)
+            set = allowed;
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+static void* worker_main(void* arg)
+{
+    struct node_worker* w = arg;
+    struct node_pool* np = w->pool;
+
+    // The barriers exist only once every thread has been created.
+    pthread_mutex_lock(&np->gate_lock);
+    while (!np->gate_open)
+        pthread_cond_wait(&np->gate_cond, &np->gate_lock);
+    pthread_mutex_unlock(&np->gate_lock);
+    if (np->stop)
+        return NULL;
+
+    w->pinned = pin_to_node(np->s->nodes->ids[w->node]);
+
+    // Allocated after pinning, so first touch places the slot on the node.
+    size_t bytes = (sizeof(uint64_t) * np->slot_values + 63) & ~(size_t)63;
+    if (posix_memalign((void**)&w->slot, 64, bytes ? bytes : 64) != 0)
+        w->slot = NULL;
+    else
+        memset(w->slot, 0, bytes);
+
+    pthread_barrier_wait(&np->done);
+
+    for (;;) {
+        pthread_barrier_wait(&np->start);
+        if (np->stop)
+            break;
+        memset(&w->times, 0, sizeof(w->times));
+        if (w->slot)
+            sampler_sample_node(np->s, w->node, w->slot, np->timed ? &w->times : NULL);
+        pthread_barrier_wait(&np->done);
+    }
+    return NULL;
+}
+
+int node_pool_start(struct node_pool* np, struct sampler* s)
+{
+    memset(np, 0, sizeof(*np));
+    np->s = s;
+    np->nworkers = s->numa_count;
+    np->slot_values = sampler_node_values(s);
+
+    // Each worker is cache-line aligned, as the threads update their
+    // timings in place.
+    size_t bytes = sizeof(*np->workers) * np->nworkers;
+    np->workers = aligned_alloc(64, (bytes + 63) & ~(size_t)63);
+    if (!np->workers)
+        return -1;
+    memset(np->workers, 0, bytes);
+
+    pthread_mutex_init(&np->gate_lock, NULL);
+    pthread_cond_init(&np->gate_cond, NULL);
+
+    int created = 0;
+    for (; created < np->nworkers; created++) {
+        struct node_worker* w = &np->workers[created];
+        w->pool = np;
+        w->node = created;
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0)
+            break;
+        char name[16];
+        snprintf(name, sizeof(name), "numa-node%d", s->nodes->ids[created]);
+        pthread_setname_np(w->thread, name);
+    }
+
+    pthread_mutex_lock(&np->gate_lock);
+    if (created < np->nworkers)
+        np->stop = 1;
+    else {
+        pthread_barrier_init(&np->start, NULL, np->nworkers + 1);
+        pthread_barrier_init(&np->done, NULL, np->nworkers + 1);
+    }
+    np->gate_open = 1;
+    pthread_cond_broadcast(&np->gate_cond);
+    pthread_mutex_unlock(&np->gate_lock);
+
+    if (np->stop) {
+        fprintf(stderr, "Failed to start node sampler threads\n");
+        for (int i = 0; i < created; i++)
+            pthread_join(np->workers[i].thread, NULL);
+        free(np->workers);
+        return -1;
+    }
+    np->running = 1;
+
+    // Wait until every thread is pinned and has its slot.
+    pthread_barrier_wait(&np->done);
+
+    int unpinned = 0;
+    for (int i = 0; i < np->nworkers; i++) {
+        if (!np->workers[i].slot) {
+            fprintf(stderr, "Failed to allocate node sampler slots\n");
+            node_pool_stop(np);
+            return -1;
+        }
+        unpinned += !np->workers[i].pinned;
+    }
+    if (unpinned)
+        fprintf(stderr, "%d node sampler thread(s) not pinned (node without CPUs)\n", unpinned);
+    return 0;
+}
+
+// Release all node threads at once, read the system-wide files meanwhile,
+// then gather the node slots once every thread is done. t, if not NULL,
+// receives the read and parse time summed over all threads.
+void node_pool_sample(struct node_pool* np, uint64_t* values, struct sampler_times* t)
+{
+    np->timed = t != NULL;
+    pthread_barrier_wait(&np->start);
+    sampler_sample_global(np->s, values, t);
+    pthread_barrier_wait(&np->done);
+
+    for (int i = 0; i < np->nworkers; i++) {
+        sampler_scatter_node(np->s, i, np->workers[i].slot, values);
+        if (t) {
+            t->read_ns += np->workers[i].times.read_ns;
+            t->parse_ns += np->workers[i].times.parse_ns;
+        }
+    }
+}
+
+void node_pool_stop(struct node_pool* np)
+{
+    if (!np->running)
+        return;
+    np->stop = 1;
+    pthread_barrier_wait(&np->start);
+    for (int i = 0; i < np->nworkers; i++) {
+        pthread_join(np->workers[i].thread, NULL);
+        free(np->workers[i].slot);
+    }
+    pthread_barrier_destroy(&np->start);
+    pthread_barrier_destroy(&np->done);
+    pthread_cond_destroy(&np->gate_cond);
+    pthread_mutex_destroy(&np->gate_lock);
+    free(np->workers);
+    np->running = 0;
+}
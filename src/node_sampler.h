@@ -0,0 +1,41 @@
+#ifndef NODE_SAMPLER_H
+#define NODE_SAMPLER_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "sampler.h"
+
+// One sampler thread per node, pinned to that node's CPUs. Each thread
+// parses its node's files into its own cache-line-aligned slot, so a tick
+// reads all nodes at nearly the same moment and no two threads write to
+// the same cache line.
+struct node_worker {
+    _Alignas(64) struct node_pool* pool;
+    int node;
+    int pinned;
+    pthread_t thread;
+    uint64_t* slot;
+    struct sampler_times times;
+};
+
+struct node_pool {
+    struct sampler* s;
+    int nworkers;
+    int slot_values;
+    struct node_worker* workers;
+    pthread_mutex_t gate_lock;
+    pthread_cond_t gate_cond;
+    int gate_open;
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+    int stop;
+    int timed;
+    int running;
+};
+
+int node_pool_start(struct node_pool* np, struct sampler* s);
+void node_pool_sample(struct node_pool* np, uint64_t* values, struct sampler_times* t);
+void node_pool_stop(struct node_pool* np);
+
+#endif
@@ -0,0 +1,130 @@
+#include "nodes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stat_file.h"
+
+// Rebuild the ID -> index lookup after the ID list changed.
+static int build_index(struct node_set* ns)
+{
+    free(ns->index_of);
+    ns->max_id = -1;
+    for (int i = 0; i < ns->count; i++)
+        if (ns->ids[i] > ns->max_id)
+            ns->max_id = ns->ids[i];
+
+    ns->index_of = malloc(sizeof(int) * (ns->max_id + 1 > 0 ? ns->max_id + 1 : 1));
+    if (!ns->index_of)
+        return -1;
+    for (int id = 0; id <= ns->max_id; id++)
+        ns->index_of[id] = -1;
+    for (int i = 0; i < ns->count; i++)
+        ns->index_of[ns->ids[i]] = i;
+    return 0;
+}
+
+// Parse a kernel node list such as "0-1,4-5" (the format of
+// /sys/devices/system/node/online). IDs are kept in ascending order and
+// duplicates are ignored.
+int node_set_parse(struct node_set* ns, const char* list)
+{
+    memset(ns, 0, sizeof(*ns));
+    unsigned char* seen = calloc(NODE_ID_MAX + 1, 1);
+    if (!seen)
+        return -1;
+
+    const char* s = list;
+    while (*s && *s != '\n') {
+        char* end;
+        long lo = strtol(s, &end, 10);
+        long hi = lo;
+        if (end == s || lo < 0)
+            goto bad;
+        s = end;
+        if (*s == '-') {
+            hi = strtol(s + 1, &end, 10);
+            if (end == s + 1 || hi < lo)
+                goto bad;
+            s = end;
+        }
+        if (hi > NODE_ID_MAX)
+            goto bad;
+        for (long id = lo; id <= hi; id++)
+            seen[id] = 1;
+        if (*s == ',')
+            s++;
+        else if (*s && *s != '\n')
+            goto bad;
+    }
+
+    for (int id = 0; id <= NODE_ID_MAX; id++)
+        ns->count += seen[id];
+    if (ns->count == 0)
+        goto bad;
+    ns->ids = malloc(sizeof(int) * ns->count);
+    if (!ns->ids) {
+        free(seen);
+        return -1;
+    }
+    for (int id = 0, i = 0; id <= NODE_ID_MAX; id++)
+        if (seen[id])
+            ns->ids[i++] = id;
+    free(seen);
+    return build_index(ns);
+
+bad:
+    fprintf(stderr, "Invalid NUMA node list '%.*s'\n", (int)strcspn(list, "\n"), list);
+    free(seen);
+    node_set_free(ns);
+    return -1;
+}
+
+// Nodes with memory, falling back to all online nodes on kernels without
+// has_memory. One file read, no probing of node directories.
+int node_set_discover(struct node_set* ns)
+{
+    static const char* const paths[] = {
+        "/sys/devices/system/node/has_memory",
+        "/sys/devices/system/node/online",
+    };
+
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        struct stat_file sf;
+        if (stat_file_open(&sf, paths[i]) != 0)
+            continue;
+        int ret = stat_file_read(&sf) == 0 ? node_set_parse(ns, sf.buf) : -1;
+        stat_file_close(&sf);
+        return ret;
+    }
+
+    fprintf(stderr, "Cannot read the online NUMA nodes from /sys/devices/system/node\n");
+    return -1;
+}
+
+// Keep only the first count nodes.
+int node_set_truncate(struct node_set* ns, int count)
+{
+    if (count > ns->count) {
+        fprintf(stderr, "Asked for %d NUMA nodes but found only %d\n", count, ns->count);
+        return -1;
+    }
+    ns->count = count;
+    return build_index(ns);
+}
+
+// Index of a node ID in the table, or -1 if it is not logged.
+int node_set_index(const struct node_set* ns, int id)
+{
+    if (id < 0 || id > ns->max_id)
+        return -1;
+    return ns->index_of[id];
+}
+
+void node_set_free(struct node_set* ns)
+{
+    free(ns->ids);
+    free(ns->index_of);
+    memset(ns, 0, sizeof(*ns));
+}
@@ -0,0 +1,23 @@
+#ifndef NODES_H
+#define NODES_H
+
+// Highest node ID accepted from sysfs or the command line.
+#define NODE_ID_MAX 4095
+
+// Compact table of the NUMA nodes being logged. Node IDs may be sparse
+// (e.g. 0, 1, 4, 5 on CXL machines); columns are labelled with the real
+// ID and stored at the node's index in this table.
+struct node_set {
+    int count;
+    int* ids;
+    int max_id;
+    int* index_of;
+};
+
+int node_set_parse(struct node_set* ns, const char* list);
+int node_set_discover(struct node_set* ns);
+int node_set_truncate(struct node_set* ns, int count);
+int node_set_index(const struct node_set* ns, int id);
+void node_set_free(struct node_set* ns);
+
+#endif
@@ -0,0 +1,108 @@
+#include "numa_maps.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int numa_maps_init(struct numa_maps* m, const struct node_set* nodes)
+{
+    memset(m, 0, sizeof(*m));
+    m->nodes = nodes;
+    m->cap = NUMA_MAPS_WINDOW;
+    m->buf = malloc(m->cap);
+    m->line_pages = calloc(nodes->count ? nodes->count : 1, sizeof(uint64_t));
+    if (!m->buf || !m->line_pages) {
+        numa_maps_free(m);
+        return -1;
+    }
+    return 0;
+}
+
+// One numa_maps line, e.g.
+//   7f3c... default anon=12 dirty=12 N0=8 N1=4 kernelpagesize_kB=4
+// The N<node>= counts are in units of the mapping's page size, which is
+// only given at the end of the line.
+static void parse_line(struct numa_maps* m, const char* s, const char* end, uint64_t* node_kb)
+{
+    int any = 0;
+    uint64_t page_kb = 4;
+
+    while (s < end) {
+        while (s < end && *s == ' ')
+            s++;
+        const char* tok = s;
+        while (s < end && *s != ' ')
+            s++;
+
+        if (tok[0] == 'N' && tok + 1 < s && isdigit((unsigned char)tok[1])) {
+            const char* q = tok + 1;
+            int node = 0;
+            while (q < s && isdigit((unsigned char)*q))
+                node = node * 10 + (*q++ - '0');
+            int idx = node_set_index(m->nodes, node);
+            if (q < s && *q == '=' && idx >= 0) {
+                uint64_t v = 0;
+                for (q++; q < s && isdigit((unsigned char)*q); q++)
+                    v = v * 10 + (uint64_t)(*q - '0');
+                m->line_pages[idx] += v;
+                any = 1;
+            }
+        }
+        else if (s - tok > 18 && memcmp(tok, "kernelpagesize_kB=", 18) == 0) {
+            page_kb = strtoull(tok + 18, NULL, 10);
+        }
+    }
+
+    if (!any)
+        return;
+    for (int i = 0; i < m->nodes->count; i++) {
+        node_kb[i] += m->line_pages[i] * page_kb;
+        m->line_pages[i] = 0;
+    }
+}
+
+// Add the file's kB per node to node_kb. Returns -1 if a line outgrew the
+// window and the window could not be grown; node_kb then holds the lines
+// before it.
+int numa_maps_read(struct numa_maps* m, int fd, uint64_t* node_kb)
+{
+    size_t have = 0;
+    for (;;) {
+        // A partial line that fills the window: make room for the rest.
+        if (have == m->cap) {
+            char* buf = realloc(m->buf, m->cap * 2);
+            if (!buf)
+                return -1;
+            m->buf = buf;
+            m->cap *= 2;
+        }
+
+        ssize_t n = read(fd, m->buf + have, m->cap - have);
+        if (n <= 0) {
+            if (have)
+                parse_line(m, m->buf, m->buf + have, node_kb);
+            return 0;
+        }
+        have += (size_t)n;
+
+        char* s = m->buf;
+        char* end = m->buf + have;
+        char* nl;
+        while ((nl = memchr(s, '\n', (size_t)(end - s))) != NULL) {
+            parse_line(m, s, nl, node_kb);
+            s = nl + 1;
+        }
+
+        // Carry the partial last line over to the next read.
+        have = (size_t)(end - s);
+        memmove(m->buf, s, have);
+    }
+}
+
+void numa_maps_free(struct numa_maps* m)
+{
+    free(m->buf);
+    free(m->line_pages);
+    memset(m, 0, sizeof(*m));
+}
@@ -0,0 +1,26 @@
+#ifndef NUMA_MAPS_H
+#define NUMA_MAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nodes.h"
+
+// Initial size of the read window; it grows to the longest line seen.
+#define NUMA_MAPS_WINDOW 65536
+
+// Reader for /proc/<pid>/numa_maps: adds up the pages every mapping has on
+// each node. Lines are parsed as they complete, so the file is never held
+// whole, and a line is never split, however long it is.
+struct numa_maps {
+    const struct node_set* nodes;
+    char* buf;
+    size_t cap;
+    uint64_t* line_pages;
+};
+
+int numa_maps_init(struct numa_maps* m, const struct node_set* nodes);
+int numa_maps_read(struct numa_maps* m, int fd, uint64_t* node_kb);
+void numa_maps_free(struct numa_maps* m);
+
+#endif
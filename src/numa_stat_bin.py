@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""
+Load numa_stat_logger binary logs (--format bin) without a text parse.
+
+The file is a self-describing header followed by fixed-width little-endian
+records (see logfmt.h). The records are mapped with numpy.memmap, so a
+multi-gigabyte log opens instantly and only the columns you touch are read.
+
+    import numa_stat_bin
+    df = numa_stat_bin.load_dataframe("numa_stat_log.bin")
+
+or, to convert on the command line:
+
+    python3 numa_stat_bin.py numa_stat_log.bin --csv numa_stat_log.csv
+"""
+
+from __future__ import annotations
+
+import argparse
+import struct
+import sys
+from pathlib import Path
+from typing import List, NamedTuple, Tuple
+
+MAGIC = b"NUMASTAT"
+TSDB_MAGIC = b"NUMATSDB"
+VERSION = 1
+FIXED_HEADER = struct.Struct("<8sIIIIII")
+CELL_DTYPES = ("<u8", "<i8", "<f8", "<u8")
+CELL_LABEL = 3
+
+
+class Schema(NamedTuple):
+    node_count: int
+    header_size: int
+    record_size: int
+    columns: List[Tuple[str, str]]
+    label_columns: List[str]
+
+
+def read_schema(path: Path) -> Schema:
+    with open(path, "rb") as fh:
+        fixed = fh.read(FIXED_HEADER.size)
+        if len(fixed) != FIXED_HEADER.size:
+            raise ValueError(f"{path}: not a numa_stat_logger binary log")
+        magic, version, header_size, node_count, ncols, record_size, _ = \
+            FIXED_HEADER.unpack(fixed)
+        if magic == TSDB_MAGIC:
+            raise ValueError(f"{path}: a tsdb log; convert it with numa_stat_dump first")
+        if magic != MAGIC:
+            raise ValueError(f"{path}: not a numa_stat_logger binary log")
+        if version != VERSION:
+            raise ValueError(f"{path}: unsupported binary log version {version}")
+        if record_size != 8 + 8 * ncols:
+            raise ValueError(f"{path}: corrupt header")
+
+        rest = fh.read(header_size - FIXED_HEADER.size)
+
+    columns: List[Tuple[str, str]] = []
+    label_columns: List[str] = []
+    pos = 0
+    for _ in range(ncols):
+        cell_type, name_len = rest[pos], rest[pos + 1]
+        name = rest[pos + 2:pos + 2 + name_len].decode("utf-8")
+        if cell_type >= len(CELL_DTYPES):
+            raise ValueError(f"{path}: column {name!r} has unsupported cell type {cell_type}")
+        columns.append((name, CELL_DTYPES[cell_type]))
+        if cell_type == CELL_LABEL:
+            label_columns.append(name)
+        pos += 2 + name_len
+
+    return Schema(node_count, header_size, record_size, columns, label_columns)
+
+
+def read_labels(path: Path) -> List[str]:
+    """Texts of the label columns (session mode), stored in <log>.labels."""
+    labels_path = Path(f"{path}.labels")
+    if not labels_path.is_file():
+        return []
+    return labels_path.read_text(encoding="utf-8").splitlines()
+
+
+def load_records(path: Path):
+    """Map the records as a numpy structured array (timestamp_ns + columns).
+
+    A truncated last record, e.g. after a crash, is ignored.
+    """
+    import numpy as np
+
+    path = Path(path)
+    schema = read_schema(path)
+    dtype = np.dtype([("timestamp_ns", "<i8")] + schema.columns)
+    count = (path.stat().st_size - schema.header_size) // schema.record_size
+    if count <= 0:
+        return np.zeros(0, dtype=dtype)
+    return np.memmap(path, dtype=dtype, mode="r",
+                     offset=schema.header_size, shape=(count,))
+
+
+def load_dataframe(path: Path):
+    """Load a binary log as a DataFrame with the same columns as the CSV log.
+
+    timestamp is float seconds like in the CSV; counter columns keep their
+    exact 64-bit integer values and label columns hold their text.
+    """
+    import pandas as pd
+
+    path = Path(path)
+    records = load_records(path)
+    schema = read_schema(path)
+    labels = read_labels(path)
+    names = [name for name in records.dtype.names if name != "timestamp_ns"]
+    df = pd.DataFrame({name: records[name] for name in names})
+    for name in schema.label_columns:
+        df[name] = [labels[i] if i < len(labels) else str(i) for i in df[name]]
+    df.insert(0, "timestamp", records["timestamp_ns"] / 1e9)
+    return df
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description="Inspect or convert a numa_stat_logger binary log."
+    )
+    parser.add_argument("log", type=Path, help="Binary log (--format bin).")
+    parser.add_argument(
+        "--csv",
+        type=Path,
+        help="Write the log as CSV to this path instead of listing its columns.",
+    )
+    return parser.parse_args()
+
+
+def main() -> int:
+    args = parse_args()
+    if args.csv is None:
+        schema = read_schema(args.log)
+        print(f"nodes {schema.node_count}")
+        for name, dtype in schema.columns:
+            kind = "label" if name in schema.label_columns else dtype
+            print(f"{kind} {name}")
+        return 0
+
+    load_dataframe(args.log).to_csv(args.csv, index=False, float_format="%.9f")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
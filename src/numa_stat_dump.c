@@ -0,0 +1,358 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "logfmt.h"
+#include "shm.h"
+#include "tsdb.h"
+
+enum dump_mode {
+    DUMP_ROWS,
+    DUMP_BLOCKS,
+    DUMP_SUMMARY,
+};
+
+// Convert a binary log written with --format bin or tsdb back to the
+// logger's CSV, streaming one record (or block) at a time.
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+        "Usage: %s [--schema | --blocks | --summary] [--columns <a,b,...>] <log|->\n"
+        "       %s [--schema] --shm <name> [--follow]\n"
+        "\n"
+        "Writes the log as CSV to stdout, or with --schema lists its columns.\n"
+        "- reads the log from stdin, e.g. zstd -dc numa_stat_log.bin.zst | %s -\n"
+        "\n"
+        "  --shm       read the rows still in a logger's --shm segment instead\n"
+        "  --follow    then keep printing new rows until the logger exits\n"
+        "\n"
+        "tsdb logs only, read from the block headers without decoding the rows:\n"
+        "  --blocks    one line per block: rows, time span and first/last/min/max\n"
+        "              of each column\n"
+        "  --summary   the same per run, i.e. per stretch of blocks with equal key\n"
+        "              columns (mem_policy and the run number in session logs)\n"
+        "  --columns   summarise only these columns\n",
+        prog, prog, prog);
+}
+
+static void print_ts(int64_t ts_ns)
+{
+    printf("%lld.%09lld", (long long)(ts_ns / 1000000000), (long long)(ts_ns % 1000000000));
+}
+
+// Mark the columns to summarise: those listed, or every non-key column.
+static int select_columns(const struct log_schema* ls, const char* list, unsigned char* sel)
+{
+    for (int i = 0; i < ls->ncols; i++)
+        sel[i] = !list && !ls->keys[i];
+    if (!list)
+        return 0;
+
+    char* copy = strdup(list);
+    if (!copy)
+        return -1;
+    int ret = 0;
+    for (char* name = strtok(copy, ","); name; name = strtok(NULL, ",")) {
+        int i = 0;
+        while (i < ls->ncols && strcmp(ls->names[i], name) != 0)
+            i++;
+        if (i == ls->ncols) {
+            fprintf(stderr, "No column '%s' in the log\n", name);
+            ret = -1;
+            break;
+        }
+        sel[i] = 1;
+    }
+    free(copy);
+    return ret;
+}
+
+static void summary_header(const struct log_schema* ls, const unsigned char* sel, const char* first)
+{
+    printf("%s,rows,ts_first,ts_last", first);
+    for (int i = 0; i < ls->ncols; i++)
+        if (ls->keys[i])
+            printf(",%s", ls->names[i]);
+    for (int i = 0; i < ls->ncols; i++)
+        if (sel[i])
+            printf(",%s_first,%s_last,%s_min,%s_max", ls->names[i], ls->names[i], ls->names[i], ls->names[i]);
+    printf("\n");
+}
+
+static void summary_row(const struct log_schema* ls, const unsigned char* sel, unsigned long long index,
+    unsigned long long rows, int64_t ts_first, int64_t ts_last, const struct tsdb_summary* sum)
+{
+    printf("%llu,%llu,", index, rows);
+    print_ts(ts_first);
+    putchar(',');
+    print_ts(ts_last);
+    for (int i = 0; i < ls->ncols; i++) {
+        if (ls->keys[i]) {
+            putchar(',');
+            csv_write_cell(stdout, ls, i, sum[i].first);
+        }
+    }
+    for (int i = 0; i < ls->ncols; i++) {
+        if (!sel[i])
+            continue;
+        const union cell v[] = { sum[i].first, sum[i].last, sum[i].min, sum[i].max };
+        for (int k = 0; k < 4; k++) {
+            putchar(',');
+            csv_write_cell(stdout, ls, i, v[k]);
+        }
+    }
+    printf("\n");
+}
+
+static int same_keys(const struct log_schema* ls, const struct tsdb_summary* a, const struct tsdb_summary* b)
+{
+    for (int i = 0; i < ls->ncols; i++)
+        if (ls->keys[i] && a[i].first.u != b[i].first.u)
+            return 0;
+    return 1;
+}
+
+static int dump_bin(FILE* fp, const struct log_schema* ls, const char* path)
+{
+    size_t record_size = bin_record_size(ls);
+    unsigned char* record = malloc(record_size);
+    union cell* cells = calloc(ls->ncols ? ls->ncols : 1, sizeof(union cell));
+    if (!record || !cells) {
+        fprintf(stderr, "Failed to allocate record buffer\n");
+        free(record);
+        free(cells);
+        return -1;
+    }
+
+    csv_write_header(stdout, ls);
+
+    size_t n;
+    int64_t ts_ns;
+    while ((n = fread(record, 1, record_size, fp)) == record_size) {
+        bin_decode_record(ls, record, &ts_ns, cells);
+        csv_write_row(stdout, ls, ts_ns, cells);
+    }
+    if (n != 0)
+        fprintf(stderr, "%s: ignoring truncated last record (%zu of %zu bytes)\n", path, n, record_size);
+
+    free(record);
+    free(cells);
+    return 0;
+}
+
+static int dump_tsdb(FILE* fp, const struct log_schema* ls, enum dump_mode mode, const unsigned char* sel)
+{
+    struct tsdb_block b = { 0 };
+    union cell* ts = NULL;
+    union cell* rows = NULL;
+    uint32_t cap = 0;
+
+    // --summary: the run being merged.
+    struct tsdb_summary* run = calloc(ls->ncols ? ls->ncols : 1, sizeof(*run));
+    unsigned long long nblocks = 0, nruns = 0, run_rows = 0;
+    int64_t run_first = 0, run_last = 0;
+    if (!run) {
+        fprintf(stderr, "Failed to allocate summary buffer\n");
+        return -1;
+    }
+
+    if (mode == DUMP_ROWS)
+        csv_write_header(stdout, ls);
+    else
+        summary_header(ls, sel, mode == DUMP_BLOCKS ? "block" : "run");
+
+    int ret;
+    while ((ret = tsdb_read_block(fp, ls, &b, mode == DUMP_ROWS)) == 1) {
+        if (mode == DUMP_BLOCKS) {
+            summary_row(ls, sel, nblocks++, b.nrows, b.ts_first, b.ts_last, b.sum);
+            continue;
+        }
+        if (mode == DUMP_SUMMARY) {
+            if (run_rows && same_keys(ls, run, b.sum)) {
+                tsdb_summary_merge(ls, run, b.sum);
+                run_rows += b.nrows;
+                run_last = b.ts_last;
+                continue;
+            }
+            if (run_rows)
+                summary_row(ls, sel, nruns++, run_rows, run_first, run_last, run);
+            memcpy(run, b.sum, sizeof(*run) * ls->ncols);
+            run_rows = b.nrows;
+            run_first = b.ts_first;
+            run_last = b.ts_last;
+            continue;
+        }
+
+        if (b.nrows > cap) {
+            free(ts);
+            free(rows);
+            cap = b.nrows;
+            ts = malloc(sizeof(*ts) * cap);
+            rows = malloc(sizeof(*rows) * cap * (ls->ncols ? ls->ncols : 1));
+            if (!ts || !rows) {
+                fprintf(stderr, "Failed to allocate block buffer\n");
+                ret = -1;
+                break;
+            }
+        }
+        if ((ret = tsdb_decode(ls, &b, ts, rows)) != 0)
+            break;
+        for (uint32_t k = 0; k < b.nrows; k++)
+            csv_write_row(stdout, ls, ts[k].i, rows + (size_t)k * ls->ncols);
+    }
+    if (ret == 0 && mode == DUMP_SUMMARY && run_rows)
+        summary_row(ls, sel, nruns, run_rows, run_first, run_last, run);
+
+    free(run);
+    free(ts);
+    free(rows);
+    tsdb_block_free(&b);
+    return ret;
+}
+
+static void print_schema(const struct log_schema* ls)
+{
+    static const char* type_names[] = { "u64", "i64", "f64", "label" };
+    printf("nodes %d\n", ls->node_count);
+    for (int i = 0; i < ls->ncols; i++)
+        printf("%s %s%s\n", ls->types[i] <= CELL_LABEL ? type_names[ls->types[i]] : "?", ls->names[i],
+            ls->keys[i] ? " key" : "");
+}
+
+// Rows of a live segment, oldest first. Rows the logger overwrites before
+// they are copied are skipped.
+static int dump_shm(const struct shm_reader* r, struct log_schema* ls, int follow)
+{
+    union cell* cells = calloc(ls->ncols ? ls->ncols : 1, sizeof(union cell));
+    if (!cells) {
+        fprintf(stderr, "Failed to allocate record buffer\n");
+        return -1;
+    }
+
+    csv_write_header(stdout, ls);
+    uint64_t published = shm_reader_published(r);
+    uint64_t n = published > r->h->nslots ? published - r->h->nslots : 0;
+    for (;;) {
+        for (; n < published; n++) {
+            int64_t ts_ns;
+            if (published - n > r->h->nslots)
+                n = published - r->h->nslots;
+            if (!shm_reader_read(r, n, &ts_ns, cells))
+                continue;
+            shm_reader_labels(r, ls);
+            csv_write_row(stdout, ls, ts_ns, cells);
+        }
+        if (!follow)
+            break;
+
+        fflush(stdout);
+        const struct timespec poll = { .tv_nsec = 1000000 };
+        nanosleep(&poll, NULL);
+        published = shm_reader_published(r);
+        if (n == published && kill(r->h->pid, 0) != 0)
+            break;
+    }
+
+    free(cells);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    int schema_only = 0;
+    enum dump_mode mode = DUMP_ROWS;
+    const char* columns = NULL;
+    const char* path = NULL;
+    const char* shm_name = NULL;
+    int follow = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc)
+            shm_name = argv[++i];
+        else if (strcmp(argv[i], "--follow") == 0)
+            follow = 1;
+        else if (strcmp(argv[i], "--schema") == 0)
+            schema_only = 1;
+        else if (strcmp(argv[i], "--blocks") == 0)
+            mode = DUMP_BLOCKS;
+        else if (strcmp(argv[i], "--summary") == 0)
+            mode = DUMP_SUMMARY;
+        else if (strcmp(argv[i], "--columns") == 0 && i + 1 < argc)
+            columns = argv[++i];
+        else if (!path && (argv[i][0] != '-' || strcmp(argv[i], "-") == 0))
+            path = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (shm_name && !path && mode == DUMP_ROWS && !columns) {
+        struct shm_reader r;
+        struct log_schema ls;
+        if (shm_reader_open(&r, shm_name, &ls) != 0)
+            return 1;
+        int ret = 0;
+        if (schema_only)
+            print_schema(&ls);
+        else
+            ret = dump_shm(&r, &ls, follow);
+        log_schema_free(&ls);
+        shm_reader_close(&r);
+        return ret == 0 ? 0 : 1;
+    }
+    if (!path || shm_name || follow) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int from_stdin = strcmp(path, "-") == 0;
+    FILE* fp = from_stdin ? stdin : fopen(path, "rb");
+    if (!fp) { perror(path); return 1; }
+
+    struct log_schema ls;
+    char magic[8];
+    if (log_read_header(fp, &ls, magic) != 0) {
+        fclose(fp);
+        return 1;
+    }
+    int tsdb = memcmp(magic, TSDB_MAGIC, 8) == 0;
+    if (mode != DUMP_ROWS && !tsdb) {
+        fprintf(stderr, "--blocks and --summary need a tsdb log\n");
+        log_schema_free(&ls);
+        fclose(fp);
+        return 1;
+    }
+
+    // Session logs keep the text of their label columns next to the log.
+    char labels_path[4096];
+    snprintf(labels_path, sizeof(labels_path), "%s.labels", path);
+    if (!from_stdin && log_labels_load(&ls, labels_path) != 0) {
+        log_schema_free(&ls);
+        fclose(fp);
+        return 1;
+    }
+
+    if (schema_only) {
+        print_schema(&ls);
+        log_schema_free(&ls);
+        fclose(fp);
+        return 0;
+    }
+
+    unsigned char* sel = calloc(ls.ncols ? ls.ncols : 1, 1);
+    if (!sel || select_columns(&ls, columns, sel) != 0) {
+        free(sel);
+        log_schema_free(&ls);
+        fclose(fp);
+        return 1;
+    }
+
+    setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+    int ret = tsdb ? dump_tsdb(fp, &ls, mode, sel) : dump_bin(fp, &ls, path);
+
+    free(sel);
+    log_schema_free(&ls);
+    fclose(fp);
+    return ret == 0 ? 0 : 1;
+}
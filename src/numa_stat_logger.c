@@ -1,253 +1,1090 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h> 
 
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <sys/types.h> 
-#include <sys/wait.h>
 
-struct node_meminfo {
-    unsigned mem_total;
-    unsigned mem_used;
+#include "cgroup.h"
+#include "child.h"
+#include "compress.h"
+#include "collector.h"
+#include "counters.h"
+#include "derive.h"
+#include "feature_window.h"
+#include "hugepages.h"
+#include "logfmt.h"
+#include "node_sampler.h"
+#include "mbm.h"
+#include "migtrace.h"
+#include "nodes.h"
+#include "output.h"
+#include "perf.h"
+#include "placement.h"
+#include "policy.h"
+#include "profile.h"
+#include "proc_numa.h"
+#include "replay.h"
+#include "sampler.h"
+#include "serve.h"
+#include "session.h"
+#include "shm.h"
+#include "ticker.h"
+#include "writer.h"
+
+// Name and type every output column once, for whichever format is used.
+static int build_schema(struct log_schema* ls, const struct sampler* s, const struct derive* d)
+{
+    if (log_schema_init(ls, s->numa_count, d->ncols) != 0)
+        return -1;
+
+    char name[LOG_NAME_MAX];
+    enum cell_type type;
+    const char* suffix;
+    for (int i = 0; i < d->ncols; i++) {
+        sampler_column_name(s, derive_column(d, i, &type, &suffix), name, sizeof(name));
+        snprintf(ls->names[i], LOG_NAME_MAX, "%.100s%s", name, suffix);
+        ls->types[i] = type;
+    }
+    return 0;
+}
+
+enum {
+    EV_TICK,
+    EV_CHILD,
+    EV_LISTEN,
+    EV_CONTROL,
+    EV_SIGNAL,
+    EV_SERVE_LISTEN,
+    EV_SERVE_CLIENT,    // + client slot, so this stays last
 };
 
-struct node_vmstat {
-    unsigned nr_free_pages;
-    unsigned numa_hit;
-    unsigned numa_miss;
-    unsigned numa_foreign;
-    unsigned numa_interleave;
-    unsigned numa_local;
-    unsigned numa_other;
+#define MAX_COLLECTORS 8
+
+// A <tier>_age_ns column: how old the values of a source (src >= 0) or a
+// collector are in a row, for everything not read on every tick.
+struct age_column {
+    int src;
+    int collector;
+    int64_t read_ns;
 };
 
-struct sys_vmstat {
-    unsigned numa_pte_updates;
-    unsigned numa_huge_pte_updates;
-    unsigned numa_pages_migrated;
-    unsigned pgmigrate_success;
-    unsigned pgmigrate_fail;
-    unsigned thp_migration_success;
-    unsigned thp_migration_fail;
-    unsigned thp_migration_split;
+// Command-line settings that shape the logger, filled in by main().
+struct options {
+    const char* node_list;
+    int numa_count;
+    int node_threads;
+    const char* counters_spec;
+    unsigned emit;
+    double interval_sec;
+    const char* source_intervals;
+    int log_jitter;
+    enum ring_overflow overflow;
+
+    // Optional collectors, each sampled at its own rate.
+    int proc;
+    pid_t proc_pid;
+    double proc_interval;
+    int hugepages;
+    double hugepages_interval;
+    const char* cgroup_path;
+    double cgroup_interval;
+    const char* perf_events[PERF_MAX_EVENTS];
+    int nperf;
+    int migrate_trace;
+    int mbm;
+    const char* mbm_group;
+    double mbm_interval;
+
+    int profile;
+    int profile_columns;
+
+    int features;
+    uint32_t feature_window;
+
+    const char* policy_spec;
+    double policy_interval;
+    long policy_syscall;
+
+    int session;
+    const char* control_path;
+    int control_keep;
+    const char* run_column;
+
+    const char* shm_name;
+    uint32_t shm_slots;
+    const char* serve_addr;
+
+    const char* replay_path;
+    double replay_speed;
+
+    struct placement logger_place;
+    struct placement child_place;
 };
 
-static void parse_node_meminfo(struct node_meminfo* nm,
-    const char* path,
-    int nodeID)
+// Everything a sample touches, set up once before the loop starts.
+struct logger {
+    struct node_set nodes;
+    struct counter_set cs;
+    struct sampler sampler;
+    struct node_pool pool;
+    struct derive derive;
+    struct log_schema schema;
+    struct record* record;
+    struct output out;
+    struct writer writer;
+    int use_writer;
+    int jitter_col;
+    int missed_col;
+    int dropped_col;
+    struct collector collectors[MAX_COLLECTORS];
+    int ncollectors;
+    struct collector* proc;
+    struct collector* cgroup;
+    struct collector* mbm;
+    uint64_t nsamples;
+
+    struct age_column ages[SRC_COUNT + MAX_COLLECTORS];
+    int nages;
+    int age_col;
+
+    struct feature_set features;
+    int use_features;
+    int feature_col;
+
+    struct session session;
+    int use_session;
+
+    struct policy policy;
+    int use_policy;
+
+    struct shm_export shm;
+    int use_shm;
+
+    struct serve serve;
+    int use_serve;
+
+    struct replay replay;
+    int use_replay;
+
+    struct profile prof;
+    int prof_report;
+    int prof_col;
+    uint64_t last_write_ns;
+};
+
+// Columns added by --profile-columns, starting at prof_col.
+static const char* const prof_columns[] = {
+    "prof_read_ns",
+    "prof_parse_ns",
+    "prof_collect_ns",
+    "prof_format_ns",
+    "prof_write_ns",
+    "prof_cpu_ns",
+    "prof_maxrss_kb",
+};
+
+static int logger_setup(struct logger* lg, const struct options* opt)
 {
-    FILE* fp = fopen(path, "r");
-    if (!fp) return;
+    memset(lg, 0, sizeof(*lg));
+    counter_set_init(&lg->cs);
+    lg->jitter_col = -1;
+    lg->missed_col = -1;
+    lg->dropped_col = -1;
+    lg->prof_col = -1;
+    lg->feature_col = -1;
+    lg->age_col = -1;
 
-    char line[256];
-    char memtotal_key[32], memfree_key[32];
-    snprintf(memtotal_key, sizeof(memtotal_key), "Node %d MemTotal:", nodeID);
-    snprintf(memfree_key, sizeof(memfree_key), "Node %d MemFree:", nodeID);
+    if (opt->replay_path) {
+        lg->use_replay = 1;
+        if (replay_open(&lg->replay, opt->replay_path, opt->run_column) != 0)
+            return -1;
+    }
 
-    int found_total = 0, found_free = 0;
+    // --- Build the node table once; columns use the real node IDs ---
+    if (opt->node_list ? node_set_parse(&lg->nodes, opt->node_list) :
+        lg->use_replay ? replay_nodes(&lg->replay, &lg->nodes) : node_set_discover(&lg->nodes))
+        return -1;
+    if (!opt->node_list && opt->numa_count && node_set_truncate(&lg->nodes, opt->numa_count) != 0)
+        return -1;
 
-    while (fgets(line, sizeof(line), fp)) {
-        unsigned val;
+    if (opt->counters_spec ? counter_set_parse(&lg->cs, opt->counters_spec) : counter_set_add_defaults(&lg->cs))
+        return -1;
 
-        if (!found_total && strstr(line, memtotal_key)) {
-            if (sscanf(line + strlen(memtotal_key), "%u", &val) == 1) {
-                nm->mem_total = val;
-                found_total = 1;
-            }
-        }
-        else if (!found_free && strstr(line, memfree_key)) {
-            if (sscanf(line + strlen(memfree_key), "%u", &val) == 1) {
-                nm->mem_used = nm->mem_total - val;
-                found_free = 1;
-            }
+    // --- Open every stat file once; samples re-read them with pread() ---
+    // A replay only needs the layout, its values come from the log.
+    if (lg->use_replay) {
+        sampler_layout(&lg->sampler, &lg->cs, &lg->nodes);
+        if (replay_map(&lg->replay, &lg->sampler) != 0)
+            return -1;
+    }
+    else if (sampler_init(&lg->sampler, &lg->cs, &lg->nodes) != 0) {
+        return -1;
+    }
+    if (opt->source_intervals &&
+        sampler_set_periods(&lg->sampler, opt->source_intervals, opt->interval_sec) != 0)
+        return -1;
+    if (opt->node_threads && node_pool_start(&lg->pool, &lg->sampler) != 0)
+        return -1;
+
+    if (derive_init(&lg->derive, lg->sampler.nvalues, opt->emit) != 0 ||
+        build_schema(&lg->schema, &lg->sampler, &lg->derive) != 0) {
+        fprintf(stderr, "Failed to allocate memory for NUMA arrays\n");
+        return -1;
+    }
+
+    if (opt->log_jitter) {
+        lg->jitter_col = log_schema_add(&lg->schema, "sched_jitter_ns", CELL_I64);
+        lg->missed_col = log_schema_add(&lg->schema, "sched_missed_ticks", CELL_U64);
+        if (lg->jitter_col < 0 || lg->missed_col < 0) {
+            fprintf(stderr, "Failed to allocate memory for NUMA arrays\n");
+            return -1;
         }
+    }
 
-        if (found_total && found_free)
-            break;
+    if (opt->overflow == RING_DROP) {
+        lg->dropped_col = log_schema_add(&lg->schema, "dropped_samples", CELL_U64);
+        if (lg->dropped_col < 0) {
+            fprintf(stderr, "Failed to allocate memory for NUMA arrays\n");
+            return -1;
+        }
     }
 
-    fclose(fp);
-}
+    if (opt->profile || opt->profile_columns)
+        profile_init(&lg->prof);
+    lg->prof_report = opt->profile;
+    if (opt->profile_columns) {
+        for (size_t i = 0; i < sizeof(prof_columns) / sizeof(prof_columns[0]); i++) {
+            int col = log_schema_add(&lg->schema, prof_columns[i], CELL_U64);
+            if (col < 0) {
+                fprintf(stderr, "Failed to allocate memory for NUMA arrays\n");
+                return -1;
+            }
+            if (i == 0)
+                lg->prof_col = col;
+        }
+    }
 
-static void parse_node_vmstat(struct node_vmstat* nv,
-    const char* path)
-{
-    FILE* fp = fopen(path, "r");
-    if (!fp) return;
+    if (opt->proc) {
+        lg->proc = &lg->collectors[lg->ncollectors++];
+        if (proc_numa_create(lg->proc, &lg->schema, opt->proc_pid, &lg->nodes,
+                collector_period_ticks(opt->proc_interval, opt->interval_sec)) != 0) {
+            fprintf(stderr, "Failed to set up the per-process collector\n");
+            return -1;
+        }
+    }
 
-    char key[128];
-    unsigned val;
-    int found_count = 0;
+    if (opt->hugepages) {
+        if (hugepages_create(&lg->collectors[lg->ncollectors++], &lg->schema, &lg->nodes,
+                collector_period_ticks(opt->hugepages_interval, opt->interval_sec)) != 0) {
+            fprintf(stderr, "Failed to set up the huge page collector\n");
+            return -1;
+        }
+    }
 
-    int f_nr_free_pages = 0;
-    int f_numa_hit = 0;
-    int f_numa_miss = 0;
-    int f_numa_foreign = 0;
-    int f_numa_interleave = 0;
-    int f_numa_local = 0;
-    int f_numa_other = 0;
+    if (opt->cgroup_path) {
+        lg->cgroup = &lg->collectors[lg->ncollectors++];
+        if (cgroup_create(lg->cgroup, &lg->schema, opt->cgroup_path, &lg->nodes,
+                collector_period_ticks(opt->cgroup_interval, opt->interval_sec)) != 0) {
+            fprintf(stderr, "Failed to set up the cgroup collector\n");
+            return -1;
+        }
+        if (opt->proc_pid)
+            cgroup_attach(lg->cgroup, opt->proc_pid);
+    }
 
-    const int TOTAL_FIELDS = 7;
+    if (opt->nperf) {
+        if (perf_create(&lg->collectors[lg->ncollectors++], &lg->schema, opt->perf_events, opt->nperf,
+                &lg->nodes) != 0) {
+            fprintf(stderr, "Failed to set up the perf_event counters\n");
+            return -1;
+        }
+    }
 
-    while (fscanf(fp, "%127s %u", key, &val) == 2) {
+    if (opt->mbm) {
+        lg->mbm = &lg->collectors[lg->ncollectors++];
+        if (mbm_create(lg->mbm, &lg->schema, opt->mbm_group, &lg->nodes,
+                collector_period_ticks(opt->mbm_interval, opt->interval_sec)) != 0) {
+            fprintf(stderr, "Failed to set up memory bandwidth monitoring\n");
+            return -1;
+        }
+        if (opt->proc_pid)
+            mbm_attach(lg->mbm, opt->proc_pid);
+    }
 
-        if (!f_nr_free_pages && strcmp(key, "nr_free_pages") == 0) {
-            nv->nr_free_pages = val;
-            f_nr_free_pages = 1;
-            found_count++;
+    if (opt->migrate_trace) {
+        if (migtrace_create(&lg->collectors[lg->ncollectors++], &lg->schema, &lg->nodes) != 0) {
+            fprintf(stderr, "Failed to set up the migration tracer\n");
+            return -1;
         }
-        else if (!f_numa_hit && strcmp(key, "numa_hit") == 0) {
-            nv->numa_hit = val;
-            f_numa_hit = 1;
-            found_count++;
+    }
+
+    // --- Age columns, only in logs that asked for tiers (--source-interval):
+    // every tiered source, and every collector slower than the tick ---
+    for (int i = -SRC_COUNT; opt->source_intervals && i < lg->ncollectors; i++) {
+        char name[LOG_NAME_MAX];
+        if (i < 0) {
+            int src = i + SRC_COUNT;
+            if (!lg->cs.count[src] || lg->sampler.period[src] <= 1)
+                continue;
+            snprintf(name, sizeof(name), "%s_age_ns", counter_source_name(src));
+            lg->ages[lg->nages] = (struct age_column){ .src = src, .collector = -1 };
         }
-        else if (!f_numa_miss && strcmp(key, "numa_miss") == 0) {
-            nv->numa_miss = val;
-            f_numa_miss = 1;
-            found_count++;
+        else {
+            if (lg->collectors[i].period <= 1)
+                continue;
+            snprintf(name, sizeof(name), "%s_age_ns", lg->collectors[i].name);
+            lg->ages[lg->nages] = (struct age_column){ .src = -1, .collector = i };
         }
-        else if (!f_numa_foreign && strcmp(key, "numa_foreign") == 0) {
-            nv->numa_foreign = val;
-            f_numa_foreign = 1;
-            found_count++;
+        int col = log_schema_add(&lg->schema, name, CELL_U64);
+        if (col < 0) {
+            fprintf(stderr, "Failed to allocate the %s column\n", name);
+            return -1;
         }
-        else if (!f_numa_interleave && strcmp(key, "numa_interleave") == 0) {
-            nv->numa_interleave = val;
-            f_numa_interleave = 1;
-            found_count++;
+        if (lg->nages++ == 0)
+            lg->age_col = col;
+    }
+
+    if (opt->features) {
+        lg->use_features = 1;
+        if (features_init(&lg->features, &lg->sampler, opt->feature_window) != 0 ||
+            (lg->feature_col = features_add_columns(&lg->features, &lg->schema)) < 0) {
+            fprintf(stderr, "Failed to set up the feature windows\n");
+            return -1;
         }
-        else if (!f_numa_local && strcmp(key, "numa_local") == 0) {
-            nv->numa_local = val;
-            f_numa_local = 1;
-            found_count++;
+    }
+
+    if (opt->session) {
+        lg->use_session = 1;
+        if (session_open(&lg->session, opt->control_path) != 0)
+            return -1;
+        lg->session.keep = opt->control_keep;
+        if (session_add_columns(&lg->session, &lg->schema, opt->run_column) != 0) {
+            fprintf(stderr, "Failed to allocate memory for NUMA arrays\n");
+            return -1;
         }
-        else if (!f_numa_other && strcmp(key, "numa_other") == 0) {
-            nv->numa_other = val;
-            f_numa_other = 1;
-            found_count++;
+    }
+    else if (lg->use_replay && lg->replay.run_col >= 0) {
+        // Recorded runs are replayed as runs: rows keep their run number
+        // and label, and feature windows restart with every run.
+        lg->use_session = 1;
+        lg->session.listen_fd = -1;
+        lg->session.fd = -1;
+        lg->session.out_fd = -1;
+        if (session_add_columns(&lg->session, &lg->schema, opt->run_column) != 0) {
+            fprintf(stderr, "Failed to allocate memory for NUMA arrays\n");
+            return -1;
         }
+    }
 
-        if (found_count == TOTAL_FIELDS)
-            break;
+    // Last, so a policy plugin sees every other column.
+    if (opt->policy_spec) {
+        lg->use_policy = 1;
+        if (policy_setup(&lg->policy, opt->policy_spec, &lg->schema, &lg->nodes,
+                collector_period_ticks(opt->policy_interval, opt->interval_sec),
+                opt->policy_syscall) != 0)
+            return -1;
+        // Replayed rows belong to no live process: decisions are only logged.
+        lg->policy.dry_run = lg->use_replay;
+        if (lg->use_features)
+            policy_use_features(&lg->policy, &lg->features);
+        if (policy_start(&lg->policy, &lg->schema) != 0)
+            return -1;
+        if (opt->proc_pid)
+            policy_attach(&lg->policy, opt->proc_pid);
     }
 
-    fclose(fp);
+    lg->record = calloc(1, sizeof(struct record) + sizeof(union cell) * lg->schema.ncols);
+    if (!lg->record) {
+        fprintf(stderr, "Failed to allocate memory for NUMA arrays\n");
+        return -1;
+    }
+
+    if (opt->shm_name) {
+        if (shm_export_open(&lg->shm, opt->shm_name, &lg->schema, opt->shm_slots) != 0)
+            return -1;
+        lg->use_shm = 1;
+    }
+    if (opt->serve_addr) {
+        // Absolute event counters are served as counters, everything else
+        // (deltas and rates included) as gauges.
+        unsigned char* counters = calloc(lg->schema.ncols ? lg->schema.ncols : 1, 1);
+        if (!counters) {
+            fprintf(stderr, "Failed to allocate the metrics buffer\n");
+            return -1;
+        }
+        for (int i = 0; i < lg->derive.ncols; i++) {
+            enum cell_type type;
+            const char* suffix;
+            int value = derive_column(&lg->derive, i, &type, &suffix);
+            counters[i] = !*suffix && sampler_column_monotonic(&lg->sampler, value);
+        }
+        lg->use_serve = 1;
+        int ret = serve_open(&lg->serve, opt->serve_addr, &lg->schema, counters);
+        free(counters);
+        if (ret != 0)
+            return -1;
+    }
+    return 0;
 }
 
-static void parse_sys_vmstat(struct sys_vmstat* sv,
-    const char* path)
+// Write time so far: the writer thread's batches, or our own output_write()
+// calls when there is no writer.
+static uint64_t logger_write_ns(struct logger* lg)
 {
-    FILE* fp = fopen(path, "r");
-    if (!fp) return;
+    if (lg->use_writer)
+        return atomic_load_explicit(&lg->writer.write_ns, memory_order_relaxed);
+    return lg->prof.phase[PROF_WRITE].total_ns;
+}
 
-    char key[128];
-    unsigned val;
-    int found_count = 0;
+// final is the sample taken when the -r command exits; the collectors are
+// not refreshed for it, as the processes they look at are gone.
+static void take_sample(struct logger* lg, int64_t jitter_ns, uint64_t missed, int final)
+{
+    int prof = lg->prof.enabled;
+    uint64_t tick = lg->nsamples++;
+    struct sampler_times st = { 0 };
+    uint64_t* raw = derive_values(&lg->derive);
 
-    int f_numa_pte_updates = 0;
-    int f_numa_huge_pte_updates = 0;
-    int f_numa_pages_migrated = 0;
-    int f_pgmigrate_success = 0;
-    int f_pgmigrate_fail = 0;
-    int f_thp_migration_success = 0;
-    int f_thp_migration_fail = 0;
-    int f_thp_migration_split = 0;
+    // --- Parse the sources due on this tick; the closing row reads all ---
+    sampler_schedule(&lg->sampler, tick, final);
+    if (lg->use_replay)
+        replay_values(&lg->replay, raw);
+    else if (lg->pool.running)
+        node_pool_sample(&lg->pool, raw, prof ? &st : NULL);
+    else
+        sampler_sample(&lg->sampler, raw, prof ? &st : NULL);
 
-    const int TOTAL_FIELDS = 8;
+    // --- Build the row, in place in the output ring if there is one ---
+    struct record* rec = lg->use_writer ? writer_reserve(&lg->writer) : lg->record;
+    uint64_t t1 = prof ? prof_now_ns() : 0;
+    unsigned refreshed = 0;
+    for (int i = 0; i < lg->ncollectors; i++) {
+        if (final)
+            collector_fill(&lg->collectors[i], rec->cells);
+        else if (collector_run(&lg->collectors[i], tick, rec->cells))
+            refreshed |= 1u << i;
+    }
+    uint64_t t2 = prof ? prof_now_ns() : 0;
 
-    while (fscanf(fp, "%127s %u", key, &val) == 2) {
+    // A replayed row keeps its recorded time, and rates use its spacing.
+    double now;
+    if (lg->use_replay) {
+        rec->ts_ns = lg->replay.ts_ns;
+        now = (lg->replay.ts_ns - lg->replay.first_ts_ns) * 1e-9;
+    }
+    else {
+        struct timespec ts, mono;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+        rec->ts_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+        now = mono.tv_sec + mono.tv_nsec * 1e-9;
+    }
+    derive_row(&lg->derive, now, lg->sampler.fresh, rec->cells);
+    for (int i = 0; i < lg->nages; i++) {
+        struct age_column* a = &lg->ages[i];
+        if (a->src >= 0 ? lg->sampler.due[a->src] : (refreshed >> a->collector) & 1)
+            a->read_ns = rec->ts_ns;
+        rec->cells[lg->age_col + i].u = (uint64_t)(rec->ts_ns - a->read_ns);
+    }
+    if (lg->jitter_col >= 0) {
+        rec->cells[lg->jitter_col].i = jitter_ns;
+        rec->cells[lg->missed_col].u = missed;
+    }
+    if (lg->dropped_col >= 0)
+        rec->cells[lg->dropped_col].u = writer_dropped(&lg->writer);
 
-        if (!f_numa_pte_updates && strcmp(key, "numa_pte_updates") == 0) {
-            sv->numa_pte_updates = val;
-            f_numa_pte_updates = 1;
-            found_count++;
-        }
-        else if (!f_numa_huge_pte_updates && strcmp(key, "numa_huge_pte_updates") == 0) {
-            sv->numa_huge_pte_updates = val;
-            f_numa_huge_pte_updates = 1;
-            found_count++;
-        }
-        else if (!f_numa_pages_migrated && strcmp(key, "numa_pages_migrated") == 0) {
-            sv->numa_pages_migrated = val;
-            f_numa_pages_migrated = 1;
-            found_count++;
-        }
-        else if (!f_pgmigrate_success && strcmp(key, "pgmigrate_success") == 0) {
-            sv->pgmigrate_success = val;
-            f_pgmigrate_success = 1; found_count++;
-        }
-        else if (!f_pgmigrate_fail && strcmp(key, "pgmigrate_fail") == 0) {
-            sv->pgmigrate_fail = val;
-            f_pgmigrate_fail = 1;
-            found_count++;
-        }
-        else if (!f_thp_migration_success && strcmp(key, "thp_migration_success") == 0) {
-            sv->thp_migration_success = val;
-            f_thp_migration_success = 1;
-            found_count++;
-        }
-        else if (!f_thp_migration_fail && strcmp(key, "thp_migration_fail") == 0) {
-            sv->thp_migration_fail = val;
-            f_thp_migration_fail = 1;
-            found_count++;
-        }
-        else if (!f_thp_migration_split && strcmp(key, "thp_migration_split") == 0) {
-            sv->thp_migration_split = val;
-            f_thp_migration_split = 1;
-            found_count++;
+    if (lg->use_session) {
+        session_fill(&lg->session, rec->cells);
+        lg->session.rows++;
+    }
+
+    // --- Rolling-window features, from the raw counters ---
+    if (lg->use_features) {
+        features_update(&lg->features, rec->ts_ns, raw);
+        features_fill(&lg->features, &rec->cells[lg->feature_col]);
+    }
+
+    // --- Closed-loop policy decision on this very row ---
+    if (lg->use_policy) {
+        if (final)
+            policy_skip(&lg->policy, rec);
+        else
+            policy_run(&lg->policy, tick, rec);
+    }
+
+    if (prof) {
+        uint64_t t3 = prof_now_ns();
+        profile_add(&lg->prof, PROF_READ, st.read_ns);
+        profile_add(&lg->prof, PROF_PARSE, st.parse_ns);
+        profile_add(&lg->prof, PROF_COLLECT, t2 - t1);
+        profile_add(&lg->prof, PROF_FORMAT, t3 - t2);
+        profile_add(&lg->prof, PROF_SLEEP, jitter_ns > 0 ? (uint64_t)jitter_ns : 0);
+        lg->prof.samples++;
+
+        if (lg->prof_col >= 0) {
+            // prof_write_ns is the write time since the previous row, as
+            // rows are written some time after they are built.
+            union cell* c = &rec->cells[lg->prof_col];
+            uint64_t write_ns = logger_write_ns(lg);
+            c[0].u = st.read_ns;
+            c[1].u = st.parse_ns;
+            c[2].u = t2 - t1;
+            c[3].u = t3 - t2;
+            c[4].u = write_ns - lg->last_write_ns;
+            profile_rusage(&c[5].u, &c[6].u);
+            lg->last_write_ns = write_ns;
         }
+    }
 
-        if (found_count == TOTAL_FIELDS)
-            break;
+    // --- Publish to shared memory and the metrics endpoint, then write ---
+    if (lg->use_shm)
+        shm_export_publish(&lg->shm, &lg->schema, rec);
+    if (lg->use_serve)
+        serve_update(&lg->serve, rec);
+
+    if (lg->use_writer) {
+        writer_commit(&lg->writer, rec);
+    }
+    else {
+        uint64_t t4 = prof ? prof_now_ns() : 0;
+        output_write(&lg->out, rec);
+        if (prof)
+            profile_add(&lg->prof, PROF_WRITE, prof_now_ns() - t4);
     }
+}
 
+// Take the row of the replayed log that is due. A new run number starts a
+// run as the session's start command does; returns -1 if its label cannot
+// be recorded.
+static int replay_sample(struct logger* lg, int64_t jitter_ns)
+{
+    struct replay* r = &lg->replay;
+    struct session* ss = &lg->session;
 
-    fclose(fp);
+    if (lg->use_session) {
+        int label = log_schema_label(&lg->schema, r->label ? r->label : "");
+        if (label < 0)
+            return -1;
+        if (!ss->active || r->run != ss->run) {
+            ss->run = r->run;
+            ss->rows = 0;
+            ss->active = 1;
+            lg->nsamples = 0;
+            if (lg->use_features)
+                features_reset(&lg->features);
+        }
+        ss->label = (uint64_t)label;
+    }
+    take_sample(lg, jitter_ns, 0, 0);
+    return 0;
 }
 
-void write_csv_header(const char* filename, int numa_count) {
-    FILE* fp = fopen(filename, "r");
-    if (fp) {
-        fclose(fp);
-        return;
+static void logger_teardown(struct logger* lg)
+{
+    if (lg->use_writer) {
+        writer_stop(&lg->writer);
+        lg->prof.phase[PROF_WRITE].total_ns = lg->writer.write_ns;
+        lg->prof.phase[PROF_WRITE].max_ns = lg->writer.write_max_ns;
     }
+    if (lg->prof_report && lg->prof.samples)
+        profile_report(&lg->prof, stderr);
+    output_close(&lg->out);
+    if (lg->use_shm)
+        shm_export_close(&lg->shm);
+    if (lg->use_serve)
+        serve_close(&lg->serve);
+    for (int i = 0; i < lg->ncollectors; i++)
+        collector_free(&lg->collectors[i]);
+    if (lg->use_policy)
+        policy_free(&lg->policy);
+    if (lg->use_session)
+        session_close(&lg->session);
+    if (lg->use_features)
+        features_free(&lg->features);
+    if (lg->use_replay)
+        replay_close(&lg->replay);
+    free(lg->record);
+    log_schema_free(&lg->schema);
+    derive_free(&lg->derive);
+    node_pool_stop(&lg->pool);
+    sampler_free(&lg->sampler);
+    counter_set_free(&lg->cs);
+    node_set_free(&lg->nodes);
+}
 
-    fp = fopen(filename, "w");
-    if (!fp) { perror("fopen"); exit(1); }
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+        "Usage: %s [options] <numa_count|auto> <interval_sec> (-d <duration_sec> | -r <command> [args...] | -s | -p <log>)\n"
+        "       %s --serve <[host]:port> [options] <numa_count|auto> <interval_sec>\n"
+        "\n"
+        "With --serve and no mode the logger runs as a daemon until SIGINT or SIGTERM.\n"
+        "\n"
+        "-s starts a session: runs are started and stopped by commands on stdin (or\n"
+        "--control), one per line: start <run> <label>, policy <label>, attach <pid>,\n"
+        "stop, quit. Rows get mem_policy and run_index columns.\n"
+        "\n"
+        "-p replays a recorded CSV or --format bin log instead of reading /sys: its rows\n"
+        "go through derived columns, --features, --policy (decisions are logged, not\n"
+        "applied), --shm and --serve, paced by their timestamps (see --replay-speed).\n"
+        "Nodes default to those in the log; interval_sec is the recorded interval.\n"
+        "\n"
+        "Nodes are read from /sys/devices/system/node/has_memory (or online); 'auto'\n"
+        "logs all of them, a number logs the first numa_count of them.\n"
+        "\n"
+        "Options:\n"
+        "  --nodes <list>          log exactly these node IDs, e.g. 0,1,4-5\n"
+        "  --node-threads          sample each node from its own thread, pinned to that\n"
+        "                          node's CPUs, so all nodes are read at the same moment\n"
+        "  --counters <file|list>  counters to log instead of the defaults; entries are\n"
+        "                          <source>:<key>[=<column>] or 'default', where source is\n"
+        "                          node_meminfo, node_vmstat, vmstat or meminfo\n"
+        "  --emit <kinds>          comma-separated columns to write per counter: abs\n"
+        "                          (default), delta (change since the previous sample)\n"
+        "                          and/or rate (change per second)\n"
+        "  --format <csv|bin|tsdb> output format (default csv); bin writes fixed-width\n"
+        "                          little-endian records, tsdb delta-encoded blocks\n"
+        "                          with per-block summaries, see numa_stat_dump\n"
+        "  --output <path>         output file (default numa_stat_log.csv, .bin or\n"
+        "                          .tsdb)\n"
+        "  --block-rows <n>        rows per tsdb block (default 1024)\n"
+        "  --compress <zstd|lz4>[:level]\n"
+        "                          compress the output in the writer thread (needs a\n"
+        "                          build with make ZSTD=1 / LZ4=1); adds .zst/.lz4 to\n"
+        "                          the default file name\n"
+        "  --compress-frame <rows> rows per compressed frame (default 1000); a log cut\n"
+        "                          short is readable up to its last frame\n"
+        "  --missed <skip|catchup> when a sample overruns its tick: skip the missed\n"
+        "                          ticks (default) or take them back to back\n"
+        "  --source-interval <source>=<sec>[,...]\n"
+        "                          read a counter source less often than every tick,\n"
+        "                          e.g. node_meminfo=0.1,vmstat=1; rows repeat its last\n"
+        "                          values and get a <source>_age_ns column, as do\n"
+        "                          the collectors slower than the tick\n"
+        "  --jitter                add sched_jitter_ns and sched_missed_ticks columns\n"
+        "  --ring <slots>          rows queued for the writer thread (default 4096);\n"
+        "                          0 writes and flushes every row on the sampling thread\n"
+        "  --overflow <block|drop> when the ring is full: wait for the writer (default)\n"
+        "                          or drop the row and count it in dropped_samples\n"
+        "  --proc                  in -r mode, log the command's process tree: per-node\n"
+        "                          resident kB from numa_maps, VmRSS and process count\n"
+        "  --pid <pid>             log the process tree of an existing process instead\n"
+        "  --proc-interval <sec>   how often the process tree is sampled (default 1)\n"
+        "  --hugepages             log per-node huge page pools (nr/free/surplus per\n"
+        "                          page size) and AnonHugePages/ShmemHugePages/FilePages\n"
+        "  --hugepages-interval <sec>\n"
+        "                          how often those are sampled (default 1)\n"
+        "  --cgroup <path|auto>    log a cgroup v2 group's per-node anon/file/anon_thp/\n"
+        "                          shmem bytes (memory.numa_stat) and its migration\n"
+        "                          counters (memory.stat); path is relative to the\n"
+        "                          cgroup2 mount, / being the root group; auto\n"
+        "                          follows the cgroup of the -r command, --pid or\n"
+        "                          the session's attach pid\n"
+        "  --cgroup-interval <sec> how often the cgroup is sampled (default 1)\n"
+        "  --perf <event>          count a hardware event per node with perf_event_open\n"
+        "                          and log its rate; event is <name>=<pmu>/<terms>/,\n"
+        "                          e.g. remote_dram=cpu/event=0xd3,umask=0x02/, or\n"
+        "                          remote-dram for local_dram and remote_dram; repeat\n"
+        "                          for up to 8 events\n"
+        "  --mbm                   log memory bandwidth per node (bytes/s of resctrl\n"
+        "                          mbm_total_bytes and mbm_local_bytes)\n"
+        "  --mbm-group <name|auto> monitor one resctrl group instead of the system;\n"
+        "                          auto creates one for the -r command, --pid or the\n"
+        "                          session's attach pid (implies --mbm)\n"
+        "  --mbm-interval <sec>    how often bandwidth is sampled (default 1)\n"
+        "  --migrate-trace         trace page migrations with eBPF: per tick, calls,\n"
+        "                          pages migrated/failed, pages per reason and per node\n"
+        "                          of the migrating CPU, and a latency histogram\n"
+        "  --shm <name>            also publish every row to the POSIX shared-memory\n"
+        "                          segment /dev/shm/<name>, a lock-free ring of the\n"
+        "                          latest rows plus the schema (see shm.h)\n"
+        "  --shm-slots <n>         rows kept in the segment (default 1024)\n"
+        "  --serve <[host]:port>   serve the latest row as OpenMetrics over HTTP\n"
+        "                          (GET /metrics), one series per node, plus per-node\n"
+        "                          histograms of the numa_miss rate\n"
+        "  --logger-cpus <list>    run the logger (all its threads) on these CPUs,\n"
+        "                          e.g. housekeeping CPUs the benchmark does not use\n"
+        "  --logger-membind <nodes>\n"
+        "                          allocate the logger's memory on these nodes only\n"
+        "  --child-cpus <list>     run the -r command on these CPUs\n"
+        "  --child-cpunodebind <nodes>\n"
+        "                          run the -r command on the CPUs of these nodes\n"
+        "  --child-policy <policy> memory policy of the -r command, as numactl would\n"
+        "                          set it: local, interleave=<nodes|all>,\n"
+        "                          preferred=<node>, membind=<nodes>, or the\n"
+        "                          POLICY_COMMANDS names default, interleave_all,\n"
+        "                          preferred_node<N>; otherwise the command starts\n"
+        "                          with the placement the logger was started with\n"
+        "  --replay-speed <x|max>  -p pace: x times the recorded speed (default 1), or\n"
+        "                          max for as fast as possible\n"
+        "  --control <socket>      in -s mode, read commands from this Unix socket\n"
+        "                          instead of stdin; the session ends when the\n"
+        "                          controller disconnects\n"
+        "  --control-keep          keep the session when the controller disconnects\n"
+        "                          and wait for the next one (end it with quit)\n"
+        "  --run-column <name>     name of the run number column (default run_index)\n"
+        "  --policy <model>        closed-loop mode: every --policy-interval seconds\n"
+        "                          pick a memory policy mode for the -r command (or\n"
+        "                          --pid) and apply it with the policy syscall; model is\n"
+        "                          plugin:<file.so>, const:<mode> or\n"
+        "                          threshold:<column>,<limit>,<mode if >=>,<mode if <>\n"
+        "  --features              add the offline preprocessing features per node\n"
+        "                          (node_N_usage, _trend, _min_usage, _max_usage,\n"
+        "                          _volatility, _free_pages_change, then\n"
+        "                          total_page_migrations and run_timestep), built\n"
+        "                          incrementally and passed to --policy plugins\n"
+        "  --feature-window <n>    compute them over the last n samples instead of the\n"
+        "                          whole run (default 0, the whole run)\n"
+        "  --policy-interval <sec> time between decisions (default 0.5)\n"
+        "  --policy-syscall <nr>   policy syscall number (default 470)\n"
+        "  --profile               print the logger's own overhead at exit: per-phase\n"
+        "                          timings, CPU time and peak RSS\n"
+        "  --profile-columns       add the same measurements as prof_* columns\n",
+        prog, prog);
+}
 
-    fprintf(fp, "timestamp");
-    for (int i = 0; i < numa_count; i++)
-        fprintf(fp, ",node_%d_mem_total,node_%d_mem_used", i, i);
-    for (int i = 0; i < numa_count; i++)
-        fprintf(fp, ",node_%d_nr_free_pages,node_%d_numa_hit,node_%d_numa_miss,node_%d_numa_foreign,node_%d_numa_interleave,node_%d_numa_local,node_%d_numa_other",
-            i, i, i, i, i, i, i);
+int main(int argc, char* argv[]) {
+    static const struct option long_options[] = {
+        { "nodes", required_argument, NULL, 'n' },
+        { "node-threads", no_argument, NULL, 'T' },
+        { "counters", required_argument, NULL, 'c' },
+        { "emit", required_argument, NULL, 'e' },
+        { "source-interval", required_argument, NULL, 'L' },
+        { "format", required_argument, NULL, 'f' },
+        { "output", required_argument, NULL, 'o' },
+        { "compress", required_argument, NULL, 'Z' },
+        { "compress-frame", required_argument, NULL, 'X' },
+        { "block-rows", required_argument, NULL, 'B' },
+        { "missed", required_argument, NULL, 'm' },
+        { "jitter", no_argument, NULL, 'j' },
+        { "ring", required_argument, NULL, 'R' },
+        { "overflow", required_argument, NULL, 'O' },
+        { "proc", no_argument, NULL, 'p' },
+        { "pid", required_argument, NULL, 'P' },
+        { "proc-interval", required_argument, NULL, 'I' },
+        { "hugepages", no_argument, NULL, 'H' },
+        { "hugepages-interval", required_argument, NULL, 'G' },
+        { "cgroup", required_argument, NULL, 'g' },
+        { "cgroup-interval", required_argument, NULL, 'Q' },
+        { "perf", required_argument, NULL, 'E' },
+        { "migrate-trace", no_argument, NULL, 'M' },
+        { "mbm", no_argument, NULL, 'b' },
+        { "mbm-group", required_argument, NULL, 'a' },
+        { "mbm-interval", required_argument, NULL, 'i' },
+        { "features", no_argument, NULL, 'F' },
+        { "feature-window", required_argument, NULL, 'W' },
+        { "shm", required_argument, NULL, 'A' },
+        { "shm-slots", required_argument, NULL, 'D' },
+        { "serve", required_argument, NULL, 'V' },
+        { "logger-cpus", required_argument, NULL, 'k' },
+        { "logger-membind", required_argument, NULL, 'l' },
+        { "child-cpus", required_argument, NULL, 'u' },
+        { "child-cpunodebind", required_argument, NULL, 'w' },
+        { "child-policy", required_argument, NULL, 'x' },
+        { "replay-speed", required_argument, NULL, 't' },
+        { "control", required_argument, NULL, 'K' },
+        { "control-keep", no_argument, NULL, 'q' },
+        { "run-column", required_argument, NULL, 'U' },
+        { "policy", required_argument, NULL, 'y' },
+        { "policy-interval", required_argument, NULL, 'Y' },
+        { "policy-syscall", required_argument, NULL, 'N' },
+        { "profile", no_argument, NULL, 'S' },
+        { "profile-columns", no_argument, NULL, 'C' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
 
-    const char* sys_cols[] = {
-        "numa_pte_updates","numa_huge_pte_updates","numa_pages_migrated",
-        "pgmigrate_success","pgmigrate_fail","thp_migration_success",
-        "thp_migration_fail","thp_migration_split"
+    const char* prog = argv[0];
+    struct options opts = {
+        .emit = EMIT_ABS,
+        .overflow = RING_BLOCK,
+        .proc_interval = 1.0,
+        .hugepages_interval = 1.0,
+        .cgroup_interval = 1.0,
+        .mbm_interval = 1.0,
+        .policy_interval = 0.5,
+        .policy_syscall = POLICY_SYSCALL_NR,
+        .run_column = "run_index",
+        .shm_slots = 1024,
+        .replay_speed = 1.0,
     };
-    for (int i = 0; i < 8; i++)
-        fprintf(fp, ",%s", sys_cols[i]);
+    enum output_format format = OUTPUT_CSV;
+    const char* output_path = NULL;
+    struct output_opts oopts = { .z = { .kind = COMPRESS_NONE } };
+    char default_path[64];
+    enum tick_policy tick_policy = TICK_SKIP;
+    long ring_slots = 4096;
 
-    fprintf(fp, "\n");
-    fclose(fp);
-}
+    // Options must come before the positional arguments so that everything
+    // after -r is passed to the command untouched.
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            opts.node_list = optarg;
+            break;
+        case 'T':
+            opts.node_threads = 1;
+            break;
+        case 'c':
+            opts.counters_spec = optarg;
+            break;
+        case 'e':
+            if (derive_parse_emit(optarg, &opts.emit) != 0)
+                return 1;
+            break;
+        case 'L':
+            opts.source_intervals = optarg;
+            break;
+        case 'f':
+            if (output_parse_format(optarg, &format) != 0)
+                return 1;
+            break;
+        case 'o':
+            output_path = optarg;
+            break;
+        case 'Z':
+            if (compress_parse(optarg, &oopts.z) != 0)
+                return 1;
+            break;
+        case 'X': {
+            char* end;
+            long long rows = strtoll(optarg, &end, 10);
+            if (*end || rows <= 0) {
+                fprintf(stderr, "Invalid --compress-frame: %s\n", optarg);
+                return 1;
+            }
+            oopts.z.frame_rows = (uint64_t)rows;
+            break;
+        }
+        case 'B': {
+            char* end;
+            long rows = strtol(optarg, &end, 10);
+            if (*end || rows <= 0 || rows > 1 << 20) {
+                fprintf(stderr, "Invalid --block-rows: %s\n", optarg);
+                return 1;
+            }
+            oopts.block_rows = (uint32_t)rows;
+            break;
+        }
+        case 'm':
+            if (ticker_parse_policy(optarg, &tick_policy) != 0)
+                return 1;
+            break;
+        case 'j':
+            opts.log_jitter = 1;
+            break;
+        case 'R':
+            ring_slots = atol(optarg);
+            if (ring_slots < 0) {
+                fprintf(stderr, "Invalid --ring size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'O':
+            if (ring_parse_overflow(optarg, &opts.overflow) != 0)
+                return 1;
+            break;
+        case 'p':
+            opts.proc = 1;
+            break;
+        case 'P':
+            opts.proc = 1;
+            opts.proc_pid = (pid_t)atoi(optarg);
+            if (opts.proc_pid <= 0) {
+                fprintf(stderr, "Invalid --pid: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'I':
+            opts.proc_interval = atof(optarg);
+            if (opts.proc_interval <= 0) {
+                fprintf(stderr, "Invalid --proc-interval: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'H':
+            opts.hugepages = 1;
+            break;
+        case 'G':
+            opts.hugepages_interval = atof(optarg);
+            if (opts.hugepages_interval <= 0) {
+                fprintf(stderr, "Invalid --hugepages-interval: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'g':
+            opts.cgroup_path = optarg;
+            break;
+        case 'E':
+            if (opts.nperf == PERF_MAX_EVENTS) {
+                fprintf(stderr, "At most %d --perf events\n", PERF_MAX_EVENTS);
+                return 1;
+            }
+            opts.perf_events[opts.nperf++] = optarg;
+            break;
+        case 'b':
+            opts.mbm = 1;
+            break;
+        case 'a':
+            opts.mbm = 1;
+            opts.mbm_group = optarg;
+            break;
+        case 'i':
+            opts.mbm_interval = atof(optarg);
+            if (opts.mbm_interval <= 0) {
+                fprintf(stderr, "Invalid --mbm-interval: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'M':
+            opts.migrate_trace = 1;
+            break;
+        case 'Q':
+            opts.cgroup_interval = atof(optarg);
+            if (opts.cgroup_interval <= 0) {
+                fprintf(stderr, "Invalid --cgroup-interval: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'F':
+            opts.features = 1;
+            break;
+        case 'W': {
+            char* end;
+            long n = strtol(optarg, &end, 10);
+            if (*end || n < 0 || n > 1 << 24) {
+                fprintf(stderr, "Invalid --feature-window: %s\n", optarg);
+                return 1;
+            }
+            opts.features = 1;
+            opts.feature_window = (uint32_t)n;
+            break;
+        }
+        case 'A':
+            if (!*optarg || strchr(optarg + 1, '/')) {
+                fprintf(stderr, "Invalid --shm name: %s\n", optarg);
+                return 1;
+            }
+            opts.shm_name = optarg;
+            break;
+        case 'D': {
+            char* end;
+            long n = strtol(optarg, &end, 10);
+            if (*end || n <= 0 || n > 1 << 24) {
+                fprintf(stderr, "Invalid --shm-slots: %s\n", optarg);
+                return 1;
+            }
+            opts.shm_slots = (uint32_t)n;
+            break;
+        }
+        case 'V':
+            opts.serve_addr = optarg;
+            break;
+        case 'k':
+            if (placement_parse_cpus(&opts.logger_place, optarg) != 0)
+                return 1;
+            break;
+        case 'l': {
+            char spec[256];
+            snprintf(spec, sizeof(spec), "membind=%s", optarg);
+            if (placement_parse_policy(&opts.logger_place, spec) != 0)
+                return 1;
+            break;
+        }
+        case 'u':
+            if (placement_parse_cpus(&opts.child_place, optarg) != 0)
+                return 1;
+            break;
+        case 'w':
+            if (placement_parse_cpunodes(&opts.child_place, optarg) != 0)
+                return 1;
+            break;
+        case 'x':
+            if (placement_parse_policy(&opts.child_place, optarg) != 0)
+                return 1;
+            break;
+        case 't':
+            opts.replay_speed = strcmp(optarg, "max") == 0 ? 0 : atof(optarg);
+            if (opts.replay_speed < 0 || (opts.replay_speed == 0 && strcmp(optarg, "max") != 0)) {
+                fprintf(stderr, "Invalid --replay-speed: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'K':
+            opts.control_path = optarg;
+            break;
+        case 'q':
+            opts.control_keep = 1;
+            break;
+        case 'U':
+            if (!*optarg || strchr(optarg, ',')) {
+                fprintf(stderr, "Invalid --run-column: %s\n", optarg);
+                return 1;
+            }
+            opts.run_column = optarg;
+            break;
+        case 'y':
+            opts.policy_spec = optarg;
+            break;
+        case 'Y':
+            opts.policy_interval = atof(optarg);
+            if (opts.policy_interval <= 0) {
+                fprintf(stderr, "Invalid --policy-interval: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'N':
+            opts.policy_syscall = atol(optarg);
+            if (opts.policy_syscall <= 0) {
+                fprintf(stderr, "Invalid --policy-syscall: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'S':
+            opts.profile = 1;
+            break;
+        case 'C':
+            opts.profile_columns = 1;
+            break;
+        case 'h':
+            usage(prog);
+            return 0;
+        default:
+            usage(prog);
+            return 1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
 
-int main(int argc, char* argv[]) {
-    if (argc < 4) {
-        fprintf(stderr, "Usage: %s <numa_count> <interval_sec> (-d <duration_sec> | -r <command> [args...])\n", argv[0]);
+    int serve_only = argc == 3 && opts.serve_addr;
+    if (argc < 4 && !serve_only) {
+        usage(prog);
         return 1;
     }
 
-    int numa_count = atoi(argv[1]);
-    if (numa_count <= 0) {
-        fprintf(stderr, "Invalid numa_count: %d\n", numa_count);
-        return 1;
+    if (strcmp(argv[1], "auto") != 0) {
+        opts.numa_count = atoi(argv[1]);
+        if (opts.numa_count <= 0) {
+            fprintf(stderr, "Invalid numa_count: %s\n", argv[1]);
+            return 1;
+        }
     }
 
     double interval_sec = atof(argv[2]);
+    opts.interval_sec = interval_sec;
     if (interval_sec <= 0) {
         fprintf(stderr, "Invalid interval_sec: %f\n", interval_sec);
         return 1;
@@ -259,7 +1096,10 @@ int main(int argc, char* argv[]) {
     char** run_argv = NULL;
 
     // parse mode
-    if (strcmp(argv[3], "-d") == 0) {
+    if (serve_only) {
+        // Runs until a signal, see EV_SIGNAL.
+    }
+    else if (strcmp(argv[3], "-d") == 0) {
         if (argc < 5) {
             fprintf(stderr, "Missing duration argument\n");
             return 1;
@@ -279,104 +1119,354 @@ int main(int argc, char* argv[]) {
         use_run = 1;
         run_argv = &argv[4]; // points to command + args
     }
+    else if (strcmp(argv[3], "-s") == 0) {
+        opts.session = 1;
+    }
+    else if (strcmp(argv[3], "-p") == 0) {
+        if (argc < 5) {
+            fprintf(stderr, "Missing log to replay\n");
+            return 1;
+        }
+        opts.replay_path = argv[4];
+    }
     else {
         fprintf(stderr, "Unknown mode: %s\n", argv[3]);
         return 1;
     }
 
-    int iterations = 0;
+    uint64_t iterations = 0;
     if (use_duration) {
         iterations = duration_sec / interval_sec;
     }
 
-    struct node_meminfo* nm = malloc(sizeof(struct node_meminfo) * numa_count);
-    struct node_vmstat* nv = malloc(sizeof(struct node_vmstat) * numa_count);
-    struct sys_vmstat sv;
+    if (ring_slots == 0)
+        opts.overflow = RING_BLOCK;
 
-    if (!nm || !nv) {
-        fprintf(stderr, "Failed to allocate memory for NUMA arrays\n");
-        free(nm); free(nv);
+    if (opts.replay_path && (opts.node_threads || opts.source_intervals || opts.proc || opts.proc_pid ||
+            opts.hugepages || opts.cgroup_path || opts.nperf || opts.migrate_trace || opts.mbm ||
+            opts.mbm_group)) {
+        fprintf(stderr, "-p replays recorded counters only; --node-threads, --source-interval and the "
+            "collectors need a live system\n");
+        return 1;
+    }
+    if (opts.proc && !opts.proc_pid && !use_run && !opts.session) {
+        fprintf(stderr, "--proc needs -r mode; use --pid to follow an existing process\n");
         return 1;
     }
+    if (opts.policy_spec && !opts.proc_pid && !use_run && !opts.session && !opts.replay_path) {
+        fprintf(stderr, "--policy needs -r mode, -p mode or --pid\n");
+        return 1;
+    }
+    if (opts.cgroup_path && strcmp(opts.cgroup_path, "auto") == 0 &&
+        !opts.proc_pid && !use_run && !opts.session) {
+        fprintf(stderr, "--cgroup auto needs -r mode, --pid or -s mode\n");
+        return 1;
+    }
+    if (opts.mbm_group && strcmp(opts.mbm_group, "auto") == 0 &&
+        !opts.proc_pid && !use_run && !opts.session) {
+        fprintf(stderr, "--mbm-group auto needs -r mode, --pid or -s mode\n");
+        return 1;
+    }
+    if ((opts.child_place.has_cpus || opts.child_place.has_policy) && !use_run) {
+        fprintf(stderr, "--child-cpus, --child-cpunodebind and --child-policy need -r mode\n");
+        return 1;
+    }
+    if (opts.control_keep && !opts.control_path) {
+        fprintf(stderr, "--control-keep needs --control\n");
+        return 1;
+    }
+    if (opts.control_path && !opts.session) {
+        fprintf(stderr, "--control needs -s mode\n");
+        return 1;
+    }
+
+    if (!output_path) {
+        snprintf(default_path, sizeof(default_path), "%s%s",
+            output_default_path(format), compress_suffix(oopts.z.kind));
+        output_path = default_path;
+    }
+    char labels_path[4096];
+    snprintf(labels_path, sizeof(labels_path), "%s.labels", output_path);
+
+    // The -r command starts with the placement the logger was started with,
+    // changed by the --child-* options. The logger itself moves to its
+    // housekeeping CPUs and memory before any of its threads or buffers
+    // exist, so all of them follow.
+    struct placement launch;
+    if (placement_get(&launch) != 0 || placement_apply(&opts.logger_place) != 0)
+        return 1;
+    placement_merge(&launch, &opts.child_place);
 
-    const char* csv_file = "numa_stat_log.csv";
-    write_csv_header(csv_file, numa_count);
+    // A daemon stops on SIGINT/SIGTERM and still closes its output cleanly.
+    // The signals are blocked before any thread exists, so that only the
+    // signalfd sees them.
+    sigset_t stop;
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGINT);
+    sigaddset(&stop, SIGTERM);
+    if (serve_only)
+        sigprocmask(SIG_BLOCK, &stop, NULL);
 
-    FILE* fp = fopen(csv_file, "a");
-    if (!fp) {
-        perror("fopen append");
-        free(nm); free(nv);
+    struct logger lg;
+    if (logger_setup(&lg, &opts) != 0 ||
+        (opts.session && format != OUTPUT_CSV && log_labels_load(&lg.schema, labels_path) != 0) ||
+        output_open(&lg.out, format, output_path, &lg.schema, &oopts) != 0) {
+        logger_teardown(&lg);
         return 1;
     }
 
-    pid_t child_pid = -1;
-    int status = 0;
+    // Without a writer thread every row is flushed as soon as it is written.
+    if (ring_slots == 0) {
+        lg.out.flush_each_row = 1;
+    }
+    else {
+        if (writer_start(&lg.writer, &lg.out, (uint64_t)ring_slots, opts.overflow, lg.schema.ncols) != 0) {
+            logger_teardown(&lg);
+            return 1;
+        }
+        lg.use_writer = 1;
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (epfd < 0 || tfd < 0) {
+        perror("epoll/timerfd");
+        logger_teardown(&lg);
+        return 1;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = EV_TICK };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+
+    struct child child = { .pid = -1, .fd = -1 };
     if (use_run) {
-        child_pid = fork();
-        if (child_pid == 0) {
-            // child: run the command
-            execvp(run_argv[0], run_argv);
-            perror("execvp failed");
-            exit(1);
+        if (child_spawn(&child, run_argv, &launch) != 0) {
+            logger_teardown(&lg);
+            return 1;
         }
+        ev.data.u32 = EV_CHILD;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, child.fd, &ev);
+        if (lg.proc && !opts.proc_pid)
+            proc_numa_attach(lg.proc, child.pid);
+        if (lg.cgroup && !opts.proc_pid)
+            cgroup_attach(lg.cgroup, child.pid);
+        if (lg.mbm && !opts.proc_pid)
+            mbm_attach(lg.mbm, child.pid);
+        if (lg.use_policy && !opts.proc_pid)
+            policy_attach(&lg.policy, child.pid);
         // parent continues to log
     }
 
-    char meminfo_path[128], vmstat_path[128];
-
-    for (int iter = 0; use_duration ? (iter < iterations) : 1; iter++) {
-        // --- Parse all nodes ---
-        for (int i = 0; i < numa_count; i++) {
-            snprintf(meminfo_path, sizeof(meminfo_path),
-                "/sys/devices/system/node/node%d/meminfo", i);
-            parse_node_meminfo(&nm[i], meminfo_path, i);
+    struct session* ss = &lg.session;
+    if (opts.session && session_watch(ss, epfd, EV_LISTEN, EV_CONTROL) != 0) {
+        perror("epoll_ctl");
+        logger_teardown(&lg);
+        return 1;
+    }
+    if (lg.use_serve && serve_watch(&lg.serve, epfd, EV_SERVE_LISTEN, EV_SERVE_CLIENT) != 0) {
+        perror("epoll_ctl");
+        logger_teardown(&lg);
+        return 1;
+    }
 
-            snprintf(vmstat_path, sizeof(vmstat_path),
-                "/sys/devices/system/node/node%d/vmstat", i);
-            parse_node_vmstat(&nv[i], vmstat_path);
+    int sfd = -1;
+    if (serve_only) {
+        sfd = signalfd(-1, &stop, SFD_CLOEXEC | SFD_NONBLOCK);
+        ev.data.u32 = EV_SIGNAL;
+        if (sfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev) != 0) {
+            perror("signalfd");
+            logger_teardown(&lg);
+            return 1;
         }
-        parse_sys_vmstat(&sv, "/proc/vmstat");
+    }
 
-        // --- Write CSV row ---
-        struct timespec ts;
-        clock_gettime(CLOCK_REALTIME, &ts);
-        fprintf(fp, "%ld.%09ld", ts.tv_sec, ts.tv_nsec);
+    // Ticks are scheduled on absolute deadlines, so the time spent sampling
+    // and writing does not stretch the period. Tick 0 is due right away, so
+    // in -r mode the first sample is taken at fork.
+    struct ticker ticker;
+    int64_t period_ns = (int64_t)llround(interval_sec * 1e9);
+    ticker_init(&ticker, period_ns, tick_policy);
+
+    // -p: row k is due (ts_k - ts_0) / speed after the start. At max speed
+    // rows come back to back, and epoll is only polled in between.
+    int replay_status = lg.use_replay ? replay_next(&lg.replay) : 1;
+    int64_t replay_start = ticker_now_ns();
+    int64_t replay_due = replay_start;
 
-        for (int i = 0; i < numa_count; i++)
-            fprintf(fp, ",%u,%u", nm[i].mem_total, nm[i].mem_used);
+    int quit = 0;
+    while (!quit && replay_status > 0 && (!use_duration || ticker.next_tick < iterations)) {
+        if (lg.use_replay) {
+            if (opts.replay_speed > 0) {
+                replay_due = replay_start +
+                    (int64_t)((lg.replay.ts_ns - lg.replay.first_ts_ns) / opts.replay_speed);
+                if (ticker_arm_at(tfd, replay_due) != 0) {
+                    perror("timerfd_settime");
+                    break;
+                }
+            }
+        }
+        // Between session runs the clock is stopped.
+        else if (!opts.session || ss->active) {
+            if (ticker_arm(&ticker, tfd) != 0) {
+                perror("timerfd_settime");
+                break;
+            }
+        }
 
-        for (int i = 0; i < numa_count; i++)
-            fprintf(fp, ",%u,%u,%u,%u,%u,%u,%u",
-                nv[i].nr_free_pages, nv[i].numa_hit, nv[i].numa_miss,
-                nv[i].numa_foreign, nv[i].numa_interleave,
-                nv[i].numa_local, nv[i].numa_other);
+        struct epoll_event events[16];
+        int n = epoll_wait(epfd, events, 16, lg.use_replay && opts.replay_speed == 0 ? 0 : -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
 
-        fprintf(fp, ",%u,%u,%u,%u,%u,%u,%u,%u\n",
-            sv.numa_pte_updates, sv.numa_huge_pte_updates, sv.numa_pages_migrated,
-            sv.pgmigrate_success, sv.pgmigrate_fail,
-            sv.thp_migration_success, sv.thp_migration_fail, sv.thp_migration_split);
+        int tick = 0, exited = 0;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.u32 == EV_TICK) {
+                uint64_t expirations;
+                if (read(tfd, &expirations, sizeof(expirations)) == sizeof(expirations))
+                    tick = 1;
+            }
+            else if (events[i].data.u32 == EV_CHILD) {
+                exited = child_handle(&child);
+            }
+            else if (events[i].data.u32 == EV_LISTEN) {
+                if (session_accept(ss, epfd, EV_CONTROL) != 0)
+                    perror("accept");
+            }
+            else if (events[i].data.u32 == EV_CONTROL) {
+                if (!session_read(ss))
+                    quit = 1;
+            }
+            else if (events[i].data.u32 == EV_SIGNAL) {
+                quit = 1;
+            }
+            else if (events[i].data.u32 == EV_SERVE_LISTEN) {
+                serve_accept(&lg.serve);
+            }
+            else if (events[i].data.u32 >= EV_SERVE_CLIENT) {
+                serve_client(&lg.serve, (int)(events[i].data.u32 - EV_SERVE_CLIENT), events[i].events);
+            }
+        }
 
-        fflush(fp);
+        if (lg.use_replay) {
+            if (tick || opts.replay_speed == 0) {
+                int64_t late = opts.replay_speed > 0 ? ticker_now_ns() - replay_due : 0;
+                int nlabels = lg.schema.nlabels;
+                if (replay_sample(&lg, late) != 0 ||
+                    (lg.schema.nlabels != nlabels && format != OUTPUT_CSV &&
+                        log_labels_save(&lg.schema, labels_path) != 0)) {
+                    fprintf(stderr, "Cannot record label '%s'\n", lg.replay.label);
+                    replay_status = -1;
+                }
+                else {
+                    replay_status = replay_next(&lg.replay);
+                }
+            }
+        }
+        else if (exited) {
+            // Final sample at the moment the child exits, in place of a
+            // tick that fired in the same batch.
+            take_sample(&lg, 0, 0, 1);
+        }
+        else if (tick && (!opts.session || ss->active)) {
+            ticker_fired(&ticker, ticker_now_ns());
+            take_sample(&lg, ticker.jitter_ns, ticker.missed, 0);
+        }
 
-        // Sleep interval
-        struct timespec ts_sleep = { 0, (long)(interval_sec * 1e9) };
-        nanosleep(&ts_sleep, NULL);
+        if (exited)
+            break;
 
-        // Stop condition for run-executable mode
-        if (use_run) {
-            pid_t ret = waitpid(child_pid, &status, WNOHANG);
-            if (ret != 0)
-                break; // child finished
+        // --- Session commands, after this tick's sample ---
+        enum session_cmd cmd;
+        while (opts.session && !quit && (cmd = session_next(ss)) != SESSION_NONE) {
+            switch (cmd) {
+            case SESSION_START: {
+                if (ss->active) {
+                    session_reply(ss, "error run %llu is still running", (unsigned long long)ss->run);
+                    break;
+                }
+                int label = log_schema_label(&lg.schema, ss->arg);
+                if (label < 0 || (format != OUTPUT_CSV && log_labels_save(&lg.schema, labels_path) != 0)) {
+                    session_reply(ss, "error cannot record label '%s'", ss->arg);
+                    break;
+                }
+                ss->label = (uint64_t)label;
+                ss->run = (uint64_t)ss->num;
+                ss->rows = 0;
+                ss->active = 1;
+                lg.nsamples = 0;
+                if (lg.use_features)
+                    features_reset(&lg.features);
+                // The run's first row is taken right away.
+                ticker_init(&ticker, period_ns, tick_policy);
+                session_reply(ss, "ok run %llu", (unsigned long long)ss->run);
+                break;
+            }
+            case SESSION_POLICY: {
+                int label = log_schema_label(&lg.schema, ss->arg);
+                if (label < 0 || (format != OUTPUT_CSV && log_labels_save(&lg.schema, labels_path) != 0)) {
+                    session_reply(ss, "error cannot record label '%s'", ss->arg);
+                    break;
+                }
+                ss->label = (uint64_t)label;
+                session_reply(ss, "ok");
+                break;
+            }
+            case SESSION_ATTACH:
+                if (lg.proc)
+                    proc_numa_attach(lg.proc, (pid_t)ss->num);
+                if (lg.cgroup)
+                    cgroup_attach(lg.cgroup, (pid_t)ss->num);
+                if (lg.mbm)
+                    mbm_attach(lg.mbm, (pid_t)ss->num);
+                if (lg.use_policy)
+                    policy_attach(&lg.policy, (pid_t)ss->num);
+                session_reply(ss, "ok");
+                break;
+            case SESSION_STOP:
+                if (!ss->active) {
+                    session_reply(ss, "error no run is started");
+                    break;
+                }
+                // Closing row, like the final sample when a -r command exits.
+                take_sample(&lg, 0, 0, 1);
+                ss->active = 0;
+                ticker_disarm(tfd);
+                session_reply(ss, "ok %llu rows", (unsigned long long)ss->rows);
+                break;
+            case SESSION_QUIT:
+                quit = 1;
+                break;
+            default:
+                break;
+            }
         }
     }
 
+    if (opts.session) {
+        if (ss->active)
+            take_sample(&lg, 0, 0, 1);
+        session_reply(ss, "ok bye");
+    }
+
+    if (ticker.total_missed)
+        fprintf(stderr, "Missed %llu sampling ticks (interval too short for the sampling work)\n",
+            (unsigned long long)ticker.total_missed);
+
     // If run mode and child still exists, wait for it
-    if (use_run)
-        waitpid(child_pid, &status, 0);
+    if (use_run) {
+        child_wait(&child);
+        child_close(&child);
+    }
 
-    fclose(fp);
-    free(nm);
-    free(nv);
+    if (sfd >= 0)
+        close(sfd);
+    close(tfd);
+    close(epfd);
+    logger_teardown(&lg);
 
-    return 0;
+    return replay_status < 0 ? 1 : 0;
 }
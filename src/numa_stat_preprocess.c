@@ -0,0 +1,952 @@
+#include <ctype.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logfmt.h"
+#include "rolling.h"
+#include "tsdb.h"
+
+// The per-run features of preprocess_stream_log.py/preprocess_rocksdb_log.py
+// in one streaming pass over the logger's CSV, binary or tsdb output, for
+// any number of nodes. Parsing (CSV) and block decoding (tsdb) run on -j
+// threads; the rows they produce are then accumulated in file order on
+// one thread, so values are computed in the same order and with the same
+// (Welford) variance as pandas' groupby and come out identical.
+
+#define CSV_CHUNK (8 << 20)     // bytes of CSV per parser thread and batch
+#define BIN_BATCH 65536         // binary records per batch
+#define TSDB_BATCH 4            // tsdb blocks per thread and batch
+
+enum role {
+    ROLE_NONE,
+    ROLE_TS,
+    ROLE_RUN,
+    ROLE_POLICY,
+    ROLE_VALUE,
+};
+
+// Where the needed columns are. A compact row is stride cells:
+//   [0] timestamp (f, seconds)   [1] run (u)   [2] policy text (pointer)
+//   [3 ...] per node mem_used, mem_total, nr_free_pages, then
+//           numa_pages_migrated
+struct layout {
+    int nnodes;
+    int node_ids[1024];
+    int nvalues;
+    int stride;
+
+    // Per input column (CSV: per field, the timestamp being field 0).
+    int nfields;
+    unsigned char* role;
+    int* slot;
+};
+
+struct run {
+    uint64_t key;
+    uint64_t rows;
+    uint64_t last_row;  // position of its last row in the logs
+    double ts_min;
+    double ts_last;
+    char policy[LOG_NAME_MAX];
+    struct rolling* usage;
+    uint64_t* free_first;
+    uint64_t* free_last;
+    uint64_t mig_first;
+    uint64_t mig_last;
+};
+
+struct runs {
+    struct run** v;     // sorted by key, until runs_in_log_order()
+    size_t n, cap;
+    struct run* last;
+    uint64_t rows;
+};
+
+struct opts {
+    int jobs;
+    const char* run_in;
+    const char* run_out;
+};
+
+// --- Layout ---
+
+// Find the columns by name; names[i] is input column i.
+static int layout_build(struct layout* L, int nfields, const char* const* names, const char* run_col)
+{
+    memset(L, 0, sizeof(*L));
+    L->nfields = nfields;
+    L->role = calloc(nfields ? nfields : 1, 1);
+    L->slot = calloc(nfields ? nfields : 1, sizeof(int));
+    if (!L->role || !L->slot)
+        return -1;
+
+    int have_run = 0, have_policy = 0, have_ts = 0, migrated = -1;
+    for (int i = 0; i < nfields; i++) {
+        int id, off = 0;
+        if (strcmp(names[i], "timestamp") == 0) {
+            L->role[i] = ROLE_TS;
+            have_ts = 1;
+        }
+        else if (strcmp(names[i], run_col) == 0) {
+            L->role[i] = ROLE_RUN;
+            have_run = 1;
+        }
+        else if (strcmp(names[i], "mem_policy") == 0) {
+            L->role[i] = ROLE_POLICY;
+            have_policy = 1;
+        }
+        else if (strcmp(names[i], "numa_pages_migrated") == 0)
+            migrated = i;
+        else if (sscanf(names[i], "node_%d_mem_used%n", &id, &off) == 1 && names[i][off] == '\0' &&
+                 L->nnodes < (int)(sizeof(L->node_ids) / sizeof(L->node_ids[0])))
+            L->node_ids[L->nnodes++] = id;
+    }
+    if (!have_ts || !have_run || !have_policy || migrated < 0) {
+        fprintf(stderr, "Input is missing required column '%s'\n",
+            !have_ts ? "timestamp" : !have_run ? run_col : !have_policy ? "mem_policy" : "numa_pages_migrated");
+        return -1;
+    }
+    if (L->nnodes == 0) {
+        fprintf(stderr, "Input has no node_N_mem_used columns\n");
+        return -1;
+    }
+
+    L->nvalues = 3 * L->nnodes + 1;
+    L->stride = 3 + L->nvalues;
+    static const char* const per_node[] = { "mem_used", "mem_total", "nr_free_pages" };
+    for (int n = 0; n < L->nnodes; n++) {
+        for (int k = 0; k < 3; k++) {
+            char name[LOG_NAME_MAX];
+            snprintf(name, sizeof(name), "node_%d_%s", L->node_ids[n], per_node[k]);
+            int i = 0;
+            while (i < nfields && strcmp(names[i], name) != 0)
+                i++;
+            if (i == nfields) {
+                fprintf(stderr, "Input is missing required column '%s'\n", name);
+                return -1;
+            }
+            L->role[i] = ROLE_VALUE;
+            L->slot[i] = 3 + 3 * n + k;
+        }
+    }
+    L->role[migrated] = ROLE_VALUE;
+    L->slot[migrated] = 3 + 3 * L->nnodes;
+    return 0;
+}
+
+static void layout_free(struct layout* L)
+{
+    free(L->role);
+    free(L->slot);
+}
+
+// --- Per-run accumulators ---
+
+static struct run* run_get(struct runs* R, const struct layout* L, uint64_t key)
+{
+    if (R->last && R->last->key == key)
+        return R->last;
+
+    size_t lo = 0, hi = R->n;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (R->v[mid]->key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < R->n && R->v[lo]->key == key)
+        return R->last = R->v[lo];
+
+    if (R->n == R->cap) {
+        size_t cap = R->cap ? R->cap * 2 : 64;
+        struct run** v = realloc(R->v, sizeof(*v) * cap);
+        if (!v)
+            return NULL;
+        R->v = v;
+        R->cap = cap;
+    }
+    struct run* r = calloc(1, sizeof(*r));
+    if (!r)
+        return NULL;
+    r->key = key;
+    r->usage = calloc(L->nnodes, sizeof(*r->usage));
+    r->free_first = calloc(L->nnodes, sizeof(uint64_t));
+    r->free_last = calloc(L->nnodes, sizeof(uint64_t));
+    if (!r->usage || !r->free_first || !r->free_last) {
+        free(r->usage);
+        free(r->free_first);
+        free(r->free_last);
+        free(r);
+        return NULL;
+    }
+    for (int n = 0; n < L->nnodes; n++)
+        rolling_init(&r->usage[n], 0);
+
+    memmove(&R->v[lo + 1], &R->v[lo], sizeof(*R->v) * (R->n - lo));
+    R->v[lo] = r;
+    R->n++;
+    return R->last = r;
+}
+
+static int accumulate(struct runs* R, const struct layout* L, const union cell* rows, size_t nrows)
+{
+    for (size_t k = 0; k < nrows; k++) {
+        const union cell* c = rows + k * L->stride;
+        struct run* r = run_get(R, L, c[1].u);
+        if (!r) {
+            fprintf(stderr, "Failed to allocate run accumulators\n");
+            return -1;
+        }
+
+        double ts = c[0].f;
+        const char* policy = (const char*)(uintptr_t)c[2].u;
+        const union cell* v = c + 3;
+        if (r->rows == 0 || ts < r->ts_min)
+            r->ts_min = ts;
+        r->ts_last = ts;
+        if (strcmp(r->policy, policy) != 0)
+            snprintf(r->policy, sizeof(r->policy), "%s", policy);
+
+        for (int n = 0; n < L->nnodes; n++, v += 3) {
+            rolling_push(&r->usage[n], (double)v[0].u / (double)v[1].u);
+            if (r->rows == 0)
+                r->free_first[n] = v[2].u;
+            r->free_last[n] = v[2].u;
+        }
+        if (r->rows == 0)
+            r->mig_first = v[0].u;
+        r->mig_last = v[0].u;
+        r->rows++;
+        r->last_row = R->rows++;
+    }
+    return 0;
+}
+
+static int by_last_row(const void* a, const void* b)
+{
+    uint64_t x = (*(struct run* const*)a)->last_row;
+    uint64_t y = (*(struct run* const*)b)->last_row;
+    return x < y ? -1 : x > y;
+}
+
+// The scripts keep the last row of every run, in log order, so runs are
+// written in the order of their last rows. Only for output: run_get()
+// needs the key order.
+static void runs_in_log_order(struct runs* R)
+{
+    qsort(R->v, R->n, sizeof(*R->v), by_last_row);
+    R->last = NULL;
+}
+
+static void runs_free(struct runs* R, const struct layout* L)
+{
+    for (size_t i = 0; i < R->n; i++) {
+        for (int n = 0; n < L->nnodes; n++)
+            rolling_free(&R->v[i]->usage[n]);
+        free(R->v[i]->usage);
+        free(R->v[i]->free_first);
+        free(R->v[i]->free_last);
+        free(R->v[i]);
+    }
+    free(R->v);
+    memset(R, 0, sizeof(*R));
+}
+
+// --- Worker threads: each job fills its own array of compact rows ---
+
+struct job {
+    const struct layout* L;
+    union cell* rows;
+    size_t nrows;
+    size_t cap;
+    size_t bad;
+    int failed;
+
+    // CSV: a run of whole lines.
+    char* begin;
+    char* end;
+
+    // tsdb: blocks to decode.
+    const struct log_schema* ls;
+    const struct tsdb_block* blocks;
+    int nblocks;
+    const char* const* labels;
+    int nlabels;
+};
+
+static union cell* job_row(struct job* j)
+{
+    if (j->nrows == j->cap) {
+        size_t cap = j->cap ? j->cap * 2 : 4096;
+        union cell* rows = realloc(j->rows, sizeof(union cell) * j->L->stride * cap);
+        if (!rows) {
+            j->failed = 1;
+            return NULL;
+        }
+        j->rows = rows;
+        j->cap = cap;
+    }
+    return j->rows + j->nrows * j->L->stride;
+}
+
+static int run_jobs(struct job* jobs, int n, void* (*fn)(void*))
+{
+    pthread_t th[n];
+    int started = 0;
+    for (; started < n - 1; started++)
+        if (pthread_create(&th[started], NULL, fn, &jobs[started + 1]) != 0)
+            break;
+    for (int i = started + 1; i < n; i++)
+        fn(&jobs[i]);
+    fn(&jobs[0]);
+    for (int i = 0; i < started; i++)
+        pthread_join(th[i], NULL);
+
+    for (int i = 0; i < n; i++) {
+        if (jobs[i].failed) {
+            fprintf(stderr, "Failed to allocate row buffers\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Parse the needed fields of every line; other fields are only skipped.
+// Lines that do not parse (e.g. the header of a second log appended to
+// the first) are counted and left out.
+static void* csv_job(void* arg)
+{
+    struct job* j = arg;
+    const struct layout* L = j->L;
+    char* p = j->begin;
+
+    while (p < j->end) {
+        char* eol = memchr(p, '\n', (size_t)(j->end - p));
+        if (!eol)
+            eol = j->end;
+        *eol = '\0';
+        if (eol > p && eol[-1] == '\r')
+            eol[-1] = '\0';
+
+        union cell* c = job_row(j);
+        if (!c)
+            return NULL;
+        int f = 0, ok = 1;
+        char* field = p;
+        for (;;) {
+            char* comma = strchr(field, ',');
+            if (f < L->nfields && L->role[f]) {
+                char* end;
+                if (comma)
+                    *comma = '\0';
+                switch (L->role[f]) {
+                case ROLE_TS:
+                    c[0].f = strtod(field, &end);
+                    ok &= end != field && *end == '\0';
+                    break;
+                case ROLE_RUN:
+                    c[1].u = strtoull(field, &end, 10);
+                    ok &= end != field && *end == '\0';
+                    break;
+                case ROLE_POLICY:
+                    c[2].u = (uintptr_t)field;
+                    break;
+                default:
+                    c[L->slot[f]].u = strtoull(field, &end, 10);
+                    if (*end == '.' || *end == 'e')
+                        c[L->slot[f]].u = (uint64_t)strtod(field, &end);
+                    ok &= end != field && *end == '\0';
+                    break;
+                }
+            }
+            f++;
+            if (!comma)
+                break;
+            field = comma + 1;
+        }
+        if (ok && f == L->nfields)
+            j->nrows++;
+        else if (eol > p)
+            j->bad++;
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+// Project decoded cells onto the compact layout.
+static void project(const struct layout* L, const char* const* labels, int nlabels,
+    int64_t ts_ns, const union cell* cells, union cell* c)
+{
+    // The double the CSV log's "<sec>.<nsec>" text reads back as, so
+    // run_timestep does not depend on the format.
+    char text[32];
+    snprintf(text, sizeof(text), "%" PRId64 ".%09" PRId64, ts_ns / 1000000000, ts_ns % 1000000000);
+    c[0].f = strtod(text, NULL);
+    for (int i = 0; i < L->nfields; i++) {
+        switch (L->role[i]) {
+        case ROLE_RUN:
+            c[1].u = cells[i].u;
+            break;
+        case ROLE_POLICY:
+            c[2].u = (uintptr_t)(cells[i].u < (uint64_t)nlabels ? labels[cells[i].u] : "");
+            break;
+        case ROLE_VALUE:
+            c[L->slot[i]].u = cells[i].u;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void* tsdb_job(void* arg)
+{
+    struct job* j = arg;
+    const struct log_schema* ls = j->ls;
+
+    for (int b = 0; b < j->nblocks; b++) {
+        const struct tsdb_block* blk = &j->blocks[b];
+        union cell* ts = malloc(sizeof(*ts) * (blk->nrows ? blk->nrows : 1));
+        union cell* cells = malloc(sizeof(*cells) * (size_t)(blk->nrows ? blk->nrows : 1) *
+            (ls->ncols ? ls->ncols : 1));
+        if (!ts || !cells || tsdb_decode(ls, blk, ts, cells) != 0) {
+            if (ts && cells)
+                j->bad += blk->nrows;
+            else
+                j->failed = 1;
+            free(ts);
+            free(cells);
+            continue;
+        }
+        for (uint32_t k = 0; k < blk->nrows; k++) {
+            union cell* c = job_row(j);
+            if (!c)
+                break;
+            project(j->L, j->labels, j->nlabels, ts[k].i, cells + (size_t)k * ls->ncols, c);
+            j->nrows++;
+        }
+        free(ts);
+        free(cells);
+    }
+    return NULL;
+}
+
+// --- Inputs ---
+
+// Every input must have the same nodes, so the output has one schema.
+static int same_nodes(const struct layout* a, const struct layout* b)
+{
+    return a->nnodes == b->nnodes && memcmp(a->node_ids, b->node_ids, sizeof(int) * a->nnodes) == 0;
+}
+
+// Rows are only read when the nodes match the first log's (first, if it has
+// any), as the runs' per-node accumulators are sized for those; read_log()
+// reports a mismatch.
+static int read_csv(FILE* fp, const char* path, const struct opts* o, const struct layout* first,
+    struct layout* L, struct runs* R)
+{
+    char* line = NULL;
+    size_t linecap = 0;
+    ssize_t len = getline(&line, &linecap, fp);
+    if (len <= 0) {
+        fprintf(stderr, "%s: empty CSV\n", path);
+        free(line);
+        return -1;
+    }
+    line[strcspn(line, "\r\n")] = '\0';
+
+    int nfields = 1;
+    for (char* p = line; *p; p++)
+        nfields += *p == ',';
+    const char** names = malloc(sizeof(*names) * nfields);
+    if (!names) {
+        free(line);
+        return -1;
+    }
+    int f = 0;
+    for (char* p = line; p; f++) {
+        names[f] = p;
+        p = strchr(p, ',');
+        if (p)
+            *p++ = '\0';
+    }
+    int ret = layout_build(L, nfields, names, o->run_in);
+    free(names);
+    free(line);
+    if (ret != 0)
+        return -1;
+    if (first->nnodes && !same_nodes(first, L))
+        return 0;
+
+    size_t cap = (size_t)o->jobs * CSV_CHUNK;
+    char* buf = malloc(cap + 1);
+    struct job* jobs = calloc(o->jobs, sizeof(*jobs));
+    size_t carry = 0, bad = 0;
+    if (!buf || !jobs) {
+        fprintf(stderr, "Failed to allocate CSV buffers\n");
+        free(buf);
+        free(jobs);
+        return -1;
+    }
+
+    for (;;) {
+        size_t n = fread(buf + carry, 1, cap - carry, fp);
+        size_t total = carry + n;
+        if (total == 0)
+            break;
+        int eof = n < cap - carry;
+
+        // Hand out whole lines only; the tail waits for the next batch.
+        size_t last = total;
+        if (!eof) {
+            while (last > 0 && buf[last - 1] != '\n')
+                last--;
+            if (last == 0) {
+                fprintf(stderr, "%s: line longer than %d MB\n", path, CSV_CHUNK >> 20);
+                ret = -1;
+                break;
+            }
+        }
+        else if (buf[total - 1] != '\n') {
+            buf[total++] = '\n';
+            last = total;
+        }
+
+        char* p = buf;
+        for (int i = 0; i < o->jobs; i++) {
+            char* end = i == o->jobs - 1 ? buf + last : p + (last / o->jobs);
+            if (end > buf + last)
+                end = buf + last;
+            while (end < buf + last && end > buf && end[-1] != '\n')
+                end++;
+            jobs[i].L = L;
+            jobs[i].nrows = 0;
+            jobs[i].begin = p;
+            jobs[i].end = end;
+            p = end;
+        }
+        if (run_jobs(jobs, o->jobs, csv_job) != 0) {
+            ret = -1;
+            break;
+        }
+        for (int i = 0; i < o->jobs && ret == 0; i++) {
+            ret = accumulate(R, L, jobs[i].rows, jobs[i].nrows);
+            bad += jobs[i].bad;
+            jobs[i].bad = 0;
+        }
+        if (ret != 0 || eof)
+            break;
+
+        carry = total - last;
+        memmove(buf, buf + last, carry);
+    }
+
+    if (bad)
+        fprintf(stderr, "%s: skipped %zu lines that are not rows\n", path, bad);
+    for (int i = 0; i < o->jobs; i++)
+        free(jobs[i].rows);
+    free(jobs);
+    free(buf);
+    return ret;
+}
+
+static int schema_layout(const struct log_schema* ls, const struct opts* o, struct layout* L)
+{
+    // The timestamp is implicit in binary logs; give it a name so the
+    // layout finds it, at the end where it maps to no cell.
+    const char** names = malloc(sizeof(*names) * (ls->ncols + 1));
+    if (!names)
+        return -1;
+    for (int i = 0; i < ls->ncols; i++)
+        names[i] = ls->names[i];
+    names[ls->ncols] = "timestamp";
+    int ret = layout_build(L, ls->ncols + 1, names, o->run_in);
+    free(names);
+    if (ret == 0)
+        L->nfields = ls->ncols;
+    return ret;
+}
+
+static int read_bin(FILE* fp, const struct log_schema* ls, const struct layout* L, struct runs* R,
+    const char* const* labels, int nlabels, const char* path)
+{
+    size_t record_size = bin_record_size(ls);
+    unsigned char* records = malloc(record_size * BIN_BATCH);
+    union cell* cells = malloc(sizeof(union cell) * (ls->ncols ? ls->ncols : 1));
+    union cell* rows = malloc(sizeof(union cell) * L->stride * BIN_BATCH);
+    int ret = 0;
+    if (!records || !cells || !rows) {
+        fprintf(stderr, "Failed to allocate record buffers\n");
+        ret = -1;
+    }
+
+    size_t n;
+    while (ret == 0 && (n = fread(records, 1, record_size * BIN_BATCH, fp)) > 0) {
+        size_t nrec = n / record_size;
+        for (size_t k = 0; k < nrec; k++) {
+            int64_t ts_ns;
+            bin_decode_record(ls, records + k * record_size, &ts_ns, cells);
+            project(L, labels, nlabels, ts_ns, cells, rows + k * L->stride);
+        }
+        ret = accumulate(R, L, rows, nrec);
+        if (n % record_size) {
+            fprintf(stderr, "%s: ignoring truncated last record\n", path);
+            break;
+        }
+    }
+
+    free(records);
+    free(cells);
+    free(rows);
+    return ret;
+}
+
+static int read_tsdb(FILE* fp, const struct log_schema* ls, const struct layout* L, struct runs* R,
+    const char* const* labels, int nlabels, const struct opts* o)
+{
+    int per_batch = o->jobs * TSDB_BATCH;
+    struct tsdb_block* blocks = calloc(per_batch, sizeof(*blocks));
+    struct job* jobs = calloc(o->jobs, sizeof(*jobs));
+    int ret = 0, done = 0;
+    if (!blocks || !jobs) {
+        fprintf(stderr, "Failed to allocate block buffers\n");
+        ret = -1;
+        done = 1;
+    }
+
+    while (!done) {
+        int nb = 0;
+        while (nb < per_batch) {
+            int r = tsdb_read_block(fp, ls, &blocks[nb], 1);
+            if (r < 0)
+                ret = -1;
+            if (r != 1) {
+                done = 1;
+                break;
+            }
+            nb++;
+        }
+
+        int per_job = (nb + o->jobs - 1) / o->jobs;
+        for (int i = 0; i < o->jobs; i++) {
+            int first = i * per_job < nb ? i * per_job : nb;
+            int count = first + per_job <= nb ? per_job : nb - first;
+            jobs[i] = (struct job){ .L = L, .rows = jobs[i].rows, .cap = jobs[i].cap, .ls = ls,
+                .blocks = blocks + first, .nblocks = count, .labels = labels, .nlabels = nlabels };
+        }
+        if (nb && run_jobs(jobs, o->jobs, tsdb_job) != 0) {
+            ret = -1;
+            break;
+        }
+        for (int i = 0; i < o->jobs && nb && ret == 0; i++) {
+            if (jobs[i].bad) {
+                fprintf(stderr, "Corrupt tsdb block\n");
+                ret = -1;
+            }
+            else
+                ret = accumulate(R, L, jobs[i].rows, jobs[i].nrows);
+        }
+        if (ret != 0)
+            break;
+    }
+
+    for (int i = 0; blocks && i < per_batch; i++)
+        tsdb_block_free(&blocks[i]);
+    for (int i = 0; jobs && i < o->jobs; i++)
+        free(jobs[i].rows);
+    free(blocks);
+    free(jobs);
+    return ret;
+}
+
+static int read_log(const char* path, const struct opts* o, struct layout* first, struct runs* R)
+{
+    int from_stdin = strcmp(path, "-") == 0;
+    FILE* fp = from_stdin ? stdin : fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    // Binary logs start with their magic ("NUMA..."), CSV logs with
+    // "timestamp".
+    int c = getc(fp);
+    ungetc(c, fp);
+
+    struct layout L;
+    int ret;
+    if (c != 'N') {
+        ret = read_csv(fp, path, o, first, &L, R);
+    }
+    else {
+        struct log_schema ls;
+        char magic[8];
+        if (log_read_header(fp, &ls, magic) != 0) {
+            if (!from_stdin)
+                fclose(fp);
+            return -1;
+        }
+        char labels_path[4096];
+        snprintf(labels_path, sizeof(labels_path), "%s.labels", path);
+        ret = from_stdin ? 0 : log_labels_load(&ls, labels_path);
+
+        const char* labels[LOG_LABELS_MAX];
+        for (int i = 0; i < ls.nlabels; i++)
+            labels[i] = ls.labels[i];
+
+        if (ret == 0)
+            ret = schema_layout(&ls, o, &L);
+        if (ret == 0 && (!first->nnodes || same_nodes(first, &L)))
+            ret = memcmp(magic, TSDB_MAGIC, 8) == 0 ? read_tsdb(fp, &ls, &L, R, labels, ls.nlabels, o)
+                                                    : read_bin(fp, &ls, &L, R, labels, ls.nlabels, path);
+        log_schema_free(&ls);
+    }
+
+    if (ret == 0 && first->nnodes && !same_nodes(first, &L)) {
+        fprintf(stderr, "%s: logs a different set of nodes than the first log\n", path);
+        ret = -1;
+    }
+    if (ret == 0 && !first->nnodes)
+        *first = L;
+    else
+        layout_free(&L);
+    if (!from_stdin)
+        fclose(fp);
+    return ret;
+}
+
+// --- Output ---
+
+// Floats as Python's repr() writes them (pandas to_csv): the shortest
+// digits that read back exactly, positional notation for exponents -4 to
+// 15, and ".0" on whole numbers. NaN is an empty field.
+static void put_double(FILE* out, double x)
+{
+    if (isnan(x))
+        return;
+    if (isinf(x)) {
+        fputs(x > 0 ? "inf" : "-inf", out);
+        return;
+    }
+
+    char buf[64];
+    int prec = 1;
+    for (; prec < 17; prec++) {
+        snprintf(buf, sizeof(buf), "%.*e", prec - 1, x);
+        if (strtod(buf, NULL) == x)
+            break;
+    }
+    snprintf(buf, sizeof(buf), "%.*e", prec - 1, x);
+    int exp = atoi(strchr(buf, 'e') + 1);
+
+    if (exp < -4 || exp >= 16) {
+        fputs(buf, out);
+        return;
+    }
+    int decimals = prec - 1 - exp;
+    snprintf(buf, sizeof(buf), "%.*f", decimals > 0 ? decimals : 0, x);
+    fputs(buf, out);
+    if (!strchr(buf, '.'))
+        fputs(".0", out);
+}
+
+static void policy_norm(const char* in, char* out, size_t len)
+{
+    while (isspace((unsigned char)*in))
+        in++;
+    size_t n = 0;
+    for (; in[n] && n + 1 < len; n++)
+        out[n] = (char)tolower((unsigned char)in[n]);
+    while (n > 0 && isspace((unsigned char)out[n - 1]))
+        n--;
+    out[n] = '\0';
+}
+
+static int is_any(const char* s, const char* const* names)
+{
+    for (; *names; names++)
+        if (strcmp(s, *names) == 0)
+            return 1;
+    return 0;
+}
+
+static int is_preferred(const char* s, int node)
+{
+    static const char* const forms[] = { "preferred_node%d", "preferred_%d", "preferred%d", "preferred-%d" };
+    char name[64];
+    for (size_t i = 0; i < sizeof(forms) / sizeof(forms[0]); i++) {
+        snprintf(name, sizeof(name), forms[i], node);
+        if (strcmp(s, name) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static void write_features(FILE* out, const struct layout* L, const struct runs* R, const char* run_out)
+{
+    static const char* const per_node[] = {
+        "usage", "trend", "min_usage", "max_usage", "volatility", "free_pages_change",
+    };
+    static const char* const first_touch[] = { "default", "first_touch", "first-touch", "firsttouch", NULL };
+    static const char* const interleave[] = { "interleave", "interleave_all", "interleave-all", NULL };
+
+    fprintf(out, "%s,run_timestep", run_out);
+    for (int k = 0; k < 6; k++)
+        for (int n = 0; n < L->nnodes; n++)
+            fprintf(out, ",node_%d_%s", L->node_ids[n], per_node[k]);
+    fprintf(out, ",total_page_migrations,first-touch,interleave");
+    for (int n = 0; n < L->nnodes; n++)
+        fprintf(out, ",preferred_%d", L->node_ids[n]);
+    fprintf(out, "\n");
+
+    for (size_t i = 0; i < R->n; i++) {
+        const struct run* r = R->v[i];
+        fprintf(out, "%" PRIu64 ",", r->key);
+        put_double(out, r->ts_last - r->ts_min);
+
+        for (int k = 0; k < 6; k++) {
+            for (int n = 0; n < L->nnodes; n++) {
+                const struct rolling* u = &r->usage[n];
+                fputc(',', out);
+                switch (k) {
+                case 0: put_double(out, u->last); break;
+                case 1: put_double(out, u->last - u->first); break;
+                case 2: put_double(out, u->min); break;
+                case 3: put_double(out, u->max); break;
+                case 4: put_double(out, rolling_std(u)); break;
+                default:
+                    fprintf(out, "%" PRId64, (int64_t)(r->free_last[n] - r->free_first[n]));
+                    break;
+                }
+            }
+        }
+
+        char policy[LOG_NAME_MAX];
+        policy_norm(r->policy, policy, sizeof(policy));
+        fprintf(out, ",%" PRId64 ",%d,%d", (int64_t)(r->mig_last - r->mig_first),
+            is_any(policy, first_touch), is_any(policy, interleave));
+        for (int n = 0; n < L->nnodes; n++)
+            fprintf(out, ",%d", is_preferred(policy, L->node_ids[n]));
+        fprintf(out, "\n");
+    }
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-j <threads>] [--run-column <name>[=<output name>]] [--output <csv>] <log|->...\n"
+        "\n"
+        "Computes the features of preprocess_stream_log.py / preprocess_rocksdb_log.py in\n"
+        "one pass: one row per run with run_timestep and, for every node, usage, trend,\n"
+        "min/max usage, volatility and free_pages_change, then total_page_migrations and\n"
+        "the policy one-hots (first-touch, interleave, preferred_N per node).\n"
+        "\n"
+        "Logs are CSV, --format bin or --format tsdb, read in the order given; a run that\n"
+        "continues in the next log is one run.\n"
+        "  -j <threads>        parser/decoder threads (default: online CPUs)\n"
+        "  --run-column <name> run number column (default run_index, or stream_run if\n"
+        "                      the log has that); =<output name> renames it, e.g.\n"
+        "                      stream_run=runs for the STREAM script's output\n"
+        "  --output <csv>      write here instead of stdout\n",
+        prog);
+}
+
+// Pick run_index, falling back to stream_run if the first log has that.
+static const char* guess_run_column(const char* path)
+{
+    FILE* fp = strcmp(path, "-") == 0 ? NULL : fopen(path, "rb");
+    if (!fp)
+        return "run_index";
+
+    struct log_schema ls;
+    char magic[8];
+    const char* col = "run_index";
+    int c = getc(fp);
+    ungetc(c, fp);
+    if (c == 'N') {
+        if (log_read_header(fp, &ls, magic) == 0) {
+            for (int i = 0; i < ls.ncols; i++)
+                if (strcmp(ls.names[i], "stream_run") == 0)
+                    col = "stream_run";
+            log_schema_free(&ls);
+        }
+    }
+    else {
+        char line[65536];
+        if (fgets(line, sizeof(line), fp) && !strstr(line, ",run_index") && strstr(line, ",stream_run"))
+            col = "stream_run";
+    }
+    fclose(fp);
+    return col;
+}
+
+int main(int argc, char* argv[])
+{
+    struct opts o = { .jobs = (int)sysconf(_SC_NPROCESSORS_ONLN) };
+    const char* output = NULL;
+    char run_in[LOG_NAME_MAX] = "";
+    int first_log = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            o.jobs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--run-column") == 0 && i + 1 < argc) {
+            const char* spec = argv[++i];
+            const char* eq = strchr(spec, '=');
+            snprintf(run_in, sizeof(run_in), "%.*s", eq ? (int)(eq - spec) : (int)strlen(spec), spec);
+            o.run_out = eq ? eq + 1 : NULL;
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (argv[i][0] != '-' || strcmp(argv[i], "-") == 0) {
+            first_log = i;
+            break;
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!first_log || o.jobs <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (o.jobs > 256)
+        o.jobs = 256;
+
+    o.run_in = run_in[0] ? run_in : guess_run_column(argv[first_log]);
+    if (!o.run_out || !*o.run_out)
+        o.run_out = o.run_in;
+
+    struct layout L = { 0 };
+    struct runs R = { 0 };
+    int ret = 0;
+    for (int i = first_log; i < argc && ret == 0; i++)
+        ret = read_log(argv[i], &o, &L, &R);
+
+    if (ret == 0) {
+        FILE* out = output ? fopen(output, "w") : stdout;
+        if (!out) {
+            perror(output);
+            ret = -1;
+        }
+        else {
+            runs_in_log_order(&R);
+            write_features(out, &L, &R, o.run_out);
+            if (output && fclose(out) != 0) {
+                perror(output);
+                ret = -1;
+            }
+        }
+    }
+
+    runs_free(&R, &L);
+    layout_free(&L);
+    return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""
+Read the live rows a numa_stat_logger publishes with --shm <name>.
+
+The segment /dev/shm/<name> holds the schema and a ring of the latest rows,
+each guarded by a sequence number (see shm.h). Reading it is a plain memory
+access on a mapping: no syscalls, no text parsing and no cost to the logger.
+
+    import numa_stat_shm
+    shm = numa_stat_shm.ShmReader("numa")
+    row = shm.latest()          # {"timestamp": ..., "node_0_mem_used": ...}
+
+or, on the command line:
+
+    python3 numa_stat_shm.py numa             # latest row, one column per line
+    python3 numa_stat_shm.py numa --follow    # every new row as CSV
+"""
+
+from __future__ import annotations
+
+import argparse
+import mmap
+import os
+import struct
+import sys
+import time
+from pathlib import Path
+from typing import Dict, Iterator, List, Optional, Tuple
+
+MAGIC = b"NUMASHM1"
+VERSION = 1
+HEADER = struct.Struct("=8sIIIIIIIIiI")
+PUBLISHED = struct.Struct("=Q")
+PUBLISHED_OFFSET = 64
+NLABELS = struct.Struct("=I")
+NLABELS_OFFSET = 72
+COLUMN_SIZE = 128
+LABEL_SIZE = 128
+CELL_FORMATS = ("Q", "q", "d", "Q")
+CELL_LABEL = 3
+
+
+class ShmReader:
+    """A read-only mapping of a logger's --shm segment."""
+
+    def __init__(self, name: str) -> None:
+        path = Path("/dev/shm") / name.lstrip("/")
+        with open(path, "rb") as fh:
+            self.map = mmap.mmap(fh.fileno(), 0, prot=mmap.PROT_READ)
+
+        (magic, version, header_size, ncols, self.node_count, self.slot_size,
+         self.nslots, columns_offset, self.labels_offset, self.pid, _) = \
+            HEADER.unpack_from(self.map, 0)
+        if magic != MAGIC or version != VERSION or self.nslots == 0:
+            raise ValueError(f"{path}: not a numa_stat_logger shared-memory export")
+
+        self.header_size = header_size
+        self.columns: List[str] = []
+        types = []
+        for i in range(ncols):
+            pos = columns_offset + i * COLUMN_SIZE
+            types.append(self.map[pos])
+            raw = self.map[pos + 2:pos + COLUMN_SIZE]
+            self.columns.append(raw.split(b"\0", 1)[0].decode("utf-8"))
+        self.label_columns = [i for i, t in enumerate(types) if t == CELL_LABEL]
+        self.row = struct.Struct("=Qq" + "".join(CELL_FORMATS[t] for t in types))
+        self.labels: List[str] = []
+
+    def published(self) -> int:
+        """Rows published so far; the newest one is published() - 1."""
+        return PUBLISHED.unpack_from(self.map, PUBLISHED_OFFSET)[0]
+
+    def read(self, n: int) -> Optional[Tuple[int, tuple]]:
+        """(timestamp_ns, values) of row n, or None if it is gone or not there yet."""
+        pos = self.header_size + (n % self.nslots) * self.slot_size
+        seq, ts_ns, *values = self.row.unpack_from(self.map, pos)
+        if seq != 2 * n + 2 or PUBLISHED.unpack_from(self.map, pos)[0] != seq:
+            return None
+        return ts_ns, tuple(values)
+
+    def label(self, index: int) -> str:
+        """Text of a label cell (session mode mem_policy)."""
+        if index >= len(self.labels):
+            count = NLABELS.unpack_from(self.map, NLABELS_OFFSET)[0]
+            for i in range(len(self.labels), count):
+                pos = self.labels_offset + i * LABEL_SIZE
+                raw = self.map[pos:pos + LABEL_SIZE]
+                self.labels.append(raw.split(b"\0", 1)[0].decode("utf-8"))
+        return self.labels[index] if index < len(self.labels) else str(index)
+
+    def as_dict(self, ts_ns: int, values: tuple) -> Dict[str, object]:
+        row: Dict[str, object] = {"timestamp": ts_ns / 1e9}
+        row.update(zip(self.columns, values))
+        for i in self.label_columns:
+            row[self.columns[i]] = self.label(values[i])
+        return row
+
+    def latest(self) -> Optional[Dict[str, object]]:
+        """The newest row, or None before the first one."""
+        while True:
+            n = self.published()
+            if n == 0:
+                return None
+            got = self.read(n - 1)
+            if got is not None:
+                return self.as_dict(*got)
+
+    def follow(self, poll_sec: float = 0.001) -> Iterator[Dict[str, object]]:
+        """Yield every row from the oldest one still in the ring, then new
+        rows as they come, until the logger exits."""
+        n = max(self.published() - self.nslots, 0)
+        while True:
+            published = self.published()
+            if n == published:
+                if not _alive(self.pid):
+                    return
+                time.sleep(poll_sec)
+                continue
+            n = max(n, published - self.nslots)
+            got = self.read(n)
+            n += 1
+            if got is not None:
+                yield self.as_dict(*got)
+
+
+def _alive(pid: int) -> bool:
+    try:
+        os.kill(pid, 0)
+    except ProcessLookupError:
+        return False
+    except PermissionError:
+        pass
+    return True
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description="Read the live rows of a numa_stat_logger --shm segment."
+    )
+    parser.add_argument("name", help="Segment name given to --shm.")
+    parser.add_argument(
+        "--follow",
+        action="store_true",
+        help="Print every new row as CSV until the logger exits.",
+    )
+    return parser.parse_args()
+
+
+def main() -> int:
+    args = parse_args()
+    shm = ShmReader(args.name)
+    if not args.follow:
+        row = shm.latest()
+        if row is None:
+            print("no rows yet", file=sys.stderr)
+            return 1
+        for name, value in row.items():
+            print(f"{name} {value}")
+        return 0
+
+    print(",".join(["timestamp"] + shm.columns), flush=True)
+    for row in shm.follow():
+        print(",".join(str(v) for v in row.values()), flush=True)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
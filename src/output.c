@@ -0,0 +1,214 @@
+#include "output.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#define STDIO_BUFFER (1 << 20)
+
+int output_parse_format(const char* name, enum output_format* format)
+{
+    if (strcmp(name, "csv") == 0)
+        *format = OUTPUT_CSV;
+    else if (strcmp(name, "bin") == 0)
+        *format = OUTPUT_BIN;
+    else if (strcmp(name, "tsdb") == 0)
+        *format = OUTPUT_TSDB;
+    else {
+        fprintf(stderr, "Unknown --format '%s' (expected csv, bin or tsdb)\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+const char* output_default_path(enum output_format format)
+{
+    if (format == OUTPUT_TSDB)
+        return "numa_stat_log.tsdb";
+    return format == OUTPUT_BIN ? "numa_stat_log.bin" : "numa_stat_log.csv";
+}
+
+// Open the file for writing, through the compressor if there is one.
+static FILE* open_file(struct output* o, const char* path, const char* mode)
+{
+    FILE* raw = fopen(path, mode);
+    if (!raw) {
+        perror(mode[0] == 'a' ? "fopen append" : "fopen");
+        return NULL;
+    }
+
+    FILE* fp = raw;
+    if (o->zspec.kind != COMPRESS_NONE) {
+        fp = compress_open(&o->z, raw, &o->zspec);
+        if (!fp) {
+            fclose(raw);
+            return NULL;
+        }
+    }
+    setvbuf(fp, NULL, _IOFBF, STDIO_BUFFER);
+    return fp;
+}
+
+// 1 if path exists and is not empty.
+static int has_data(const char* path, FILE** keep)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return 0;
+    int c = fgetc(fp);
+    if (keep && c != EOF) {
+        rewind(fp);
+        *keep = fp;
+        return 1;
+    }
+    fclose(fp);
+    return c != EOF;
+}
+
+// A crash can leave half a record at the end of a binary log; records
+// appended after it would all be read shifted. Cut the log back to its
+// last whole record first.
+static int drop_partial_record(const char* path, long header, size_t record_size)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        perror(path);
+        return -1;
+    }
+    off_t extra = (st.st_size - header) % (off_t)record_size;
+    if (extra == 0)
+        return 0;
+    fprintf(stderr, "%s: dropping a truncated last record (%lld bytes) before appending\n",
+        path, (long long)extra);
+    if (truncate(path, st.st_size - extra) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+// The header is only written when the file does not exist yet; later runs
+// append to it. A binary or tsdb log must have been written with the same
+// schema.
+// Compressed logs are appended to as new frames.
+static int open_csv(struct output* o, const char* path)
+{
+    int append = o->zspec.kind == COMPRESS_NONE ? access(path, F_OK) == 0 : has_data(path, NULL);
+
+    o->fp = open_file(o, path, append ? "a" : "w");
+    if (!o->fp)
+        return -1;
+    if (!append) {
+        csv_write_header(o->fp, o->ls);
+        output_flush(o);
+    }
+    return 0;
+}
+
+static int open_bin(struct output* o, const char* path, const char* magic)
+{
+    FILE* fp = NULL;
+    if (has_data(path, &fp)) {
+        if (o->zspec.kind != COMPRESS_NONE) {
+            fclose(fp);
+            fprintf(stderr, "%s exists; compressed binary logs cannot be appended to\n", path);
+            return -1;
+        }
+        int ok = log_header_matches(fp, o->ls, magic);
+        long header = ftell(fp);
+        fclose(fp);
+        if (!ok) {
+            fprintf(stderr, "%s exists with a different column schema\n", path);
+            return -1;
+        }
+        if (strcmp(magic, BIN_MAGIC) == 0 && drop_partial_record(path, header, bin_record_size(o->ls)) != 0)
+            return -1;
+        o->fp = open_file(o, path, "ab");
+        return o->fp ? 0 : -1;
+    }
+
+    o->fp = open_file(o, path, "wb");
+    if (!o->fp)
+        return -1;
+    if (log_write_header(o->fp, o->ls, magic) != 0) {
+        perror("write header");
+        return -1;
+    }
+    return 0;
+}
+
+int output_open(struct output* o, enum output_format format, const char* path,
+    const struct log_schema* ls, const struct output_opts* opt)
+{
+    memset(o, 0, sizeof(*o));
+    o->format = format;
+    o->ls = ls;
+    if (opt)
+        o->zspec = opt->z;
+
+    if (format == OUTPUT_CSV)
+        return open_csv(o, path);
+
+    if (format == OUTPUT_TSDB) {
+        if (tsdb_writer_init(&o->tsdb, ls, opt ? opt->block_rows : 0) != 0) {
+            fprintf(stderr, "Failed to allocate tsdb block buffer\n");
+            return -1;
+        }
+        return open_bin(o, path, TSDB_MAGIC);
+    }
+
+    o->record_size = bin_record_size(ls);
+    o->record = malloc(o->record_size);
+    if (!o->record) {
+        fprintf(stderr, "Failed to allocate output record\n");
+        return -1;
+    }
+    return open_bin(o, path, BIN_MAGIC);
+}
+
+void output_write(struct output* o, const struct record* rec)
+{
+    if (o->format == OUTPUT_CSV) {
+        csv_write_row(o->fp, o->ls, rec->ts_ns, rec->cells);
+    }
+    else if (o->format == OUTPUT_TSDB) {
+        tsdb_append(&o->tsdb, o->fp, rec->ts_ns, rec->cells);
+    }
+    else {
+        bin_encode_record(o->ls, rec->ts_ns, rec->cells, o->record);
+        fwrite(o->record, 1, o->record_size, o->fp);
+    }
+
+    if (o->zspec.kind != COMPRESS_NONE && ++o->frame_rows >= o->zspec.frame_rows) {
+        o->frame_rows = 0;
+        output_flush(o);
+    }
+    else if (o->flush_each_row) {
+        fflush(o->fp);
+    }
+}
+
+// Push buffered rows to the file. A compressed log is only readable up to
+// its last closed frame, which ends here once frame_rows rows are in it.
+void output_flush(struct output* o)
+{
+    fflush(o->fp);
+    if (o->zspec.kind != COMPRESS_NONE && o->frame_rows == 0)
+        compress_end_frame(&o->z);
+}
+
+void output_close(struct output* o)
+{
+    if (o->fp) {
+        if (o->format == OUTPUT_TSDB)
+            tsdb_flush(&o->tsdb, o->fp);
+        fclose(o->fp);
+    }
+    tsdb_writer_free(&o->tsdb);
+    free(o->record);
+    o->fp = NULL;
+    o->record = NULL;
+}
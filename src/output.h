@@ -0,0 +1,52 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+
+#include "cell.h"
+#include "compress.h"
+#include "logfmt.h"
+#include "tsdb.h"
+
+enum output_format {
+    OUTPUT_CSV,
+    OUTPUT_BIN,
+    OUTPUT_TSDB,
+};
+
+struct output_opts {
+    struct compress_spec z;
+    uint32_t block_rows;    // tsdb rows per block, 0 for the default
+};
+
+// The logger's output file. Rows go through a large stdio buffer and are
+// written out by output_flush(), or after every row with flush_each_row.
+// With compression the writer thread also does the compressing.
+struct output {
+    enum output_format format;
+    int flush_each_row;
+    FILE* fp;
+    const struct log_schema* ls;
+    unsigned char* record;
+    size_t record_size;
+
+    // --compress: rows go through the compressor, which closes a frame
+    // every zspec.frame_rows rows.
+    struct compress_spec zspec;
+    struct compressor z;
+    uint64_t frame_rows;
+
+    // --format tsdb: rows are buffered into blocks, written when full, when
+    // a key column changes and at close.
+    struct tsdb_writer tsdb;
+};
+
+int output_parse_format(const char* name, enum output_format* format);
+const char* output_default_path(enum output_format format);
+int output_open(struct output* o, enum output_format format, const char* path,
+    const struct log_schema* ls, const struct output_opts* opt);
+void output_write(struct output* o, const struct record* rec);
+void output_flush(struct output* o);
+void output_close(struct output* o);
+
+#endif
@@ -0,0 +1,431 @@
+#define _GNU_SOURCE
+#include "perf.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include "cpulist.h"
+
+#define PMU_ROOT "/sys/bus/event_source/devices"
+
+struct perf_event_def {
+    char name[48];
+    char pmu[64];
+    char terms[256];
+};
+
+// Events of one PMU instance on one CPU, read together.
+struct perf_group {
+    int node;
+    int leader;
+    int nevents;
+    int event[PERF_MAX_EVENTS];    // definition of each member, in read order
+    int fds[PERF_MAX_EVENTS];
+
+    // Raw counts and times of the last good read, which rates are taken
+    // against.
+    uint64_t prev_value[PERF_MAX_EVENTS];
+    uint64_t prev_enabled;
+    uint64_t prev_running;
+    int64_t prev_ns;
+};
+
+struct perf {
+    int nnodes;
+    int nevents;
+    struct perf_event_def defs[PERF_MAX_EVENTS];
+    int ngroups;
+    struct perf_group* groups;
+    uint64_t buf[3 + PERF_MAX_EVENTS];
+    double* total;      // nnodes x nevents rates of this row
+    unsigned char* stale;   // a group of the column could not be read
+    double* prev;       // the previous row
+};
+
+static const char* const presets[][2] = {
+    { "remote-dram", "local_dram=cpu/event=0xd3,umask=0x01/" },
+    { "remote-dram", "remote_dram=cpu/event=0xd3,umask=0x02/" },
+};
+
+static int64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int read_line(const char* path, char* out, size_t size)
+{
+    FILE* fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    int ok = fgets(out, (int)size, fp) != NULL;
+    fclose(fp);
+    if (!ok)
+        return -1;
+    out[strcspn(out, "\n")] = '\0';
+    return 0;
+}
+
+static int parse_def(const char* spec, struct perf_event_def* d)
+{
+    const char* eq = strchr(spec, '=');
+    const char* slash = eq ? strchr(eq + 1, '/') : NULL;
+    size_t len = strlen(spec);
+    if (!eq || !slash || eq == spec || (size_t)(eq - spec) >= sizeof(d->name) ||
+        (size_t)(slash - eq - 1) >= sizeof(d->pmu) || len < 2 || spec[len - 1] != '/' ||
+        spec + len - 1 == slash) {
+        fprintf(stderr, "Invalid --perf event '%s' (expected <name>=<pmu>/<terms>/)\n", spec);
+        return -1;
+    }
+    for (const char* p = spec; p < eq; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '_') {
+            fprintf(stderr, "Invalid --perf event name in '%s'\n", spec);
+            return -1;
+        }
+    }
+    snprintf(d->name, sizeof(d->name), "%.*s", (int)(eq - spec), spec);
+    snprintf(d->pmu, sizeof(d->pmu), "%.*s", (int)(slash - eq - 1), eq + 1);
+    snprintf(d->terms, sizeof(d->terms), "%.*s", (int)(spec + len - 1 - slash - 1), slash + 1);
+    return 0;
+}
+
+// Scatter the bits of value into the config word fields named by a format
+// file, e.g. "config:0-7,21" or "config1:0-63".
+static int apply_format(const char* format, uint64_t value, struct perf_event_attr* attr)
+{
+    __u64* word;
+    if (strncmp(format, "config:", 7) == 0)
+        word = &attr->config;
+    else if (strncmp(format, "config1:", 8) == 0)
+        word = &attr->config1;
+    else if (strncmp(format, "config2:", 8) == 0)
+        word = &attr->config2;
+    else
+        return -1;
+    const char* p = strchr(format, ':') + 1;
+
+    while (*p) {
+        char* end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (end == p)
+            return -1;
+        if (*end == '-')
+            hi = strtol(end + 1, &end, 10);
+        if (lo < 0 || hi > 63 || hi < lo)
+            return -1;
+        for (long bit = lo; bit <= hi; bit++, value >>= 1)
+            if (value & 1)
+                *word |= 1ULL << bit;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return 0;
+}
+
+// Fill attr->config* from "term=value,..." for one PMU instance. A term
+// without a value is an alias from events/, which is expanded in place.
+static int apply_terms(const char* pmu, const char* terms, struct perf_event_attr* attr, int depth)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", terms);
+
+    char* save;
+    for (char* term = strtok_r(buf, ",", &save); term; term = strtok_r(NULL, ",", &save)) {
+        char path[512], line[256];
+        char* eq = strchr(term, '=');
+        if (!eq) {
+            snprintf(path, sizeof(path), PMU_ROOT "/%s/events/%s", pmu, term);
+            if (depth > 0 || read_line(path, line, sizeof(line)) != 0 ||
+                apply_terms(pmu, line, attr, depth + 1) != 0) {
+                fprintf(stderr, "Unknown event '%s' on PMU %s\n", term, pmu);
+                return -1;
+            }
+            continue;
+        }
+
+        *eq = '\0';
+        uint64_t value = strtoull(eq + 1, NULL, 0);
+        if (strcmp(term, "config") == 0)
+            attr->config |= value;
+        else if (strcmp(term, "config1") == 0)
+            attr->config1 |= value;
+        else if (strcmp(term, "config2") == 0)
+            attr->config2 |= value;
+        else {
+            snprintf(path, sizeof(path), PMU_ROOT "/%s/format/%s", pmu, term);
+            if (read_line(path, line, sizeof(line)) != 0 || apply_format(line, value, attr) != 0) {
+                fprintf(stderr, "Unknown term '%s' on PMU %s\n", term, pmu);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// pmu itself, or its numbered instances (uncore_imc -> uncore_imc_0, ...).
+static int is_instance(const char* dev, const char* pmu)
+{
+    size_t n = strlen(pmu);
+    if (strcmp(dev, pmu) == 0)
+        return 1;
+    if (strncmp(dev, pmu, n) != 0 || dev[n] != '_' || !dev[n + 1])
+        return 0;
+    for (const char* p = dev + n + 1; *p; p++)
+        if (!isdigit((unsigned char)*p))
+            return 0;
+    return 1;
+}
+
+static int open_group(struct perf* pf, const char* dev, int type, int cpu, int node,
+    const int* defs, int ndefs)
+{
+    struct perf_group* g = &pf->groups[pf->ngroups];
+    memset(g, 0, sizeof(*g));
+    g->node = node;
+    g->leader = -1;
+
+    for (int k = 0; k < ndefs; k++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = (uint32_t)type;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.disabled = g->leader < 0;
+        if (apply_terms(dev, pf->defs[defs[k]].terms, &attr, 0) != 0)
+            return -1;
+
+        int fd = (int)syscall(SYS_perf_event_open, &attr, -1, cpu, g->leader, PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "perf_event_open %s on %s, CPU %d: %s%s\n", pf->defs[defs[k]].name, dev, cpu,
+                strerror(errno),
+                errno == EACCES || errno == EPERM ? " (needs CAP_PERFMON or kernel.perf_event_paranoid <= 0)" : "");
+            for (int j = 0; j < g->nevents; j++)
+                close(g->fds[j]);
+            return -1;
+        }
+        if (g->leader < 0)
+            g->leader = fd;
+        g->event[g->nevents] = defs[k];
+        g->fds[g->nevents++] = fd;
+    }
+    pf->ngroups++;
+    return 0;
+}
+
+// One group per instance of the PMU and CPU on a logged node.
+static int open_pmu(struct perf* pf, const char* pmu, const int* defs, int ndefs,
+    const cpu_set_t* node_sets, const struct node_set* nodes)
+{
+    DIR* dir = opendir(PMU_ROOT);
+    if (!dir) {
+        perror(PMU_ROOT);
+        return -1;
+    }
+
+    int found = 0, ret = 0;
+    struct dirent* de;
+    while (ret == 0 && (de = readdir(dir)) != NULL) {
+        if (!is_instance(de->d_name, pmu))
+            continue;
+        found = 1;
+
+        char path[512], line[64];
+        snprintf(path, sizeof(path), PMU_ROOT "/%s/type", de->d_name);
+        if (read_line(path, line, sizeof(line)) != 0) {
+            perror(path);
+            ret = -1;
+            break;
+        }
+        int type = atoi(line);
+
+        // Uncore PMUs list the CPUs to count on; core PMUs count everywhere.
+        cpu_set_t cpus;
+        snprintf(path, sizeof(path), PMU_ROOT "/%s/cpumask", de->d_name);
+        int ncpus = cpulist_read(path, &cpus);
+        if (ncpus <= 0) {
+            snprintf(path, sizeof(path), PMU_ROOT "/%s/cpus", de->d_name);
+            ncpus = cpulist_read(path, &cpus);
+        }
+
+        for (int cpu = 0; ret == 0 && cpu < CPU_SETSIZE; cpu++) {
+            if (ncpus > 0 && !CPU_ISSET(cpu, &cpus))
+                continue;
+            for (int i = 0; i < nodes->count; i++) {
+                if (!CPU_ISSET(cpu, &node_sets[i]))
+                    continue;
+                struct perf_group* groups = realloc(pf->groups, sizeof(*groups) * (pf->ngroups + 1));
+                if (!groups) {
+                    ret = -1;
+                    break;
+                }
+                pf->groups = groups;
+                ret = open_group(pf, de->d_name, type, cpu, i, defs, ndefs);
+                break;
+            }
+        }
+    }
+    closedir(dir);
+
+    if (!found) {
+        fprintf(stderr, "No PMU named %s under " PMU_ROOT "\n", pmu);
+        return -1;
+    }
+    return ret;
+}
+
+static void perf_sample(struct collector* c, union cell* out)
+{
+    struct perf* pf = c->priv;
+    int n = pf->nnodes * pf->nevents;
+    int64_t now = monotonic_ns();
+
+    memset(pf->total, 0, sizeof(double) * n);
+    memset(pf->stale, 0, n);
+    for (int i = 0; i < pf->ngroups; i++) {
+        struct perf_group* g = &pf->groups[i];
+        ssize_t want = (ssize_t)sizeof(uint64_t) * (3 + g->nevents);
+        int ok = read(g->leader, pf->buf, want) == want && now > g->prev_ns;
+        uint64_t enabled = ok ? pf->buf[1] - g->prev_enabled : 0;
+        uint64_t running = ok ? pf->buf[2] - g->prev_running : 0;
+
+        // Not read, or not scheduled at all since the last read: its
+        // columns repeat their previous value, and the next good read
+        // covers the whole gap.
+        if (!running) {
+            for (int k = 0; k < g->nevents; k++)
+                pf->stale[g->node * pf->nevents + g->event[k]] = 1;
+            continue;
+        }
+
+        // Per second, scaled up by enabled / running of this interval when
+        // the kernel multiplexed the group with other users of the PMU.
+        double scale = (double)enabled / (double)running / ((double)(now - g->prev_ns) / 1e9);
+        for (int k = 0; k < g->nevents; k++) {
+            pf->total[g->node * pf->nevents + g->event[k]] += (double)(pf->buf[3 + k] - g->prev_value[k]) * scale;
+            g->prev_value[k] = pf->buf[3 + k];
+        }
+        g->prev_enabled = pf->buf[1];
+        g->prev_running = pf->buf[2];
+        g->prev_ns = now;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (!pf->stale[i])
+            pf->prev[i] = pf->total[i];
+        out[i].f = pf->prev[i];
+    }
+}
+
+static void perf_destroy(struct collector* c)
+{
+    struct perf* pf = c->priv;
+    if (!pf)
+        return;
+    for (int i = 0; i < pf->ngroups; i++)
+        for (int k = 0; k < pf->groups[i].nevents; k++)
+            close(pf->groups[i].fds[k]);
+    free(pf->groups);
+    free(pf->total);
+    free(pf->stale);
+    free(pf->prev);
+    free(pf);
+    c->priv = NULL;
+}
+
+static int add_def(struct perf* pf, const char* spec)
+{
+    if (pf->nevents == PERF_MAX_EVENTS) {
+        fprintf(stderr, "At most %d --perf events\n", PERF_MAX_EVENTS);
+        return -1;
+    }
+    return parse_def(spec, &pf->defs[pf->nevents++]);
+}
+
+int perf_create(struct collector* c, struct log_schema* ls, const char* const* specs, int nspecs,
+    const struct node_set* nodes)
+{
+    // Read in the same tick as the core counters.
+    collector_init(c, "perf", 1);
+    c->sample = perf_sample;
+    c->destroy = perf_destroy;
+
+    struct perf* pf = calloc(1, sizeof(*pf));
+    if (!pf)
+        return -1;
+    c->priv = pf;
+    pf->nnodes = nodes->count;
+
+    for (int i = 0; i < nspecs; i++) {
+        int preset = 0;
+        for (size_t p = 0; p < sizeof(presets) / sizeof(presets[0]); p++) {
+            if (strcmp(specs[i], presets[p][0]) == 0) {
+                preset = 1;
+                if (add_def(pf, presets[p][1]) != 0)
+                    return -1;
+            }
+        }
+        if (!preset && add_def(pf, specs[i]) != 0)
+            return -1;
+    }
+
+    cpu_set_t* node_sets = calloc(nodes->count, sizeof(cpu_set_t));
+    pf->total = calloc((size_t)nodes->count * pf->nevents, sizeof(double));
+    pf->stale = calloc((size_t)nodes->count * pf->nevents, 1);
+    pf->prev = calloc((size_t)nodes->count * pf->nevents, sizeof(double));
+    if (!node_sets || !pf->total || !pf->stale || !pf->prev) {
+        free(node_sets);
+        return -1;
+    }
+    for (int i = 0; i < nodes->count; i++)
+        if (node_cpus(nodes->ids[i], &node_sets[i]) < 0)
+            CPU_ZERO(&node_sets[i]);
+
+    // Group the events by PMU, in the order the PMUs first appear.
+    int ret = 0;
+    unsigned char done[PERF_MAX_EVENTS] = { 0 };
+    for (int e = 0; ret == 0 && e < pf->nevents; e++) {
+        if (done[e])
+            continue;
+        int defs[PERF_MAX_EVENTS], ndefs = 0;
+        for (int f = e; f < pf->nevents; f++) {
+            if (strcmp(pf->defs[f].pmu, pf->defs[e].pmu) == 0) {
+                done[f] = 1;
+                defs[ndefs++] = f;
+            }
+        }
+        ret = open_pmu(pf, pf->defs[e].pmu, defs, ndefs, node_sets, nodes);
+    }
+    free(node_sets);
+    if (ret != 0)
+        return -1;
+    if (pf->ngroups == 0) {
+        fprintf(stderr, "No CPU of the logged nodes can count the --perf events\n");
+        return -1;
+    }
+
+    int64_t now = monotonic_ns();
+    for (int i = 0; i < pf->ngroups; i++) {
+        ioctl(pf->groups[i].leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        pf->groups[i].prev_ns = now;
+    }
+
+    char name[LOG_NAME_MAX];
+    for (int i = 0; i < nodes->count; i++) {
+        for (int e = 0; e < pf->nevents; e++) {
+            snprintf(name, sizeof(name), "node_%d_perf_%s_per_sec", nodes->ids[i], pf->defs[e].name);
+            if (collector_add_column(c, ls, name, CELL_F64) < 0)
+                return -1;
+        }
+    }
+    return collector_finish(c);
+}
@@ -0,0 +1,22 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include "collector.h"
+#include "nodes.h"
+
+#define PERF_MAX_EVENTS 8
+
+// Hardware counters per node through perf_event_open(). Each event is
+// <name>=<pmu>/<terms>/, for example
+//   remote_dram=cpu/event=0xd3,umask=0x02/
+//   imc_reads=uncore_imc/event=0x04,umask=0x03/
+// or the preset remote-dram (local_dram and remote_dram from
+// mem_load_l3_miss_retired). Terms are config/config1/config2, fields from
+// the PMU's format/ directory or an alias from its events/ directory. The
+// events of one PMU on one CPU form a group that is read with a single
+// read(); core PMUs count on every CPU of the node, uncore PMUs on the CPUs
+// in their cpumask. Each event gives a node_N_perf_<name>_per_sec column.
+int perf_create(struct collector* c, struct log_schema* ls, const char* const* specs, int nspecs,
+    const struct node_set* nodes);
+
+#endif
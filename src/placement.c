@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+#include "placement.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+
+#include "cpulist.h"
+
+#define ULONG_BITS (sizeof(unsigned long) * 8)
+
+int placement_parse_cpus(struct placement* p, const char* list)
+{
+    if (cpulist_parse(list, &p->cpus) <= 0) {
+        fprintf(stderr, "Invalid CPU list: %s\n", list);
+        return -1;
+    }
+    p->has_cpus = 1;
+    return 0;
+}
+
+// Node lists use the CPU list syntax; "all" is every node with memory.
+static int parse_nodes(const char* list, cpu_set_t* set)
+{
+    int n = strcmp(list, "all") == 0 ?
+        cpulist_read("/sys/devices/system/node/has_memory", set) : cpulist_parse(list, set);
+    if (n < 0 && strcmp(list, "all") == 0)
+        n = cpulist_read("/sys/devices/system/node/online", set);
+    if (n <= 0)
+        fprintf(stderr, "Invalid node list: %s\n", list);
+    return n;
+}
+
+// Like numactl --cpunodebind: the CPUs of these nodes.
+int placement_parse_cpunodes(struct placement* p, const char* nodes)
+{
+    cpu_set_t set;
+    if (parse_nodes(nodes, &set) <= 0)
+        return -1;
+
+    CPU_ZERO(&p->cpus);
+    for (int node = 0; node < PLACEMENT_MAX_NODES; node++) {
+        cpu_set_t cpus;
+        if (!CPU_ISSET(node, &set))
+            continue;
+        if (node_cpus(node, &cpus) < 0) {
+            fprintf(stderr, "Cannot read the CPUs of node %d\n", node);
+            return -1;
+        }
+        CPU_OR(&p->cpus, &p->cpus, &cpus);
+    }
+    if (CPU_COUNT(&p->cpus) == 0) {
+        fprintf(stderr, "Nodes %s have no CPUs\n", nodes);
+        return -1;
+    }
+    p->has_cpus = 1;
+    return 0;
+}
+
+// numactl's memory policies, or the names POLICY_COMMANDS in
+// stream_logger.py/rocksdb_logger.py gives them:
+//   default                      inherit the policy (no numactl)
+//   local                        --localalloc
+//   interleave=<nodes|all>       --interleave, also interleave_all
+//   preferred=<node>             --preferred, also preferred_node<N>
+//   membind=<nodes>              --membind, also bind=<nodes>
+int placement_parse_policy(struct placement* p, const char* spec)
+{
+    const char* arg = NULL;
+    int mode;
+
+    if (strcmp(spec, "default") == 0) {
+        p->has_policy = 0;
+        return 0;
+    }
+    if (strcmp(spec, "local") == 0 || strcmp(spec, "localalloc") == 0)
+        mode = MPOL_LOCAL;
+    else if (strcmp(spec, "interleave_all") == 0) {
+        mode = MPOL_INTERLEAVE;
+        arg = "all";
+    }
+    else if (strncmp(spec, "interleave=", 11) == 0) {
+        mode = MPOL_INTERLEAVE;
+        arg = spec + 11;
+    }
+    else if (strncmp(spec, "preferred_node", 14) == 0) {
+        mode = MPOL_PREFERRED;
+        arg = spec + 14;
+    }
+    else if (strncmp(spec, "preferred=", 10) == 0) {
+        mode = MPOL_PREFERRED;
+        arg = spec + 10;
+    }
+    else if (strncmp(spec, "membind=", 8) == 0 || strncmp(spec, "bind=", 5) == 0) {
+        mode = MPOL_BIND;
+        arg = strchr(spec, '=') + 1;
+    }
+    else {
+        fprintf(stderr, "Unknown memory policy: %s\n", spec);
+        return -1;
+    }
+
+    memset(p->nodes, 0, sizeof(p->nodes));
+    if (arg) {
+        cpu_set_t set;
+        int n = parse_nodes(arg, &set);
+        if (n <= 0)
+            return -1;
+        if (mode == MPOL_PREFERRED && n != 1) {
+            fprintf(stderr, "A preferred policy takes one node: %s\n", spec);
+            return -1;
+        }
+        for (int node = 0; node < PLACEMENT_MAX_NODES; node++)
+            if (CPU_ISSET(node, &set))
+                p->nodes[node / ULONG_BITS] |= 1UL << (node % ULONG_BITS);
+    }
+    p->mode = mode;
+    p->has_policy = 1;
+    return 0;
+}
+
+// The calling thread's placement. Kernels without NUMA have no memory
+// policy; that part is then left unset.
+int placement_get(struct placement* p)
+{
+    memset(p, 0, sizeof(*p));
+    if (sched_getaffinity(0, sizeof(p->cpus), &p->cpus) != 0) {
+        perror("sched_getaffinity");
+        return -1;
+    }
+    p->has_cpus = 1;
+
+    if (syscall(SYS_get_mempolicy, &p->mode, p->nodes, (unsigned long)PLACEMENT_MAX_NODES, NULL, 0) == 0)
+        p->has_policy = 1;
+    else if (errno != ENOSYS) {
+        perror("get_mempolicy");
+        return -1;
+    }
+    return 0;
+}
+
+void placement_merge(struct placement* into, const struct placement* from)
+{
+    if (from->has_cpus) {
+        into->has_cpus = 1;
+        into->cpus = from->cpus;
+    }
+    if (from->has_policy) {
+        into->has_policy = 1;
+        into->mode = from->mode;
+        memcpy(into->nodes, from->nodes, sizeof(into->nodes));
+    }
+}
+
+// Apply to the calling thread only; other threads keep theirs.
+int placement_apply(const struct placement* p)
+{
+    if (p->has_cpus && sched_setaffinity(0, sizeof(p->cpus), &p->cpus) != 0) {
+        perror("sched_setaffinity");
+        return -1;
+    }
+    if (p->has_policy) {
+        int base = p->mode & ~MPOL_MODE_FLAGS;
+        int nomask = base == MPOL_DEFAULT || base == MPOL_LOCAL;
+        // maxnode counts one past the last bit the kernel reads.
+        if (syscall(SYS_set_mempolicy, p->mode, nomask ? NULL : p->nodes,
+                nomask ? 0UL : (unsigned long)PLACEMENT_MAX_NODES + 1) != 0) {
+            perror("set_mempolicy");
+            return -1;
+        }
+    }
+    return 0;
+}
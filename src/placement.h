@@ -0,0 +1,30 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+// Needs _GNU_SOURCE for cpu_set_t.
+#include <sched.h>
+
+#define PLACEMENT_MAX_NODES 1024
+#define PLACEMENT_MASK_WORDS (PLACEMENT_MAX_NODES / (8 * sizeof(unsigned long)))
+
+// CPU affinity and memory policy of the calling thread, which is what a
+// thread or process started from it inherits. Only the parts that are set
+// are applied, so a placement can describe just --logger-cpus or just
+// --child-policy.
+struct placement {
+    int has_cpus;
+    cpu_set_t cpus;
+
+    int has_policy;
+    int mode;           // MPOL_* plus mode flags, as get_mempolicy returns it
+    unsigned long nodes[PLACEMENT_MASK_WORDS];
+};
+
+int placement_parse_cpus(struct placement* p, const char* list);
+int placement_parse_cpunodes(struct placement* p, const char* nodes);
+int placement_parse_policy(struct placement* p, const char* spec);
+int placement_get(struct placement* p);
+void placement_merge(struct placement* into, const struct placement* from);
+int placement_apply(const struct placement* p);
+
+#endif
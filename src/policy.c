@@ -0,0 +1,201 @@
+#include "policy.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/syscall.h>
+
+#include "profile.h"
+
+#define ULONG_BITS (sizeof(unsigned long) * 8)
+
+static double cell_value(const union cell* c, unsigned char type)
+{
+    if (type == CELL_U64)
+        return (double)c->u;
+    if (type == CELL_I64)
+        return (double)c->i;
+    return c->f;
+}
+
+// const:<mode> -- the same fixed answer as inference_engine/dummy_model.sh.
+static int decide_const(const struct numa_policy_sample* s, void* state)
+{
+    (void)s;
+    return ((struct policy*)state)->const_mode;
+}
+
+// threshold:<column>,<limit>,<mode if >= limit>,<mode if < limit>
+static int decide_threshold(const struct numa_policy_sample* s, void* state)
+{
+    const struct policy* p = state;
+    double v = cell_value(&s->cells[p->thr_col], s->types[p->thr_col]);
+    return v >= p->thr_limit ? p->thr_mode_ge : p->thr_mode_lt;
+}
+
+static int load_plugin(struct policy* p, const char* path)
+{
+    p->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!p->handle) {
+        fprintf(stderr, "Cannot load policy plugin: %s\n", dlerror());
+        return -1;
+    }
+    p->decide = (numa_policy_decide_fn)dlsym(p->handle, "numa_policy_decide");
+    p->init = (numa_policy_init_fn)dlsym(p->handle, "numa_policy_init");
+    p->fini = (numa_policy_fini_fn)dlsym(p->handle, "numa_policy_fini");
+    if (!p->decide) {
+        fprintf(stderr, "Policy plugin %s has no numa_policy_decide\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_spec(struct policy* p, const char* spec)
+{
+    if (strncmp(spec, "plugin:", 7) == 0)
+        return load_plugin(p, spec + 7);
+
+    p->state = p;
+    if (strncmp(spec, "const:", 6) == 0) {
+        char* end;
+        p->const_mode = (int)strtol(spec + 6, &end, 10);
+        if (end != spec + 6 && *end == '\0') {
+            p->decide = decide_const;
+            return 0;
+        }
+    }
+    else if (strncmp(spec, "threshold:", 10) == 0) {
+        const char* s = spec + 10;
+        size_t len = strcspn(s, ",");
+        if (len > 0 && len < LOG_NAME_MAX && s[len] == ',' &&
+            sscanf(s + len + 1, "%lf,%d,%d", &p->thr_limit, &p->thr_mode_ge, &p->thr_mode_lt) == 3) {
+            memcpy(p->thr_name, s, len);
+            p->thr_name[len] = '\0';
+            p->decide = decide_threshold;
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "Invalid --policy '%s' (expected plugin:<file.so>, const:<mode> or "
+                    "threshold:<column>,<limit>,<mode>,<mode>)\n", spec);
+    return -1;
+}
+
+// Parse the policy spec and add the policy_* columns. The decision
+// function is started by policy_start() once the schema is complete.
+int policy_setup(struct policy* p, const char* spec, struct log_schema* ls,
+    const struct node_set* nodes, uint64_t period, long syscall_nr)
+{
+    memset(p, 0, sizeof(*p));
+    p->period = period ? period : 1;
+    p->syscall_nr = syscall_nr;
+    p->thr_col = -1;
+
+    if (parse_spec(p, spec) != 0)
+        return -1;
+
+    // Allow every logged node, by real node ID.
+    p->maxnode = (unsigned long)nodes->max_id + 1;
+    p->nmask = calloc((p->maxnode + ULONG_BITS - 1) / ULONG_BITS, sizeof(unsigned long));
+    if (!p->nmask)
+        return -1;
+    for (int i = 0; i < nodes->count; i++)
+        p->nmask[nodes->ids[i] / ULONG_BITS] |= 1UL << (nodes->ids[i] % ULONG_BITS);
+
+    p->sample.node_count = nodes->count;
+    p->sample.node_ids = nodes->ids;
+
+    p->first_col = log_schema_add(ls, "policy_mode", CELL_I64);
+    if (p->first_col < 0 ||
+        log_schema_add(ls, "policy_ret", CELL_I64) < 0 ||
+        log_schema_add(ls, "policy_decide_ns", CELL_U64) < 0)
+        return -1;
+    return 0;
+}
+
+// Hand the decision function the rolling-window features; call before
+// policy_start() so a plugin's init sees their names.
+void policy_use_features(struct policy* p, const struct feature_set* fs)
+{
+    p->sample.nfeatures = fs->nvalues;
+    p->sample.feature_names = (const char (*)[NUMA_POLICY_NAME_MAX])fs->names;
+    p->sample.features = fs->values;
+}
+
+int policy_start(struct policy* p, const struct log_schema* ls)
+{
+    p->sample.ncols = ls->ncols;
+    p->sample.names = (const char (*)[NUMA_POLICY_NAME_MAX])ls->names;
+    p->sample.types = ls->types;
+
+    if (p->thr_name[0]) {
+        for (int i = 0; i < ls->ncols && p->thr_col < 0; i++)
+            if (strcmp(ls->names[i], p->thr_name) == 0)
+                p->thr_col = i;
+        if (p->thr_col < 0) {
+            fprintf(stderr, "--policy threshold: no column named '%s'\n", p->thr_name);
+            return -1;
+        }
+    }
+
+    if (p->init && p->init(&p->sample, &p->state) != 0) {
+        fprintf(stderr, "Policy plugin initialisation failed\n");
+        p->init = NULL;
+        p->fini = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void policy_attach(struct policy* p, pid_t pid)
+{
+    p->pid = pid;
+    p->sample.pid = pid;
+}
+
+// Mark a row without a decision: policy_mode -1.
+void policy_skip(const struct policy* p, struct record* rec)
+{
+    union cell* out = &rec->cells[p->first_col];
+    out[0].i = -1;
+    out[1].i = 0;
+    out[2].u = 0;
+}
+
+// Decide on the row just built and apply the result.
+void policy_run(struct policy* p, uint64_t tick, struct record* rec)
+{
+    union cell* out = &rec->cells[p->first_col];
+    policy_skip(p, rec);
+    if (tick % p->period != 0 || (p->pid <= 0 && !p->dry_run))
+        return;
+
+    uint64_t t0 = prof_now_ns();
+    p->sample.ts_ns = rec->ts_ns;
+    p->sample.cells = rec->cells;
+    int mode = p->decide(&p->sample, p->state);
+    out[2].u = prof_now_ns() - t0;
+    if (mode < 0)
+        return;
+
+    long ret = p->dry_run ? 0 : syscall(p->syscall_nr, p->pid, mode, p->nmask, p->maxnode);
+    out[0].i = mode;
+    out[1].i = ret == 0 ? 0 : -errno;
+    p->decisions++;
+    if (ret != 0 && p->failures++ == 0)
+        perror("policy syscall");
+}
+
+void policy_free(struct policy* p)
+{
+    if (p->fini)
+        p->fini(p->state);
+    if (p->handle)
+        dlclose(p->handle);
+    free(p->nmask);
+    memset(p, 0, sizeof(*p));
+}
@@ -0,0 +1,58 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "cell.h"
+#include "feature_window.h"
+#include "logfmt.h"
+#include "nodes.h"
+#include "policy_plugin.h"
+
+// Default number of the out-of-tree memory policy syscall that
+// inference_engine/change_policy calls: (pid, mode, nmask, maxnode).
+#define POLICY_SYSCALL_NR 470
+
+// Closed-loop policy control inside the logger: every period ticks the
+// decision function looks at the row just built and the chosen mode is
+// applied with the policy syscall, without forking. The decision lands in
+// policy_* columns of that same row.
+struct policy {
+    uint64_t period;
+    long syscall_nr;
+    pid_t pid;
+    int dry_run;        // decide and log, but apply nothing (-p replays)
+    int first_col;
+
+    numa_policy_decide_fn decide;
+    numa_policy_fini_fn fini;
+    void* state;
+    void* handle;
+    numa_policy_init_fn init;
+
+    // Built-in models.
+    int const_mode;
+    char thr_name[LOG_NAME_MAX];
+    int thr_col;
+    double thr_limit;
+    int thr_mode_ge;
+    int thr_mode_lt;
+
+    struct numa_policy_sample sample;
+    unsigned long* nmask;
+    unsigned long maxnode;
+    uint64_t decisions;
+    uint64_t failures;
+};
+
+int policy_setup(struct policy* p, const char* spec, struct log_schema* ls,
+    const struct node_set* nodes, uint64_t period, long syscall_nr);
+void policy_use_features(struct policy* p, const struct feature_set* fs);
+int policy_start(struct policy* p, const struct log_schema* ls);
+void policy_attach(struct policy* p, pid_t pid);
+void policy_run(struct policy* p, uint64_t tick, struct record* rec);
+void policy_skip(const struct policy* p, struct record* rec);
+void policy_free(struct policy* p);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef POLICY_PLUGIN_H
+#define POLICY_PLUGIN_H
+
+// Interface for --policy plugin:<file.so> decision plugins. Build one with
+//
+//   cc -O2 -shared -fPIC -I<repo>/src my_model.c -o my_model.so
+//
+// and export numa_policy_decide (required) and, if the plugin keeps state or
+// needs to look up its columns once, numa_policy_init / numa_policy_fini.
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "cell.h"
+
+#define NUMA_POLICY_NAME_MAX 128
+
+// One logged row as the plugin sees it. At init, cells is NULL and only
+// the schema fields are set.
+struct numa_policy_sample {
+    int64_t ts_ns;                      // CLOCK_REALTIME of the row
+    int ncols;
+    const char (*names)[NUMA_POLICY_NAME_MAX];
+    const unsigned char* types;         // enum cell_type per column
+    const union cell* cells;
+    int node_count;
+    const int* node_ids;
+    pid_t pid;                          // process the policy is applied to
+
+    // Rolling-window features (--features), the same values the offline
+    // preprocessing computes; nfeatures is 0 without --features.
+    int nfeatures;
+    const char (*feature_names)[NUMA_POLICY_NAME_MAX];
+    const double* features;
+};
+
+// Return 0 on success; a non-zero return aborts the logger's startup.
+typedef int (*numa_policy_init_fn)(const struct numa_policy_sample* schema, void** state);
+// Return the mode to apply, or a negative value to leave the policy alone.
+typedef int (*numa_policy_decide_fn)(const struct numa_policy_sample* sample, void* state);
+typedef void (*numa_policy_fini_fn)(void* state);
+
+#endif
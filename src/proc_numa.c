@@ -0,0 +1,264 @@
+#include "proc_numa.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "numa_maps.h"
+#include "stat_parse.h"
+
+// Room for the small per-process files (stat, status, task lists).
+#define CHUNK_SIZE 65536
+
+struct proc_numa {
+    pid_t root;
+    const struct node_set* nodes;
+    int numa_count;
+    int scan_proc;
+
+    pid_t* pids;
+    int npids;
+    int cap;
+    pid_t (*pairs)[2];
+    int npairs;
+    int pairs_cap;
+
+    char* buf;
+    struct numa_maps maps;
+    uint64_t* node_kb;
+
+    struct stat_parser status_parser;
+    uint64_t vmrss_kb;
+};
+
+static const struct stat_key status_keys[] = {
+    { "VmRSS", 0 },
+};
+
+static int add_pid(struct proc_numa* p, pid_t pid)
+{
+    for (int i = 0; i < p->npids; i++)
+        if (p->pids[i] == pid)
+            return 0;
+    if (p->npids == p->cap) {
+        int cap = p->cap ? p->cap * 2 : 16;
+        pid_t* pids = realloc(p->pids, sizeof(*pids) * cap);
+        if (!pids)
+            return -1;
+        p->pids = pids;
+        p->cap = cap;
+    }
+    p->pids[p->npids++] = pid;
+    return 0;
+}
+
+static ssize_t read_small(const char* path, char* buf, size_t len)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = read(fd, buf, len - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+// Children of every thread of pid, from /proc/<pid>/task/<tid>/children.
+// Returns -1 if the kernel has no children files (CONFIG_PROC_CHILDREN).
+static int add_children(struct proc_numa* p, pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+    DIR* dir = opendir(path);
+    if (!dir)
+        return 0;
+
+    int ret = 0;
+    struct dirent* de;
+    while ((de = readdir(dir)) != NULL && ret == 0) {
+        if (!isdigit((unsigned char)de->d_name[0]))
+            continue;
+        snprintf(path, sizeof(path), "/proc/%d/task/%.16s/children", (int)pid, de->d_name);
+        if (read_small(path, p->buf, CHUNK_SIZE) < 0) {
+            if (errno == ENOENT)
+                ret = -1;
+            continue;
+        }
+        char* s = p->buf;
+        char* end;
+        long child;
+        while ((child = strtol(s, &end, 10)) > 0 && end != s) {
+            if (add_pid(p, (pid_t)child) != 0)
+                ret = -1;
+            s = end;
+        }
+    }
+    closedir(dir);
+    return ret;
+}
+
+// Fallback: read the parent of every process from /proc/<pid>/stat and
+// collect the tree from those edges.
+static void scan_descendants(struct proc_numa* p)
+{
+    DIR* dir = opendir("/proc");
+    if (!dir)
+        return;
+
+    p->npairs = 0;
+    struct dirent* de;
+    while ((de = readdir(dir)) != NULL) {
+        if (!isdigit((unsigned char)de->d_name[0]))
+            continue;
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%.16s/stat", de->d_name);
+        if (read_small(path, p->buf, CHUNK_SIZE) < 0)
+            continue;
+        // comm may contain spaces and parentheses; the state and ppid
+        // follow the last ')'.
+        char* s = strrchr(p->buf, ')');
+        int ppid;
+        if (!s || sscanf(s + 1, " %*c %d", &ppid) != 1)
+            continue;
+
+        if (p->npairs == p->pairs_cap) {
+            int cap = p->pairs_cap ? p->pairs_cap * 2 : 256;
+            pid_t (*pairs)[2] = realloc(p->pairs, sizeof(*pairs) * cap);
+            if (!pairs)
+                break;
+            p->pairs = pairs;
+            p->pairs_cap = cap;
+        }
+        p->pairs[p->npairs][0] = (pid_t)atoi(de->d_name);
+        p->pairs[p->npairs][1] = (pid_t)ppid;
+        p->npairs++;
+    }
+    closedir(dir);
+
+    // p->pids grows while we walk it, so this is a breadth-first search.
+    for (int i = 0; i < p->npids; i++)
+        for (int j = 0; j < p->npairs; j++)
+            if (p->pairs[j][1] == p->pids[i])
+                add_pid(p, p->pairs[j][0]);
+}
+
+static void collect_tree(struct proc_numa* p)
+{
+    p->npids = 0;
+    add_pid(p, p->root);
+    if (!p->scan_proc) {
+        for (int i = 0; i < p->npids; i++) {
+            if (add_children(p, p->pids[i]) != 0) {
+                p->scan_proc = 1;
+                p->npids = 1;
+                break;
+            }
+        }
+    }
+    if (p->scan_proc)
+        scan_descendants(p);
+}
+
+static void scan_numa_maps(struct proc_numa* p, pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/numa_maps", (int)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    numa_maps_read(&p->maps, fd, p->node_kb);
+    close(fd);
+}
+
+static void proc_numa_sample(struct collector* c, union cell* out)
+{
+    struct proc_numa* p = c->priv;
+
+    memset(p->node_kb, 0, sizeof(uint64_t) * p->numa_count);
+    p->npids = 0;
+    if (p->root > 0)
+        collect_tree(p);
+
+    uint64_t rss_kb = 0;
+    int alive = 0;
+    for (int i = 0; i < p->npids; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/status", (int)p->pids[i]);
+        if (read_small(path, p->buf, CHUNK_SIZE) < 0)
+            continue;
+        alive++;
+        // Kernel threads and zombies have no VmRSS line.
+        p->vmrss_kb = 0;
+        stat_parser_run(&p->status_parser, p->buf, &p->vmrss_kb);
+        rss_kb += p->vmrss_kb;
+
+        scan_numa_maps(p, p->pids[i]);
+    }
+
+    out[0].u = (uint64_t)alive;
+    out[1].u = rss_kb;
+    for (int i = 0; i < p->numa_count; i++)
+        out[2 + i].u = p->node_kb[i];
+}
+
+static void proc_numa_destroy(struct collector* c)
+{
+    struct proc_numa* p = c->priv;
+    if (!p)
+        return;
+    stat_parser_free(&p->status_parser);
+    free(p->pids);
+    free(p->pairs);
+    free(p->buf);
+    numa_maps_free(&p->maps);
+    free(p->node_kb);
+    free(p);
+    c->priv = NULL;
+}
+
+void proc_numa_attach(struct collector* c, pid_t root)
+{
+    struct proc_numa* p = c->priv;
+    p->root = root;
+}
+
+int proc_numa_create(struct collector* c, struct log_schema* ls, pid_t root,
+    const struct node_set* nodes, uint64_t period)
+{
+    int numa_count = nodes->count;
+
+    collector_init(c, "proc", period);
+    c->sample = proc_numa_sample;
+    c->destroy = proc_numa_destroy;
+
+    struct proc_numa* p = calloc(1, sizeof(*p));
+    if (!p)
+        return -1;
+    c->priv = p;
+    p->root = root;
+    p->nodes = nodes;
+    p->numa_count = numa_count;
+    p->buf = malloc(CHUNK_SIZE + 1);
+    p->node_kb = calloc(numa_count, sizeof(uint64_t));
+    if (!p->buf || !p->node_kb || numa_maps_init(&p->maps, nodes) != 0 ||
+        stat_parser_init(&p->status_parser, status_keys, 1) != 0)
+        return -1;
+
+    if (collector_add_column(c, ls, "proc_count", CELL_U64) < 0 ||
+        collector_add_column(c, ls, "proc_rss_kb", CELL_U64) < 0)
+        return -1;
+    for (int i = 0; i < numa_count; i++) {
+        char name[LOG_NAME_MAX];
+        snprintf(name, sizeof(name), "node_%d_proc_kb", nodes->ids[i]);
+        if (collector_add_column(c, ls, name, CELL_U64) < 0)
+            return -1;
+    }
+    return collector_finish(c);
+}
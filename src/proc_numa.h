@@ -0,0 +1,17 @@
+#ifndef PROC_NUMA_H
+#define PROC_NUMA_H
+
+#include <sys/types.h>
+
+#include "collector.h"
+#include "nodes.h"
+
+// Per-process placement of a process tree: resident kB per node summed
+// from /proc/<pid>/numa_maps, plus VmRSS and the number of processes, over
+// the root and all of its descendants. The root may be attached after the
+// columns are created, e.g. once the -r command has been spawned.
+int proc_numa_create(struct collector* c, struct log_schema* ls, pid_t root,
+    const struct node_set* nodes, uint64_t period);
+void proc_numa_attach(struct collector* c, pid_t root);
+
+#endif
@@ -0,0 +1,56 @@
+#include "profile.h"
+
+#include <string.h>
+
+static const char* const phase_names[PROF_COUNT] = {
+    "read", "parse", "collect", "format", "write", "sleep error",
+};
+
+static uint64_t timeval_ns(const struct timeval* tv)
+{
+    return (uint64_t)tv->tv_sec * 1000000000 + (uint64_t)tv->tv_usec * 1000;
+}
+
+void profile_init(struct profile* p)
+{
+    memset(p, 0, sizeof(*p));
+    p->enabled = 1;
+    p->start_ns = (int64_t)prof_now_ns();
+    getrusage(RUSAGE_SELF, &p->start_usage);
+}
+
+void profile_add(struct profile* p, enum prof_phase phase, uint64_t ns)
+{
+    struct prof_stat* st = &p->phase[phase];
+    st->total_ns += ns;
+    if (ns > st->max_ns)
+        st->max_ns = ns;
+}
+
+// CPU time (user + system, all threads) and peak RSS of the logger.
+void profile_rusage(uint64_t* cpu_ns, uint64_t* maxrss_kb)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    *cpu_ns = timeval_ns(&ru.ru_utime) + timeval_ns(&ru.ru_stime);
+    *maxrss_kb = (uint64_t)ru.ru_maxrss;
+}
+
+void profile_report(const struct profile* p, FILE* fp)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    double wall = ((int64_t)prof_now_ns() - p->start_ns) * 1e-9;
+    double user = (timeval_ns(&ru.ru_utime) - timeval_ns(&p->start_usage.ru_utime)) * 1e-9;
+    double sys = (timeval_ns(&ru.ru_stime) - timeval_ns(&p->start_usage.ru_stime)) * 1e-9;
+    uint64_t n = p->samples ? p->samples : 1;
+
+    fprintf(fp, "Logger overhead: %llu samples in %.3f s\n", (unsigned long long)p->samples, wall);
+    fprintf(fp, "  %-12s %12s %12s\n", "phase", "mean_us", "max_us");
+    for (int i = 0; i < PROF_COUNT; i++)
+        fprintf(fp, "  %-12s %12.2f %12.2f\n", phase_names[i],
+            p->phase[i].total_ns / 1e3 / n, p->phase[i].max_ns / 1e3);
+    fprintf(fp, "  cpu          user %.3f s, sys %.3f s = %.3f%% of one CPU\n",
+        user, sys, wall > 0 ? 100.0 * (user + sys) / wall : 0.0);
+    fprintf(fp, "  max rss      %ld kB\n", ru.ru_maxrss);
+}
@@ -0,0 +1,48 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <sys/resource.h>
+
+// Where the logger spends its time, per sample.
+enum prof_phase {
+    PROF_READ,      // pread() of the stat files
+    PROF_PARSE,     // parsing them into counter values
+    PROF_COLLECT,   // the slower collectors (--proc, ...)
+    PROF_FORMAT,    // deriving columns and building the row
+    PROF_WRITE,     // formatting and writing rows (writer thread if any)
+    PROF_SLEEP,     // wake-up error: how late each tick fired
+    PROF_COUNT,
+};
+
+struct prof_stat {
+    uint64_t total_ns;
+    uint64_t max_ns;
+};
+
+// Self-profiling of the logger: phase timings plus its own CPU time and
+// RSS, as an exit summary and/or per-row columns.
+struct profile {
+    int enabled;
+    uint64_t samples;
+    struct prof_stat phase[PROF_COUNT];
+    int64_t start_ns;
+    struct rusage start_usage;
+};
+
+static inline uint64_t prof_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void profile_init(struct profile* p);
+void profile_add(struct profile* p, enum prof_phase phase, uint64_t ns);
+void profile_rusage(uint64_t* cpu_ns, uint64_t* maxrss_kb);
+void profile_report(const struct profile* p, FILE* fp);
+
+#endif
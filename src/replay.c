@@ -0,0 +1,232 @@
+#include "replay.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// CSV timestamps are <sec>.<nsec>; read them back to the nanosecond.
+static int parse_ts(const char* s, int64_t* ts_ns)
+{
+    char* end;
+    long long sec = strtoll(s, &end, 10);
+    if (end == s)
+        return -1;
+    int64_t ns = 0;
+    if (*end == '.') {
+        int digits = 0;
+        for (end++; *end >= '0' && *end <= '9'; end++) {
+            if (digits++ < 9)
+                ns = ns * 10 + (*end - '0');
+        }
+        for (; digits < 9; digits++)
+            ns *= 10;
+    }
+    if (*end)
+        return -1;
+    *ts_ns = (int64_t)sec * 1000000000 + ns;
+    return 0;
+}
+
+static int read_csv_header(struct replay* r, const char* path)
+{
+    if (getline(&r->line, &r->cap, r->fp) <= 0 || strncmp(r->line, "timestamp", 9) != 0) {
+        fprintf(stderr, "%s: not a numa_stat_logger log\n", path);
+        return -1;
+    }
+    r->line[strcspn(r->line, "\r\n")] = '\0';
+    if (log_schema_init(&r->ls, 0, 0) != 0)
+        return -1;
+
+    char* p = strchr(r->line, ',');
+    while (p) {
+        char* name = p + 1;
+        p = strchr(name, ',');
+        if (p)
+            *p = '\0';
+        if (log_schema_add(&r->ls, name, CELL_U64) < 0)
+            return -1;
+    }
+    r->fields = calloc(r->ls.ncols ? r->ls.ncols : 1, sizeof(*r->fields));
+    return r->fields ? 0 : -1;
+}
+
+int replay_open(struct replay* r, const char* path, const char* run_column)
+{
+    memset(r, 0, sizeof(*r));
+    r->run_col = -1;
+    r->label_col = -1;
+
+    r->fp = fopen(path, "rb");
+    if (!r->fp) {
+        perror(path);
+        return -1;
+    }
+
+    // Binary logs start with their magic, CSV logs with "timestamp".
+    int c = getc(r->fp);
+    ungetc(c, r->fp);
+    if (c == 'N') {
+        char magic[8];
+        char labels_path[4096];
+        if (log_read_header(r->fp, &r->ls, magic) != 0)
+            return -1;
+        if (memcmp(magic, BIN_MAGIC, 8) != 0) {
+            fprintf(stderr, "%s: a tsdb log; convert it with numa_stat_dump first\n", path);
+            return -1;
+        }
+        snprintf(labels_path, sizeof(labels_path), "%s.labels", path);
+        if (log_labels_load(&r->ls, labels_path) != 0)
+            return -1;
+        r->binary = 1;
+        r->record = malloc(bin_record_size(&r->ls));
+        r->cells = calloc(r->ls.ncols ? r->ls.ncols : 1, sizeof(*r->cells));
+        if (!r->record || !r->cells)
+            return -1;
+    }
+    else if (read_csv_header(r, path) != 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < r->ls.ncols; i++) {
+        if (strcmp(r->ls.names[i], run_column) == 0)
+            r->run_col = i;
+        else if (strcmp(r->ls.names[i], "mem_policy") == 0)
+            r->label_col = i;
+    }
+    return 0;
+}
+
+// The nodes the log has node_<id>_ columns for.
+int replay_nodes(const struct replay* r, struct node_set* nodes)
+{
+    unsigned char* seen = calloc(NODE_ID_MAX + 1, 1);
+    char list[4096] = "";
+    size_t len = 0;
+    if (!seen)
+        return -1;
+
+    for (int i = 0; i < r->ls.ncols; i++) {
+        int id;
+        if (sscanf(r->ls.names[i], "node_%d_", &id) == 1 && id >= 0 && id <= NODE_ID_MAX)
+            seen[id] = 1;
+    }
+    for (int id = 0; id <= NODE_ID_MAX && len + 16 < sizeof(list); id++)
+        if (seen[id])
+            len += (size_t)snprintf(list + len, sizeof(list) - len, "%s%d", len ? "," : "", id);
+    free(seen);
+
+    if (len == 0) {
+        fprintf(stderr, "The replayed log has no node_N_ columns\n");
+        return -1;
+    }
+    return node_set_parse(nodes, list);
+}
+
+// Find the log column of every raw value.
+int replay_map(struct replay* r, const struct sampler* s)
+{
+    r->nvalues = s->nvalues;
+    r->map = calloc(s->nvalues ? s->nvalues : 1, sizeof(*r->map));
+    if (!r->map)
+        return -1;
+
+    for (int i = 0; i < s->nvalues; i++) {
+        char name[LOG_NAME_MAX];
+        sampler_column_name(s, i, name, sizeof(name));
+        int col = 0;
+        while (col < r->ls.ncols && strcmp(r->ls.names[col], name) != 0)
+            col++;
+        if (col == r->ls.ncols) {
+            fprintf(stderr, "The replayed log has no column %s (record it with the same --counters "
+                "and --emit abs)\n", name);
+            return -1;
+        }
+        r->map[i] = col;
+    }
+    return 0;
+}
+
+static int read_end(struct replay* r)
+{
+    if (ferror(r->fp)) {
+        perror("Reading the replayed log");
+        return -1;
+    }
+    return 0;
+}
+
+// Read the next row. Returns 1 for a row, 0 at the end of the log, -1 on a
+// read error. CSV lines that are not rows are skipped and counted.
+int replay_next(struct replay* r)
+{
+    if (r->binary) {
+        size_t size = bin_record_size(&r->ls);
+        size_t got = fread(r->record, 1, size, r->fp);
+        if (got != size) {
+            if (got)
+                fprintf(stderr, "Ignoring truncated last record\n");
+            return read_end(r);
+        }
+        bin_decode_record(&r->ls, r->record, &r->ts_ns, r->cells);
+        if (r->run_col >= 0)
+            r->run = r->cells[r->run_col].u;
+        if (r->label_col >= 0)
+            r->label = r->cells[r->label_col].u < (uint64_t)r->ls.nlabels ?
+                r->ls.labels[r->cells[r->label_col].u] : "";
+    }
+    else {
+        for (;;) {
+            if (getline(&r->line, &r->cap, r->fp) <= 0)
+                return read_end(r);
+            r->line[strcspn(r->line, "\r\n")] = '\0';
+
+            char* p = strchr(r->line, ',');
+            int n = 0;
+            if (p)
+                *p = '\0';
+            while (p && n < r->ls.ncols) {
+                r->fields[n++] = p + 1;
+                p = strchr(p + 1, ',');
+                if (p)
+                    *p = '\0';
+            }
+            if (n == r->ls.ncols && !p && parse_ts(r->line, &r->ts_ns) == 0)
+                break;
+            r->skipped++;
+        }
+        if (r->run_col >= 0)
+            r->run = strtoull(r->fields[r->run_col], NULL, 10);
+        if (r->label_col >= 0)
+            r->label = r->fields[r->label_col];
+    }
+
+    if (r->rows++ == 0)
+        r->first_ts_ns = r->ts_ns;
+    return 1;
+}
+
+void replay_values(const struct replay* r, uint64_t* values)
+{
+    if (r->binary) {
+        for (int i = 0; i < r->nvalues; i++)
+            values[i] = r->cells[r->map[i]].u;
+    }
+    else {
+        for (int i = 0; i < r->nvalues; i++)
+            values[i] = strtoull(r->fields[r->map[i]], NULL, 10);
+    }
+}
+
+void replay_close(struct replay* r)
+{
+    if (r->skipped)
+        fprintf(stderr, "Replay skipped %llu lines that are not rows\n", (unsigned long long)r->skipped);
+    if (r->fp)
+        fclose(r->fp);
+    log_schema_free(&r->ls);
+    free(r->map);
+    free(r->line);
+    free(r->fields);
+    free(r->record);
+    free(r->cells);
+    memset(r, 0, sizeof(*r));
+}
@@ -0,0 +1,49 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cell.h"
+#include "logfmt.h"
+#include "nodes.h"
+#include "sampler.h"
+
+// -p mode: a recorded CSV or binary log stands in for the stat files. Every
+// raw value the sampler would read is taken from the log's column of the
+// same name, so derived columns, --features, --policy decisions, --shm and
+// --serve see the rows as they were recorded.
+struct replay {
+    FILE* fp;
+    int binary;
+    struct log_schema ls;       // the recorded log's columns
+    int* map;                   // per raw value, its column in the log
+    int nvalues;
+    int run_col;                // -1 without a run column
+    int label_col;              // mem_policy, -1 without one
+
+    // CSV: the current line, split in place.
+    char* line;
+    size_t cap;
+    char** fields;
+    uint64_t skipped;
+
+    // Binary: the current record.
+    unsigned char* record;
+    union cell* cells;
+
+    int64_t ts_ns;
+    int64_t first_ts_ns;
+    uint64_t run;
+    const char* label;
+    uint64_t rows;
+};
+
+int replay_open(struct replay* r, const char* path, const char* run_column);
+int replay_nodes(const struct replay* r, struct node_set* nodes);
+int replay_map(struct replay* r, const struct sampler* s);
+int replay_next(struct replay* r);
+void replay_values(const struct replay* r, uint64_t* values);
+void replay_close(struct replay* r);
+
+#endif
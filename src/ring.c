@@ -0,0 +1,148 @@
+#include "ring.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+static void futex_wait(_Atomic uint32_t* word, uint32_t expected, int timeout_ms)
+{
+    struct timespec ts = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_nsec = (long)(timeout_ms % 1000) * 1000000,
+    };
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, timeout_ms >= 0 ? &ts : NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+int ring_parse_overflow(const char* name, enum ring_overflow* overflow)
+{
+    if (strcmp(name, "block") == 0)
+        *overflow = RING_BLOCK;
+    else if (strcmp(name, "drop") == 0)
+        *overflow = RING_DROP;
+    else {
+        fprintf(stderr, "Unknown --overflow policy '%s' (expected block or drop)\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+int ring_init(struct ring* r, uint64_t capacity, size_t slot_size, enum ring_overflow overflow)
+{
+    memset(r, 0, sizeof(*r));
+    r->capacity = capacity;
+    r->slot_size = (slot_size + 63) & ~(size_t)63;
+    r->overflow = overflow;
+
+    // Only wake the consumer early once the ring is half full; otherwise
+    // it drains on its own timer and writes in large batches.
+    r->wake_fill = capacity / 2 ? capacity / 2 : 1;
+
+    if (posix_memalign((void**)&r->slots, 64, r->slot_size * capacity) != 0) {
+        r->slots = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void* ring_slot(struct ring* r, uint64_t index)
+{
+    return r->slots + (index % r->capacity) * r->slot_size;
+}
+
+// Producer: return the next free slot, or NULL if the record was dropped.
+void* ring_reserve(struct ring* r)
+{
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+    while (head - atomic_load_explicit(&r->tail, memory_order_acquire) >= r->capacity) {
+        if (r->overflow == RING_DROP) {
+            atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+            return NULL;
+        }
+
+        uint32_t seq = atomic_load(&r->producer_seq);
+        atomic_store(&r->producer_sleeping, 1);
+        if (head - atomic_load(&r->tail) >= r->capacity)
+            futex_wait(&r->producer_seq, seq, -1);
+        atomic_store(&r->producer_sleeping, 0);
+    }
+    return ring_slot(r, head);
+}
+
+// Producer: make the slot returned by ring_reserve() visible.
+void ring_publish(struct ring* r)
+{
+    // seq_cst pairs with the consumer's sleeping flag: either it sees the
+    // new head or we see that it is asleep.
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed) + 1;
+    atomic_store(&r->head, head);
+
+    if (atomic_load(&r->consumer_sleeping) &&
+        head - atomic_load_explicit(&r->tail, memory_order_relaxed) >= r->wake_fill) {
+        atomic_fetch_add(&r->consumer_seq, 1);
+        futex_wake(&r->consumer_seq);
+    }
+}
+
+// Consumer: number of records ready, starting at index *first.
+size_t ring_peek(struct ring* r, uint64_t* first)
+{
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    *first = tail;
+    return (size_t)(atomic_load_explicit(&r->head, memory_order_acquire) - tail);
+}
+
+// Consumer: hand n records back to the producer.
+void ring_release(struct ring* r, size_t n)
+{
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed) + n;
+    atomic_store(&r->tail, tail);
+
+    if (atomic_load(&r->producer_sleeping)) {
+        atomic_fetch_add(&r->producer_seq, 1);
+        futex_wake(&r->producer_seq);
+    }
+}
+
+// Consumer: sleep until records arrive, the ring fills past the wake mark,
+// the ring is closed or timeout_ms passes. Returns 0 once the ring is
+// closed and fully drained.
+int ring_wait(struct ring* r, int timeout_ms)
+{
+    uint64_t first;
+    if (ring_peek(r, &first) > 0)
+        return 1;
+    if (atomic_load(&r->closed))
+        return ring_peek(r, &first) > 0;
+
+    uint32_t seq = atomic_load(&r->consumer_seq);
+    atomic_store(&r->consumer_sleeping, 1);
+    if (atomic_load(&r->head) - atomic_load(&r->tail) < r->wake_fill && !atomic_load(&r->closed))
+        futex_wait(&r->consumer_seq, seq, timeout_ms);
+    atomic_store(&r->consumer_sleeping, 0);
+    return 1;
+}
+
+void ring_close(struct ring* r)
+{
+    atomic_store(&r->closed, 1);
+    atomic_fetch_add(&r->consumer_seq, 1);
+    futex_wake(&r->consumer_seq);
+}
+
+void ring_free(struct ring* r)
+{
+    free(r->slots);
+    r->slots = NULL;
+}
@@ -0,0 +1,46 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum ring_overflow {
+    RING_BLOCK,     // the producer waits for the consumer to free a slot
+    RING_DROP,      // the record is dropped and counted
+};
+
+// Single-producer/single-consumer ring of fixed-size records. head and
+// tail only ever grow and live on their own cache lines; the futex words
+// are only touched when one side is actually asleep.
+struct ring {
+    size_t slot_size;
+    uint64_t capacity;
+    uint64_t wake_fill;
+    enum ring_overflow overflow;
+    unsigned char* slots;
+
+    _Alignas(64) _Atomic uint64_t head;
+    _Atomic uint64_t dropped;
+
+    _Alignas(64) _Atomic uint64_t tail;
+
+    _Alignas(64) _Atomic uint32_t consumer_seq;
+    _Atomic uint32_t consumer_sleeping;
+    _Atomic uint32_t producer_seq;
+    _Atomic uint32_t producer_sleeping;
+    _Atomic int closed;
+};
+
+int ring_parse_overflow(const char* name, enum ring_overflow* overflow);
+int ring_init(struct ring* r, uint64_t capacity, size_t slot_size, enum ring_overflow overflow);
+void* ring_reserve(struct ring* r);
+void ring_publish(struct ring* r);
+size_t ring_peek(struct ring* r, uint64_t* first);
+void* ring_slot(struct ring* r, uint64_t index);
+void ring_release(struct ring* r, size_t n);
+int ring_wait(struct ring* r, int timeout_ms);
+void ring_close(struct ring* r);
+void ring_free(struct ring* r);
+
+#endif
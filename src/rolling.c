@@ -0,0 +1,141 @@
+#include "rolling.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+int rolling_init(struct rolling* r, uint32_t window)
+{
+    memset(r, 0, sizeof(*r));
+    r->window = window;
+    if (window) {
+        r->ring = malloc(sizeof(double) * window);
+        r->minq = malloc(sizeof(uint64_t) * window);
+        r->maxq = malloc(sizeof(uint64_t) * window);
+        if (!r->ring || !r->minq || !r->maxq) {
+            rolling_free(r);
+            return -1;
+        }
+    }
+    rolling_reset(r);
+    return 0;
+}
+
+void rolling_reset(struct rolling* r)
+{
+    r->seq = 0;
+    r->count = 0;
+    r->mean = 0;
+    r->m2 = 0;
+    r->first = NAN;
+    r->last = NAN;
+    r->min = NAN;
+    r->max = NAN;
+    r->min_head = r->min_len = 0;
+    r->max_head = r->max_len = 0;
+}
+
+#define Q_AT(q, head, i, w) (q)[((head) + (i)) % (w)]
+
+void rolling_push(struct rolling* r, double x)
+{
+    uint32_t w = r->window;
+
+    // Evict the value leaving a full window (Welford in reverse).
+    if (w && r->count == w) {
+        double old = r->ring[r->seq % w];
+        double n = (double)--r->count;
+        if (n == 0) {
+            r->mean = 0;
+            r->m2 = 0;
+        }
+        else {
+            double delta = old - r->mean;
+            r->mean -= delta / n;
+            r->m2 -= delta * (old - r->mean);
+        }
+    }
+
+    // Same update order as pandas' group_var, so whole-run values match.
+    double oldmean = r->mean;
+    r->count++;
+    r->mean += (x - oldmean) / (double)r->count;
+    r->m2 += (x - r->mean) * (x - oldmean);
+    r->last = x;
+
+    if (!w) {
+        if (r->seq == 0) {
+            r->first = r->min = r->max = x;
+        }
+        else {
+            if (x < r->min)
+                r->min = x;
+            if (x > r->max)
+                r->max = x;
+        }
+        r->seq++;
+        return;
+    }
+
+    uint64_t seq = r->seq++;
+    r->ring[seq % w] = x;
+
+    // Drop deque entries that fell out of the window, then the ones the
+    // new value dominates.
+    uint64_t oldest = r->seq > w ? r->seq - w : 0;
+    while (r->min_len && Q_AT(r->minq, r->min_head, 0, w) < oldest) {
+        r->min_head = (r->min_head + 1) % w;
+        r->min_len--;
+    }
+    while (r->max_len && Q_AT(r->maxq, r->max_head, 0, w) < oldest) {
+        r->max_head = (r->max_head + 1) % w;
+        r->max_len--;
+    }
+    while (r->min_len && r->ring[Q_AT(r->minq, r->min_head, r->min_len - 1, w) % w] >= x)
+        r->min_len--;
+    while (r->max_len && r->ring[Q_AT(r->maxq, r->max_head, r->max_len - 1, w) % w] <= x)
+        r->max_len--;
+    Q_AT(r->minq, r->min_head, r->min_len++, w) = seq;
+    Q_AT(r->maxq, r->max_head, r->max_len++, w) = seq;
+
+    r->min = r->ring[Q_AT(r->minq, r->min_head, 0, w) % w];
+    r->max = r->ring[Q_AT(r->maxq, r->max_head, 0, w) % w];
+    r->first = r->ring[oldest % w];
+
+    // Removals accumulate rounding error; rebuild the sums from the window
+    // once per window's worth of samples (amortised O(1)).
+    if (r->count == w && r->seq % w == 0) {
+        r->count = 0;
+        r->mean = 0;
+        r->m2 = 0;
+        for (uint64_t i = oldest; i < r->seq; i++) {
+            double v = r->ring[i % w];
+            double om = r->mean;
+            r->count++;
+            r->mean += (v - om) / (double)r->count;
+            r->m2 += (v - r->mean) * (v - om);
+        }
+    }
+}
+
+// Sample standard deviation (ddof 1); NaN below two values, like pandas.
+double rolling_std(const struct rolling* r)
+{
+    if (r->count < 2)
+        return NAN;
+    // A window of identical values is exactly 0, whatever removals left.
+    if (r->min == r->max)
+        return 0.0;
+    double var = r->m2 / (double)(r->count - 1);
+    return var > 0 ? sqrt(var) : 0.0;
+}
+
+void rolling_free(struct rolling* r)
+{
+    free(r->ring);
+    free(r->minq);
+    free(r->maxq);
+    r->ring = NULL;
+    r->minq = NULL;
+    r->maxq = NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef ROLLING_H
+#define ROLLING_H
+
+#include <stdint.h>
+
+// Incremental statistics over the last `window` values of one series, or
+// over every value since the last reset when window is 0. Each push is
+// O(1) amortised: Welford mean/variance with removal, and monotonic
+// deques for min and max.
+struct rolling {
+    uint32_t window;
+    uint64_t seq;       // values pushed since the reset
+    uint64_t count;     // values currently in the window
+    double mean;
+    double m2;
+    double first;
+    double last;
+    double min;
+    double max;
+
+    // Bounded windows only: the window itself and the deques, which hold
+    // sequence numbers of candidate minima/maxima.
+    double* ring;
+    uint64_t* minq;
+    uint64_t* maxq;
+    uint32_t min_head, min_len;
+    uint32_t max_head, max_len;
+};
+
+int rolling_init(struct rolling* r, uint32_t window);
+void rolling_reset(struct rolling* r);
+void rolling_push(struct rolling* r, double x);
+double rolling_std(const struct rolling* r);
+void rolling_free(struct rolling* r);
+
+#endif
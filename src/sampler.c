@@ -0,0 +1,277 @@
+#include "sampler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "collector.h"
+
+static int source_instances(const struct sampler* s, int src)
+{
+    if (s->cs->count[src] == 0)
+        return 0;
+    return counter_source_per_node(src) ? s->numa_count : 1;
+}
+
+static void source_path(int src, int node, char* buf, size_t len)
+{
+    switch (src) {
+    case SRC_NODE_MEMINFO:
+        snprintf(buf, len, "/sys/devices/system/node/node%d/meminfo", node);
+        break;
+    case SRC_NODE_VMSTAT:
+        snprintf(buf, len, "/sys/devices/system/node/node%d/vmstat", node);
+        break;
+    case SRC_SYS_VMSTAT:
+        snprintf(buf, len, "/proc/vmstat");
+        break;
+    default:
+        snprintf(buf, len, "/proc/meminfo");
+        break;
+    }
+}
+
+// Lay out the value array without opening any file, for values that come
+// from elsewhere (-p replays a recorded log).
+void sampler_layout(struct sampler* s, const struct counter_set* cs, const struct node_set* nodes)
+{
+    memset(s, 0, sizeof(*s));
+    s->cs = cs;
+    s->nodes = nodes;
+    s->numa_count = nodes->count;
+    for (int src = 0; src < SRC_COUNT; src++) {
+        s->period[src] = 1;
+        s->due[src] = 1;
+        s->base[src] = s->nvalues;
+        s->nvalues += cs->count[src] * source_instances(s, src);
+    }
+}
+
+// On failure everything opened so far is released again.
+int sampler_init(struct sampler* s, const struct counter_set* cs, const struct node_set* nodes)
+{
+    sampler_layout(s, cs, nodes);
+
+    char path[128];
+    for (int src = 0; src < SRC_COUNT; src++) {
+        int n = cs->count[src];
+        int inst = source_instances(s, src);
+        if (inst == 0)
+            continue;
+
+        // All instances of a source share one key table; offsets are
+        // relative to the instance's slice of the value array.
+        s->keys[src] = calloc(n, sizeof(struct stat_key));
+        s->files[src] = calloc(inst, sizeof(struct stat_file));
+        s->parsers[src] = calloc(inst, sizeof(struct stat_parser));
+        for (int i = 0; s->files[src] && i < inst; i++)
+            s->files[src][i].fd = -1;
+        if (!s->keys[src] || !s->files[src] || !s->parsers[src]) {
+            fprintf(stderr, "Failed to allocate sampler\n");
+            sampler_free(s);
+            return -1;
+        }
+
+        for (int j = 0; j < n; j++) {
+            s->keys[src][j].key = cs->counters[src][j].key;
+            s->keys[src][j].offset = j * sizeof(uint64_t);
+        }
+
+        for (int i = 0; i < inst; i++) {
+            source_path(src, counter_source_per_node(src) ? nodes->ids[i] : 0, path, sizeof(path));
+            if (stat_file_open(&s->files[src][i], path) != 0) {
+                perror(path);
+                sampler_free(s);
+                return -1;
+            }
+            if (stat_parser_init(&s->parsers[src][i], s->keys[src], n) != 0) {
+                fprintf(stderr, "Failed to build stat parser for %s\n", path);
+                sampler_free(s);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// spec is a comma-separated list of <source>=<seconds>, e.g.
+// node_meminfo=0.1,vmstat=1; sources not listed are read every tick.
+int sampler_set_periods(struct sampler* s, const char* spec, double interval_sec)
+{
+    const char* p = spec;
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        const char* eq = memchr(p, '=', len);
+        int src = 0;
+        while (src < SRC_COUNT && !(eq && (size_t)(eq - p) == strlen(counter_source_name(src)) &&
+                   strncmp(p, counter_source_name(src), eq - p) == 0))
+            src++;
+
+        char* end = NULL;
+        double sec = eq ? strtod(eq + 1, &end) : 0;
+        if (src == SRC_COUNT || end != p + len || sec <= 0) {
+            fprintf(stderr, "Invalid --source-interval entry '%.*s' (expected <source>=<sec>, where "
+                "source is node_meminfo, node_vmstat, vmstat or meminfo)\n", (int)len, p);
+            return -1;
+        }
+        s->period[src] = collector_period_ticks(sec, interval_sec);
+
+        p += len;
+        if (*p == ',')
+            p++;
+    }
+
+    if (sampler_tiered(s) && !s->fresh) {
+        s->fresh = malloc(s->nvalues ? s->nvalues : 1);
+        if (!s->fresh) {
+            fprintf(stderr, "Failed to allocate sampler\n");
+            return -1;
+        }
+        memset(s->fresh, 1, s->nvalues);
+    }
+    return 0;
+}
+
+// 1 if some source is read less often than every tick.
+int sampler_tiered(const struct sampler* s)
+{
+    for (int src = 0; src < SRC_COUNT; src++)
+        if (s->cs->count[src] && s->period[src] > 1)
+            return 1;
+    return 0;
+}
+
+// Decide which sources are read on this tick, before sampling it; all
+// reads every source regardless of its period.
+void sampler_schedule(struct sampler* s, uint64_t tick, int all)
+{
+    for (int src = 0; src < SRC_COUNT; src++) {
+        s->due[src] = all || tick % s->period[src] == 0;
+        if (s->fresh && s->cs->count[src])
+            memset(&s->fresh[s->base[src]], s->due[src], (size_t)s->cs->count[src] * source_instances(s, src));
+    }
+}
+
+static void sample_source(struct sampler* s, int src, int i, uint64_t* dst, struct sampler_times* t)
+{
+    struct stat_file* sf = &s->files[src][i];
+    if (!s->due[src])
+        return;
+    if (!t) {
+        if (stat_file_read(sf) == 0)
+            stat_parser_run(&s->parsers[src][i], sf->buf, dst);
+        return;
+    }
+
+    uint64_t t0 = prof_now_ns();
+    int ok = stat_file_read(sf) == 0;
+    uint64_t t1 = prof_now_ns();
+    if (ok)
+        stat_parser_run(&s->parsers[src][i], sf->buf, dst);
+    t->read_ns += t1 - t0;
+    t->parse_ns += prof_now_ns() - t1;
+}
+
+// t, if not NULL, accumulates the time spent reading and parsing.
+void sampler_sample(struct sampler* s, uint64_t* values, struct sampler_times* t)
+{
+    for (int src = 0; src < SRC_COUNT; src++) {
+        int n = s->cs->count[src];
+        int inst = source_instances(s, src);
+
+        for (int i = 0; i < inst; i++)
+            sample_source(s, src, i, &values[s->base[src] + i * n], t);
+    }
+}
+
+// Number of values one node contributes: its node_meminfo counters
+// followed by its node_vmstat counters.
+int sampler_node_values(const struct sampler* s)
+{
+    int n = 0;
+    for (int src = 0; src < SRC_COUNT; src++)
+        if (counter_source_per_node(src))
+            n += s->cs->count[src];
+    return n;
+}
+
+// Sample one node's files into a compact array of sampler_node_values()
+// entries. Safe to call for different nodes from different threads.
+void sampler_sample_node(struct sampler* s, int node, uint64_t* out, struct sampler_times* t)
+{
+    for (int src = 0; src < SRC_COUNT; src++) {
+        if (!counter_source_per_node(src) || s->cs->count[src] == 0)
+            continue;
+        sample_source(s, src, node, out, t);
+        out += s->cs->count[src];
+    }
+}
+
+// Copy a node's compact values into their columns of the value array.
+void sampler_scatter_node(const struct sampler* s, int node, const uint64_t* in, uint64_t* values)
+{
+    for (int src = 0; src < SRC_COUNT; src++) {
+        int n = s->cs->count[src];
+        if (!counter_source_per_node(src) || n == 0)
+            continue;
+        memcpy(&values[s->base[src] + node * n], in, sizeof(uint64_t) * n);
+        in += n;
+    }
+}
+
+// Sample the system-wide sources only.
+void sampler_sample_global(struct sampler* s, uint64_t* values, struct sampler_times* t)
+{
+    for (int src = 0; src < SRC_COUNT; src++)
+        if (!counter_source_per_node(src) && s->cs->count[src] > 0)
+            sample_source(s, src, 0, &values[s->base[src]], t);
+}
+
+void sampler_column_name(const struct sampler* s, int col, char* buf, size_t len)
+{
+    int src = SRC_COUNT - 1;
+    while (src > 0 && (col < s->base[src] || s->cs->count[src] == 0))
+        src--;
+
+    int n = s->cs->count[src];
+    int rel = col - s->base[src];
+    const char* name = s->cs->counters[src][rel % n].name;
+
+    if (counter_source_per_node(src))
+        snprintf(buf, len, "node_%d_%s", s->nodes->ids[rel / n], name);
+    else
+        snprintf(buf, len, "%s", name);
+}
+
+// vmstat/numastat event counters only grow; nr_* entries and meminfo
+// are current amounts.
+int sampler_column_monotonic(const struct sampler* s, int col)
+{
+    int src = SRC_COUNT - 1;
+    while (src > 0 && (col < s->base[src] || s->cs->count[src] == 0))
+        src--;
+    if (src != SRC_NODE_VMSTAT && src != SRC_SYS_VMSTAT)
+        return 0;
+    const char* key = s->cs->counters[src][(col - s->base[src]) % s->cs->count[src]].key;
+    return strncmp(key, "nr_", 3) != 0;
+}
+
+void sampler_free(struct sampler* s)
+{
+    if (!s->cs)
+        return;
+    for (int src = 0; src < SRC_COUNT; src++) {
+        int inst = source_instances(s, src);
+        for (int i = 0; i < inst; i++) {
+            if (s->files[src])
+                stat_file_close(&s->files[src][i]);
+            if (s->parsers[src])
+                stat_parser_free(&s->parsers[src][i]);
+        }
+        free(s->keys[src]);
+        free(s->files[src]);
+        free(s->parsers[src]);
+    }
+    free(s->fresh);
+    memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,56 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "counters.h"
+#include "nodes.h"
+#include "profile.h"
+#include "stat_file.h"
+#include "stat_parse.h"
+
+// Reads the selected counters into a flat value array. Columns are laid
+// out source by source; per-node sources repeat their counters per node.
+//
+//   [node_meminfo x nodes][node_vmstat x nodes][vmstat][meminfo]
+//
+// Each source is read every period[src] ticks; in between its values are
+// left as they were. fresh is only allocated once some source is slower
+// than the tick.
+struct sampler {
+    const struct counter_set* cs;
+    const struct node_set* nodes;
+    int numa_count;
+    int nvalues;
+
+    uint64_t period[SRC_COUNT];
+    unsigned char due[SRC_COUNT];
+    unsigned char* fresh;   // per value, 1 if read on this tick
+
+    int base[SRC_COUNT];
+    struct stat_key* keys[SRC_COUNT];
+    struct stat_file* files[SRC_COUNT];
+    struct stat_parser* parsers[SRC_COUNT];
+};
+
+struct sampler_times {
+    uint64_t read_ns;
+    uint64_t parse_ns;
+};
+
+void sampler_layout(struct sampler* s, const struct counter_set* cs, const struct node_set* nodes);
+int sampler_init(struct sampler* s, const struct counter_set* cs, const struct node_set* nodes);
+int sampler_set_periods(struct sampler* s, const char* spec, double interval_sec);
+int sampler_tiered(const struct sampler* s);
+void sampler_schedule(struct sampler* s, uint64_t tick, int all);
+void sampler_sample(struct sampler* s, uint64_t* values, struct sampler_times* t);
+int sampler_node_values(const struct sampler* s);
+void sampler_sample_node(struct sampler* s, int node, uint64_t* out, struct sampler_times* t);
+void sampler_scatter_node(const struct sampler* s, int node, const uint64_t* in, uint64_t* values);
+void sampler_sample_global(struct sampler* s, uint64_t* values, struct sampler_times* t);
+void sampler_column_name(const struct sampler* s, int col, char* buf, size_t len);
+int sampler_column_monotonic(const struct sampler* s, int col);
+void sampler_free(struct sampler* s);
+
+#endif
@@ -1,6 +1,7 @@
 #!/bin/bash
 
-NUMA_COUNT=$(ls -d /sys/devices/system/node/node* | wc -l)
+# The logger reads the online NUMA nodes itself.
+NUMA_COUNT=auto
 INTERVAL=0.1
 
 if [ "$#" -ge 1 ]; then
@@ -0,0 +1,489 @@
+#define _GNU_SOURCE
+#include "serve.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+// Room kept in front of the body for the HTTP header, which can only be
+// written once the body length is known.
+#define HEADER_ROOM 256
+
+// Upper bounds (misses/s) of the numa_miss rate histogram; the last
+// bucket is +Inf. Its name has no column behind it, unlike
+// numa_stat_numa_miss_rate under --emit rate.
+#define HIST_NAME "numa_stat_numa_miss_per_second"
+
+static const double bucket_le[SERVE_BUCKETS - 1] = { 1, 10, 100, 1e3, 1e4, 1e5, 1e6, 1e7 };
+
+static const char not_found[] =
+    "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 10\r\n\r\nnot found\n";
+static const char bad_method[] =
+    "HTTP/1.1 405 Method Not Allowed\r\nContent-Type: text/plain\r\nContent-Length: 19\r\n\r\nmethod not allowed\n";
+
+// Metric names allow [a-zA-Z0-9_:] only.
+static void metric_name(char* buf, size_t len, const char* name)
+{
+    int n = snprintf(buf, len, "numa_stat_%s", name);
+    for (int i = 0; i < n && (size_t)i < len; i++)
+        if (!isalnum((unsigned char)buf[i]) && buf[i] != '_' && buf[i] != ':')
+            buf[i] = '_';
+}
+
+// node_<N>_<name> columns are per node.
+static const char* split_node(const char* name, int* node)
+{
+    int off = 0;
+    if (sscanf(name, "node_%d_%n", node, &off) == 1 && off > 0)
+        return name + off;
+    *node = -1;
+    return name;
+}
+
+static int listen_on(const char* addr)
+{
+    char host[256];
+    const char* colon = strrchr(addr, ':');
+    const char* port = colon ? colon + 1 : addr;
+    size_t hlen = colon ? (size_t)(colon - addr) : 0;
+    if (hlen >= 2 && addr[0] == '[' && addr[hlen - 1] == ']') {
+        addr++;
+        hlen -= 2;
+    }
+    if (hlen >= sizeof(host) || !*port) {
+        fprintf(stderr, "Invalid --serve address: %s\n", addr);
+        return -1;
+    }
+    memcpy(host, addr, hlen);
+    host[hlen] = '\0';
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_PASSIVE };
+    struct addrinfo* res;
+    int err = getaddrinfo(hlen ? host : NULL, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "--serve %s: %s\n", addr, gai_strerror(err));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || listen(fd, SERVE_MAX_CLIENTS) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0)
+        perror("--serve");
+    freeaddrinfo(res);
+    return fd;
+}
+
+// Group the columns into metric families, in column order.
+static int build_families(struct serve* s, const unsigned char* counters)
+{
+    const struct log_schema* ls = s->ls;
+    int* fam_of = calloc(ls->ncols ? ls->ncols : 1, sizeof(int));
+    s->families = calloc(ls->ncols ? ls->ncols : 1, sizeof(*s->families));
+    s->series = calloc(ls->ncols ? ls->ncols : 1, sizeof(*s->series));
+    if (!fam_of || !s->families || !s->series) {
+        free(fam_of);
+        return -1;
+    }
+
+    for (int i = 0; i < ls->ncols; i++) {
+        int node;
+        char name[sizeof(s->families[0].name)];
+        metric_name(name, sizeof(name), split_node(ls->names[i], &node));
+
+        int f = 0;
+        int counter = counters && counters[i];
+        while (f < s->nfamilies && (strcmp(s->families[f].name, name) != 0 ||
+                   (s->families[f].type == CELL_LABEL) != (ls->types[i] == CELL_LABEL) ||
+                   s->families[f].counter != counter))
+            f++;
+        if (f == s->nfamilies) {
+            snprintf(s->families[f].name, sizeof(s->families[f].name), "%s", name);
+            s->families[f].type = ls->types[i];
+            s->families[f].counter = counter;
+            s->nfamilies++;
+        }
+        s->families[f].n++;
+        fam_of[i] = f;
+    }
+
+    int next = 0;
+    for (int f = 0; f < s->nfamilies; f++) {
+        s->families[f].first = next;
+        next += s->families[f].n;
+        s->families[f].n = 0;
+    }
+    for (int i = 0; i < ls->ncols; i++) {
+        struct serve_family* fam = &s->families[fam_of[i]];
+        struct serve_series* ser = &s->series[fam->first + fam->n++];
+        ser->col = i;
+        split_node(ls->names[i], &ser->node);
+    }
+    free(fam_of);
+    return 0;
+}
+
+// Histograms need the absolute numa_miss counter of each node.
+static int build_hist(struct serve* s)
+{
+    const struct log_schema* ls = s->ls;
+    s->hist = calloc(ls->ncols ? ls->ncols : 1, sizeof(*s->hist));
+    if (!s->hist)
+        return -1;
+    for (int i = 0; i < ls->ncols; i++) {
+        int node;
+        const char* rest = split_node(ls->names[i], &node);
+        if (node >= 0 && ls->types[i] == CELL_U64 && strcmp(rest, "numa_miss") == 0) {
+            s->hist[s->nhist].col = i;
+            s->hist[s->nhist].node = node;
+            s->nhist++;
+        }
+    }
+    return 0;
+}
+
+// counters, if not NULL, marks the columns that are monotonic counters.
+int serve_open(struct serve* s, const char* addr, const struct log_schema* ls, const unsigned char* counters)
+{
+    memset(s, 0, sizeof(*s));
+    s->listen_fd = -1;
+    s->ls = ls;
+    for (int i = 0; i < SERVE_MAX_CLIENTS; i++)
+        s->clients[i].fd = -1;
+
+    if (build_families(s, counters) != 0 || build_hist(s) != 0 ||
+        !(s->row = calloc(ls->ncols ? ls->ncols : 1, sizeof(union cell)))) {
+        fprintf(stderr, "Failed to allocate the metrics buffer\n");
+        return -1;
+    }
+
+    // Every line has a bounded length, so the buffer is sized once here.
+    size_t line = sizeof(s->families[0].name) + 96;
+    s->cap = HEADER_ROOM + 4 * line;
+    s->cap += (size_t)s->nfamilies * line + (size_t)ls->ncols * (line + 4 * LOG_NAME_MAX);
+    s->cap += (size_t)s->nhist * (SERVE_BUCKETS + 2) * line + 2 * line;
+    s->buf = malloc(s->cap);
+    if (!s->buf) {
+        fprintf(stderr, "Failed to allocate the metrics buffer\n");
+        return -1;
+    }
+    s->dirty = 1;
+
+    s->listen_fd = listen_on(addr);
+    return s->listen_fd < 0 ? -1 : 0;
+}
+
+int serve_watch(struct serve* s, int epfd, uint32_t ev_listen, uint32_t ev_client)
+{
+    s->epfd = epfd;
+    s->ev_client = ev_client;
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = ev_listen };
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, s->listen_fd, &ev);
+}
+
+// Keep a copy of the row (the ring slot it came from is reused) and feed
+// the histograms. Nothing is rendered here.
+void serve_update(struct serve* s, const struct record* rec)
+{
+    memcpy(s->row, rec->cells, sizeof(union cell) * s->ls->ncols);
+    double dt = (double)(rec->ts_ns - s->prev_ts_ns) * 1e-9;
+
+    for (int i = 0; i < s->nhist; i++) {
+        struct serve_hist* h = &s->hist[i];
+        uint64_t v = rec->cells[h->col].u;
+        if (s->rows && dt > 0 && v >= h->prev) {
+            double rate = (double)(v - h->prev) / dt;
+            int b = 0;
+            while (b < SERVE_BUCKETS - 1 && rate > bucket_le[b])
+                b++;
+            h->counts[b]++;
+            h->sum += rate;
+        }
+        h->prev = v;
+    }
+
+    s->prev_ts_ns = rec->ts_ns;
+    s->row_ts_ns = rec->ts_ns;
+    s->rows++;
+    s->dirty = 1;
+}
+
+static size_t put_value(char* p, size_t n, enum cell_type type, union cell v)
+{
+    int len;
+    if (type == CELL_I64)
+        len = snprintf(p, n, "%" PRId64, v.i);
+    else if (type == CELL_F64 && isnan(v.f))
+        len = snprintf(p, n, "NaN");
+    else if (type == CELL_F64 && isinf(v.f))
+        len = snprintf(p, n, "%sInf", v.f > 0 ? "+" : "-");
+    else if (type == CELL_F64)
+        len = snprintf(p, n, "%.17g", v.f);
+    else
+        len = snprintf(p, n, "%" PRIu64, v.u);
+    return len < 0 ? 0 : (size_t)len < n ? (size_t)len : n ? n - 1 : 0;
+}
+
+// Label values escape backslash, double quote and newline.
+static size_t put_escaped(char* p, size_t n, const char* text)
+{
+    size_t k = 0;
+    for (; *text && k + 2 < n; text++) {
+        if (*text == '\\' || *text == '"' || *text == '\n') {
+            p[k++] = '\\';
+            p[k++] = *text == '\n' ? 'n' : *text;
+        }
+        else
+            p[k++] = *text;
+    }
+    if (n)
+        p[k] = '\0';
+    return k;
+}
+
+#define PUT(...) do { \
+        int len_ = snprintf(p, (size_t)(end - p), __VA_ARGS__); \
+        p += len_ < 0 ? 0 : len_ < end - p ? len_ : end - p - 1; \
+    } while (0)
+
+static void render(struct serve* s)
+{
+    const struct log_schema* ls = s->ls;
+    char* body = s->buf + HEADER_ROOM;
+    char* p = body;
+    char* end = s->buf + s->cap;
+
+    PUT("# TYPE numa_stat_rows counter\nnuma_stat_rows_total %" PRIu64 "\n", s->rows);
+    if (s->rows) {
+        PUT("# TYPE numa_stat_sample_timestamp_seconds gauge\n"
+            "numa_stat_sample_timestamp_seconds %" PRId64 ".%09" PRId64 "\n",
+            s->row_ts_ns / 1000000000, s->row_ts_ns % 1000000000);
+    }
+
+    for (int f = 0; s->rows && f < s->nfamilies; f++) {
+        const struct serve_family* fam = &s->families[f];
+        const char* kind = fam->type == CELL_LABEL ? "info" : fam->counter ? "counter" : "gauge";
+        const char* suffix = fam->counter ? "_total" : "";
+        PUT("# TYPE %s %s\n", fam->name, kind);
+
+        for (int k = 0; k < fam->n; k++) {
+            const struct serve_series* ser = &s->series[fam->first + k];
+            union cell v = s->row[ser->col];
+
+            if (fam->type == CELL_LABEL) {
+                const char* text = ls->labels && v.u < (uint64_t)ls->nlabels ? ls->labels[v.u] : "";
+                const char* label = fam->name + strlen("numa_stat_");
+                if (ser->node >= 0)
+                    PUT("%s_info{node=\"%d\",%s=\"", fam->name, ser->node, label);
+                else
+                    PUT("%s_info{%s=\"", fam->name, label);
+                p += put_escaped(p, (size_t)(end - p), text);
+                PUT("\"} 1\n");
+                continue;
+            }
+
+            if (ser->node >= 0)
+                PUT("%s%s{node=\"%d\"} ", fam->name, suffix, ser->node);
+            else
+                PUT("%s%s ", fam->name, suffix);
+            p += put_value(p, (size_t)(end - p), ls->types[ser->col], v);
+            PUT("\n");
+        }
+    }
+
+    if (s->nhist)
+        PUT("# TYPE " HIST_NAME " histogram\n");
+    for (int i = 0; i < s->nhist; i++) {
+        const struct serve_hist* h = &s->hist[i];
+        uint64_t total = 0;
+        for (int b = 0; b < SERVE_BUCKETS; b++) {
+            total += h->counts[b];
+            if (b < SERVE_BUCKETS - 1)
+                PUT(HIST_NAME "_bucket{node=\"%d\",le=\"%.1f\"} %" PRIu64 "\n",
+                    h->node, bucket_le[b], total);
+            else
+                PUT(HIST_NAME "_bucket{node=\"%d\",le=\"+Inf\"} %" PRIu64 "\n", h->node, total);
+        }
+        PUT(HIST_NAME "_count{node=\"%d\"} %" PRIu64 "\n", h->node, total);
+        PUT(HIST_NAME "_sum{node=\"%d\"} %.17g\n", h->node, h->sum);
+    }
+    PUT("# EOF\n");
+
+    char header[HEADER_ROOM];
+    int hlen = snprintf(header, sizeof(header),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+        "Content-Length: %zu\r\n\r\n", (size_t)(p - body));
+    memcpy(body - hlen, header, (size_t)hlen);
+    s->response = body - hlen;
+    s->response_len = (size_t)hlen + (size_t)(p - body);
+}
+
+static void drop_client(struct serve* s, struct serve_client* c)
+{
+    epoll_ctl(s->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->pending);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+void serve_accept(struct serve* s)
+{
+    for (;;) {
+        int fd = accept4(s->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        int slot = 0;
+        while (slot < SERVE_MAX_CLIENTS && s->clients[slot].fd >= 0)
+            slot++;
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = s->ev_client + (uint32_t)slot };
+        if (slot == SERVE_MAX_CLIENTS || epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            continue;
+        }
+        s->clients[slot].fd = fd;
+    }
+}
+
+// Send a response; whatever the socket does not take right away is kept
+// and sent on EPOLLOUT. Returns -1 if the client is gone.
+static int respond(struct serve* s, struct serve_client* c, const char* data, size_t len)
+{
+    ssize_t n = send(c->fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        return -1;
+    size_t sent = n < 0 ? 0 : (size_t)n;
+    if (sent == len)
+        return c->close_after ? -1 : 0;
+
+    c->pending = malloc(len - sent);
+    if (!c->pending)
+        return -1;
+    memcpy(c->pending, data + sent, len - sent);
+    c->pending_len = len - sent;
+    c->pending_off = 0;
+    struct epoll_event ev = { .events = EPOLLOUT, .data.u32 = s->ev_client + (uint32_t)(c - s->clients) };
+    return epoll_ctl(s->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+static int flush_pending(struct serve* s, struct serve_client* c)
+{
+    ssize_t n = send(c->fd, c->pending + c->pending_off, c->pending_len - c->pending_off,
+        MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    c->pending_off += (size_t)n;
+    if (c->pending_off < c->pending_len)
+        return 0;
+
+    free(c->pending);
+    c->pending = NULL;
+    if (c->close_after)
+        return -1;
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = s->ev_client + (uint32_t)(c - s->clients) };
+    return epoll_ctl(s->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+// Answer every complete request in the buffer. Connections are kept open
+// unless the client asks otherwise.
+static int handle_requests(struct serve* s, struct serve_client* c)
+{
+    char* eoh;
+    while (!c->pending && (eoh = memmem(c->req, c->len, "\r\n\r\n", 4)) != NULL) {
+        *eoh = '\0';
+        char method[8] = "", path[256] = "", version[16] = "";
+        sscanf(c->req, "%7s %255s %15s", method, path, version);
+        path[strcspn(path, "?")] = '\0';
+
+        int keep_alive = strcasestr(c->req, "\nConnection: keep-alive") != NULL;
+        c->close_after = strcasestr(c->req, "\nConnection: close") != NULL ||
+            (strcmp(version, "HTTP/1.1") != 0 && !keep_alive);
+
+        size_t used = (size_t)(eoh + 4 - c->req);
+        c->len -= used;
+        memmove(c->req, eoh + 4, c->len);
+
+        int ret;
+        if (strcmp(method, "GET") != 0)
+            ret = respond(s, c, bad_method, sizeof(bad_method) - 1);
+        else if (strcmp(path, "/metrics") != 0 && strcmp(path, "/") != 0)
+            ret = respond(s, c, not_found, sizeof(not_found) - 1);
+        else {
+            if (s->dirty) {
+                render(s);
+                s->dirty = 0;
+            }
+            ret = respond(s, c, s->response, s->response_len);
+        }
+        if (ret != 0)
+            return -1;
+    }
+    return 0;
+}
+
+void serve_client(struct serve* s, int slot, uint32_t events)
+{
+    if (slot < 0 || slot >= SERVE_MAX_CLIENTS || s->clients[slot].fd < 0)
+        return;
+    struct serve_client* c = &s->clients[slot];
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        drop_client(s, c);
+        return;
+    }
+    if ((events & EPOLLOUT) && c->pending && flush_pending(s, c) != 0) {
+        drop_client(s, c);
+        return;
+    }
+    if (!(events & EPOLLIN))
+        return;
+
+    ssize_t n = recv(c->fd, c->req + c->len, sizeof(c->req) - c->len, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+    if (n <= 0) {
+        drop_client(s, c);
+        return;
+    }
+    c->len += (size_t)n;
+
+    // A header that does not fit is not a scrape.
+    if (handle_requests(s, c) != 0 || c->len == sizeof(c->req))
+        drop_client(s, c);
+}
+
+void serve_close(struct serve* s)
+{
+    for (int i = 0; i < SERVE_MAX_CLIENTS; i++)
+        if (s->clients[i].fd >= 0)
+            drop_client(s, &s->clients[i]);
+    if (s->listen_fd >= 0)
+        close(s->listen_fd);
+    free(s->families);
+    free(s->series);
+    free(s->hist);
+    free(s->row);
+    free(s->buf);
+    memset(s, 0, sizeof(*s));
+    s->listen_fd = -1;
+}
@@ -0,0 +1,83 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdint.h>
+
+#include "cell.h"
+#include "logfmt.h"
+
+#define SERVE_MAX_CLIENTS 64
+#define SERVE_BUCKETS 9
+
+// One group of output columns exported as one metric: node_<N>_<name>
+// columns become numa_stat_<name>{node="N"}, the others numa_stat_<name>.
+struct serve_family {
+    char name[LOG_NAME_MAX + 16];
+    enum cell_type type;
+    int counter;    // exported as <name>_total
+    int first;      // index into serve.series
+    int n;
+};
+
+struct serve_series {
+    int col;
+    int node;       // -1 for system-wide columns
+};
+
+// Per-node histogram of the per-interval numa_miss rate (misses/s).
+struct serve_hist {
+    int col;
+    int node;
+    uint64_t prev;
+    uint64_t counts[SERVE_BUCKETS];
+    double sum;
+};
+
+struct serve_client {
+    int fd;
+    char req[2048];
+    size_t len;
+    char* pending;      // unsent rest of a response, rarely needed
+    size_t pending_len;
+    size_t pending_off;
+    int close_after;
+};
+
+// --serve: an OpenMetrics endpoint for the latest row, served from the
+// logger's own epoll loop. The row is copied on every tick and rendered
+// into a preallocated buffer at most once per tick, on the first scrape
+// after it; every other scrape is a single send() of that buffer.
+struct serve {
+    int listen_fd;
+    int epfd;
+    uint32_t ev_client;
+    struct serve_client clients[SERVE_MAX_CLIENTS];
+
+    const struct log_schema* ls;
+    struct serve_family* families;
+    int nfamilies;
+    struct serve_series* series;
+
+    struct serve_hist* hist;
+    int nhist;
+    int64_t prev_ts_ns;
+
+    union cell* row;
+    int64_t row_ts_ns;
+    uint64_t rows;
+    int dirty;
+
+    char* buf;
+    size_t cap;
+    const char* response;
+    size_t response_len;
+};
+
+int serve_open(struct serve* s, const char* addr, const struct log_schema* ls, const unsigned char* counters);
+int serve_watch(struct serve* s, int epfd, uint32_t ev_listen, uint32_t ev_client);
+void serve_accept(struct serve* s);
+void serve_client(struct serve* s, int slot, uint32_t events);
+void serve_update(struct serve* s, const struct record* rec);
+void serve_close(struct serve* s);
+
+#endif
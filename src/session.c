@@ -0,0 +1,235 @@
+#define _GNU_SOURCE
+#include "session.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+int session_open(struct session* s, const char* control_path)
+{
+    memset(s, 0, sizeof(*s));
+    s->listen_fd = -1;
+    s->fd = STDIN_FILENO;
+    s->out_fd = STDOUT_FILENO;
+    s->col = -1;
+    s->control_path = control_path;
+    if (!control_path)
+        return 0;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(control_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "--control path too long: %s\n", control_path);
+        return -1;
+    }
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", control_path);
+
+    s->fd = -1;
+    s->out_fd = -1;
+    s->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s->listen_fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(control_path);
+    if (bind(s->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(s->listen_fd, 1) != 0) {
+        perror(control_path);
+        return -1;
+    }
+    return 0;
+}
+
+// mem_policy, then the run number under the driver's column name.
+int session_add_columns(struct session* s, struct log_schema* ls, const char* run_column)
+{
+    s->col = log_schema_add(ls, "mem_policy", CELL_LABEL);
+    if (s->col < 0 || log_schema_add(ls, run_column, CELL_U64) < 0)
+        return -1;
+    ls->keys[s->col] = 1;
+    ls->keys[s->col + 1] = 1;
+    return 0;
+}
+
+int session_watch(struct session* s, int epfd, uint32_t ev_listen, uint32_t ev_control)
+{
+    struct epoll_event ev = { .events = EPOLLIN };
+    if (s->listen_fd >= 0) {
+        ev.data.u32 = ev_listen;
+        return epoll_ctl(epfd, EPOLL_CTL_ADD, s->listen_fd, &ev);
+    }
+    ev.data.u32 = ev_control;
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev);
+}
+
+// Take the driver's connection on the control socket. There is only ever
+// one controller; later connections are turned away.
+int session_accept(struct session* s, int epfd, uint32_t ev_control)
+{
+    int fd = accept4(s->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0)
+        return errno == EINTR || errno == EAGAIN ? 0 : -1;
+    if (s->fd >= 0) {
+        dprintf(fd, "error session already has a controller\n");
+        close(fd);
+        return 0;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = ev_control };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        close(fd);
+        return -1;
+    }
+    s->fd = fd;
+    s->out_fd = fd;
+    return 0;
+}
+
+// Pull in what the controller sent. Returns 0 at end of input, which ends
+// the session unless keep is set: then a closed --control connection only
+// frees the socket for the next controller, and the session carries on.
+int session_read(struct session* s)
+{
+    if (s->len == sizeof(s->buf)) {
+        session_reply(s, "error command too long");
+        s->len = 0;
+    }
+
+    ssize_t n = read(s->fd, s->buf + s->len, sizeof(s->buf) - s->len);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return 1;
+    if (n <= 0 && s->keep && s->listen_fd >= 0) {
+        close(s->fd);
+        s->fd = -1;
+        s->out_fd = -1;
+        s->len = 0;
+        return 1;
+    }
+    if (n < 0)
+        return 0;
+    s->len += (size_t)n;
+    return n > 0;
+}
+
+// Labels are written into CSV rows unquoted and into <log>.labels one per
+// line, so they cannot hold a separator or a quote.
+static int check_label(struct session* s, const char* label)
+{
+    if (strpbrk(label, ",\"")) {
+        session_reply(s, "error label '%s' contains ',' or '\"'", label);
+        return -1;
+    }
+    return 0;
+}
+
+static enum session_cmd parse_command(struct session* s, char* line)
+{
+    char* save;
+    char* cmd = strtok_r(line, " \t\r", &save);
+    char* a = strtok_r(NULL, " \t\r", &save);
+    char* b = strtok_r(NULL, " \t\r", &save);
+    char* end;
+
+    if (!cmd)
+        return SESSION_NONE;
+
+    if (strcmp(cmd, "start") == 0 && a && b) {
+        s->num = strtol(a, &end, 10);
+        if (*end || s->num < 0) {
+            session_reply(s, "error invalid run number '%s'", a);
+            return SESSION_NONE;
+        }
+        if (check_label(s, b) != 0)
+            return SESSION_NONE;
+        snprintf(s->arg, sizeof(s->arg), "%s", b);
+        return SESSION_START;
+    }
+    if (strcmp(cmd, "policy") == 0 && a && !b) {
+        if (check_label(s, a) != 0)
+            return SESSION_NONE;
+        snprintf(s->arg, sizeof(s->arg), "%s", a);
+        return SESSION_POLICY;
+    }
+    if (strcmp(cmd, "attach") == 0 && a && !b) {
+        s->num = strtol(a, &end, 10);
+        if (*end || s->num <= 0) {
+            session_reply(s, "error invalid pid '%s'", a);
+            return SESSION_NONE;
+        }
+        return SESSION_ATTACH;
+    }
+    if (strcmp(cmd, "stop") == 0 && !a)
+        return SESSION_STOP;
+    if (strcmp(cmd, "quit") == 0 && !a)
+        return SESSION_QUIT;
+
+    session_reply(s, "error expected start <run> <label>, policy <label>, attach <pid>, stop or quit");
+    return SESSION_NONE;
+}
+
+// Return the next complete command, or SESSION_NONE once the buffered
+// input holds no more full lines. Malformed lines are answered here.
+enum session_cmd session_next(struct session* s)
+{
+    char* nl;
+    while ((nl = memchr(s->buf, '\n', s->len)) != NULL) {
+        char line[sizeof(s->buf)];
+        size_t n = (size_t)(nl - s->buf);
+        memcpy(line, s->buf, n);
+        line[n] = '\0';
+        s->len -= n + 1;
+        memmove(s->buf, nl + 1, s->len);
+
+        enum session_cmd cmd = parse_command(s, line);
+        if (cmd != SESSION_NONE)
+            return cmd;
+    }
+    return SESSION_NONE;
+}
+
+void session_reply(struct session* s, const char* fmt, ...)
+{
+    if (s->out_fd < 0)
+        return;
+
+    char line[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        return;
+    if ((size_t)n > sizeof(line) - 2)
+        n = sizeof(line) - 2;
+    line[n++] = '\n';
+
+    // A controller that went away must not take the logger down with SIGPIPE.
+    ssize_t ret = s->listen_fd >= 0 ? send(s->out_fd, line, (size_t)n, MSG_NOSIGNAL)
+                                    : write(s->out_fd, line, (size_t)n);
+    if (ret < 0 && errno != EPIPE)
+        perror("session reply");
+}
+
+void session_fill(const struct session* s, union cell* cells)
+{
+    cells[s->col].u = s->label;
+    cells[s->col + 1].u = s->run;
+}
+
+void session_close(struct session* s)
+{
+    if (s->listen_fd >= 0) {
+        if (s->fd >= 0)
+            close(s->fd);
+        close(s->listen_fd);
+        unlink(s->control_path);
+    }
+    s->listen_fd = -1;
+    s->fd = -1;
+    s->out_fd = -1;
+}
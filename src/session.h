@@ -0,0 +1,54 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "cell.h"
+#include "logfmt.h"
+
+enum session_cmd {
+    SESSION_NONE,
+    SESSION_START,      // start <run> <label>
+    SESSION_POLICY,     // policy <label>
+    SESSION_ATTACH,     // attach <pid>
+    SESSION_STOP,       // stop
+    SESSION_QUIT,       // quit, or end of input
+};
+
+// Session mode (-s): one long-lived logger records many runs into a single
+// output. A driver sends one command per line on stdin, or over a Unix
+// socket with --control, and gets an "ok ..." or "error ..." line back for
+// each. Rows are only taken while a run is started, and every row carries
+// the run's mem_policy label and run number.
+struct session {
+    int listen_fd;
+    int fd;
+    int out_fd;
+    char buf[1024];
+    size_t len;
+
+    int active;
+    uint64_t run;
+    uint64_t label;
+    uint64_t rows;
+    int col;
+    const char* control_path;
+    int keep;           // --control-keep: outlive a controller's disconnect
+
+    // Arguments of the last command from session_next().
+    char arg[LOG_NAME_MAX];
+    long num;
+};
+
+int session_open(struct session* s, const char* control_path);
+int session_add_columns(struct session* s, struct log_schema* ls, const char* run_column);
+int session_watch(struct session* s, int epfd, uint32_t ev_listen, uint32_t ev_control);
+int session_accept(struct session* s, int epfd, uint32_t ev_control);
+int session_read(struct session* s);
+enum session_cmd session_next(struct session* s);
+void session_reply(struct session* s, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+void session_fill(const struct session* s, union cell* cells);
+void session_close(struct session* s);
+
+#endif
@@ -0,0 +1,204 @@
+#include "shm.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// shm_open() wants a single leading slash.
+static void shm_path(char* buf, size_t len, const char* name)
+{
+    snprintf(buf, len, "/%s", name[0] == '/' ? name + 1 : name);
+}
+
+static unsigned char* slot_at(unsigned char* slots, const struct shm_header* h, uint64_t n)
+{
+    return slots + (n % h->nslots) * h->slot_size;
+}
+
+int shm_export_open(struct shm_export* e, const char* name, const struct log_schema* ls, uint32_t nslots)
+{
+    memset(e, 0, sizeof(*e));
+    shm_path(e->name, sizeof(e->name), name);
+
+    uint32_t columns_offset = sizeof(struct shm_header);
+    uint32_t labels_offset = columns_offset + sizeof(struct shm_column) * ls->ncols;
+    uint32_t header_size = (labels_offset + LOG_LABELS_MAX * LOG_NAME_MAX + 63) & ~63u;
+    uint32_t slot_size = (16 + 8 * ls->ncols + 63) & ~63u;
+    e->size = header_size + (size_t)slot_size * nslots;
+
+    // A segment left by an earlier logger is replaced, not reused, so its
+    // readers keep their old mapping instead of seeing it change size.
+    shm_unlink(e->name);
+    int fd = shm_open(e->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror(e->name);
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)e->size) != 0) {
+        perror(e->name);
+        close(fd);
+        shm_unlink(e->name);
+        return -1;
+    }
+    void* p = mmap(NULL, e->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror(e->name);
+        shm_unlink(e->name);
+        return -1;
+    }
+
+    // The new segment is all zeroes, so every slot starts with seq 0.
+    e->h = p;
+    e->slots = (unsigned char*)p + header_size;
+    struct shm_header* h = e->h;
+    h->version = SHM_VERSION;
+    h->header_size = header_size;
+    h->ncols = (uint32_t)ls->ncols;
+    h->node_count = (uint32_t)ls->node_count;
+    h->slot_size = slot_size;
+    h->nslots = nslots;
+    h->columns_offset = columns_offset;
+    h->labels_offset = labels_offset;
+    h->pid = (int32_t)getpid();
+
+    struct shm_column* cols = (struct shm_column*)((unsigned char*)p + columns_offset);
+    for (int i = 0; i < ls->ncols; i++) {
+        cols[i].type = ls->types[i];
+        cols[i].key = ls->keys[i];
+        snprintf(cols[i].name, sizeof(cols[i].name), "%s", ls->names[i]);
+    }
+
+    // The magic goes in last: a reader that sees it sees a whole header.
+    atomic_thread_fence(memory_order_release);
+    memcpy(h->magic, SHM_MAGIC, 8);
+    return 0;
+}
+
+void shm_export_publish(struct shm_export* e, const struct log_schema* ls, const struct record* rec)
+{
+    struct shm_header* h = e->h;
+
+    // Labels are only ever appended; their text is in place before the
+    // count that makes them visible.
+    uint32_t nlabels = atomic_load_explicit(&h->nlabels, memory_order_relaxed);
+    if ((int)nlabels < ls->nlabels) {
+        char (*labels)[LOG_NAME_MAX] = (void*)((unsigned char*)h + h->labels_offset);
+        for (int i = (int)nlabels; i < ls->nlabels; i++)
+            memcpy(labels[i], ls->labels[i], LOG_NAME_MAX);
+        atomic_store_explicit(&h->nlabels, (uint32_t)ls->nlabels, memory_order_release);
+    }
+
+    unsigned char* slot = slot_at(e->slots, h, e->n);
+    _Atomic uint64_t* seq = (_Atomic uint64_t*)slot;
+    atomic_store_explicit(seq, 2 * e->n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(slot + 8, &rec->ts_ns, 8);
+    memcpy(slot + 16, rec->cells, 8 * (size_t)ls->ncols);
+    atomic_store_explicit(seq, 2 * e->n + 2, memory_order_release);
+
+    e->n++;
+    atomic_store_explicit(&h->published, e->n, memory_order_release);
+}
+
+// The segment is unlinked at exit; readers that still map it see the last
+// rows and can tell that nothing new arrives from the pid.
+void shm_export_close(struct shm_export* e)
+{
+    if (!e->h)
+        return;
+    munmap(e->h, e->size);
+    shm_unlink(e->name);
+    e->h = NULL;
+}
+
+// Map a segment read-only and describe its columns in ls.
+int shm_reader_open(struct shm_reader* r, const char* name, struct log_schema* ls)
+{
+    char path[256];
+    memset(r, 0, sizeof(*r));
+    shm_path(path, sizeof(path), name);
+
+    int fd = shm_open(path, O_RDONLY | O_CLOEXEC, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    void* p = st.st_size >= (off_t)sizeof(struct shm_header) ?
+        mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "%s: not a numa_stat_logger shared-memory export\n", path);
+        return -1;
+    }
+    r->h = p;
+    r->size = (size_t)st.st_size;
+
+    const struct shm_header* h = r->h;
+    if (memcmp(h->magic, SHM_MAGIC, 8) != 0 || h->version != SHM_VERSION || h->nslots == 0 ||
+        h->header_size + (size_t)h->slot_size * h->nslots > r->size ||
+        h->slot_size < 16 + 8 * h->ncols ||
+        h->columns_offset + sizeof(struct shm_column) * h->ncols > h->labels_offset ||
+        log_schema_init(ls, (int)h->node_count, (int)h->ncols) != 0) {
+        fprintf(stderr, "%s: not a numa_stat_logger shared-memory export\n", path);
+        shm_reader_close(r);
+        return -1;
+    }
+    r->slots = (const unsigned char*)p + h->header_size;
+
+    const struct shm_column* cols = (const void*)((const unsigned char*)p + h->columns_offset);
+    for (uint32_t i = 0; i < h->ncols; i++) {
+        ls->types[i] = cols[i].type;
+        ls->keys[i] = cols[i].key;
+        snprintf(ls->names[i], LOG_NAME_MAX, "%.*s", (int)sizeof(cols[i].name) - 1, cols[i].name);
+    }
+    shm_reader_labels(r, ls);
+    return 0;
+}
+
+uint64_t shm_reader_published(const struct shm_reader* r)
+{
+    return atomic_load_explicit(&r->h->published, memory_order_acquire);
+}
+
+// Copy row n. Returns 1 on success, 0 if it is not published yet or was
+// overwritten (before or during the copy).
+int shm_reader_read(const struct shm_reader* r, uint64_t n, int64_t* ts_ns, union cell* cells)
+{
+    const unsigned char* slot = slot_at((unsigned char*)r->slots, r->h, n);
+    const _Atomic uint64_t* seq = (const _Atomic uint64_t*)slot;
+
+    if (atomic_load_explicit(seq, memory_order_acquire) != 2 * n + 2)
+        return 0;
+    memcpy(ts_ns, slot + 8, 8);
+    memcpy(cells, slot + 16, 8 * (size_t)r->h->ncols);
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(seq, memory_order_relaxed) == 2 * n + 2;
+}
+
+// Pick up labels published since the last call.
+void shm_reader_labels(const struct shm_reader* r, struct log_schema* ls)
+{
+    const char (*labels)[LOG_NAME_MAX] = (const void*)((const unsigned char*)r->h + r->h->labels_offset);
+    uint32_t n = atomic_load_explicit(&r->h->nlabels, memory_order_acquire);
+    for (int i = ls->nlabels; i < (int)n && i < LOG_LABELS_MAX; i++) {
+        char text[LOG_NAME_MAX];
+        snprintf(text, sizeof(text), "%.*s", LOG_NAME_MAX - 1, labels[i]);
+        if (log_schema_label(ls, text) < 0)
+            break;
+    }
+}
+
+void shm_reader_close(struct shm_reader* r)
+{
+    if (r->h)
+        munmap((void*)r->h, r->size);
+    r->h = NULL;
+}
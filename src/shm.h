@@ -0,0 +1,73 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "cell.h"
+#include "logfmt.h"
+
+#define SHM_MAGIC "NUMASHM1"
+#define SHM_VERSION 1
+
+// Live export of the latest rows through POSIX shared memory (--shm). The
+// segment /dev/shm/<name> holds, in native byte order:
+//
+//   struct shm_header                       (128 bytes)
+//   ncols x struct shm_column               at columns_offset
+//   LOG_LABELS_MAX x char[LOG_NAME_MAX]     at labels_offset
+//   nslots x slot                           at header_size
+//
+// A slot is { u64 seq, i64 ts_ns, ncols x 8-byte cell } padded to a multiple
+// of 64 bytes. Row n (counting from 0) goes to slot n % nslots; its seq is
+// odd while it is written and 2 * n + 2 once it is complete. Readers copy
+// the slot and accept it if seq had that value before and after the copy,
+// so they never block the logger and cost it nothing.
+struct shm_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t ncols;
+    uint32_t node_count;
+    uint32_t slot_size;
+    uint32_t nslots;
+    uint32_t columns_offset;
+    uint32_t labels_offset;
+    int32_t pid;
+    uint32_t reserved;
+
+    _Alignas(64) _Atomic uint64_t published;    // rows published so far
+    _Atomic uint32_t nlabels;
+};
+
+struct shm_column {
+    uint8_t type;
+    uint8_t key;
+    char name[LOG_NAME_MAX - 2];
+};
+
+struct shm_export {
+    char name[256];
+    struct shm_header* h;
+    size_t size;
+    unsigned char* slots;
+    uint64_t n;
+};
+
+int shm_export_open(struct shm_export* e, const char* name, const struct log_schema* ls, uint32_t nslots);
+void shm_export_publish(struct shm_export* e, const struct log_schema* ls, const struct record* rec);
+void shm_export_close(struct shm_export* e);
+
+struct shm_reader {
+    const struct shm_header* h;
+    size_t size;
+    const unsigned char* slots;
+};
+
+int shm_reader_open(struct shm_reader* r, const char* name, struct log_schema* ls);
+uint64_t shm_reader_published(const struct shm_reader* r);
+int shm_reader_read(const struct shm_reader* r, uint64_t n, int64_t* ts_ns, union cell* cells);
+void shm_reader_labels(const struct shm_reader* r, struct log_schema* ls);
+void shm_reader_close(struct shm_reader* r);
+
+#endif
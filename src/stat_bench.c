@@ -0,0 +1,464 @@
+// Microbenchmark and correctness check for the parsers of the sampled
+// files, run over copies of the kernel snapshots in ../snapshots.
+//
+//   make bench
+//   ./stat_bench [-n iterations] [snapshot_dir]
+//
+// Every case first checks the parsed values against the ones pinned below,
+// on the cold path (full scan), the cached-line path and after a layout
+// change, then times both paths. Heap allocations are counted through
+// -Wl,--wrap, so the timed loops must report zero.
+//
+// The stat parser cases use the keys of the collectors that read those
+// files: the node and system counters, hugepages, the cgroup's memory.stat
+// and the VmRSS of a process. memory.numa_stat and numa_maps have parsers
+// of their own, which are checked and timed the same way. The numa_maps
+// reader is also checked on a generated file with a mapping line several
+// times longer than its initial read window.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cgroup.h"
+#include "numa_maps.h"
+#include "nodes.h"
+#include "stat_parse.h"
+
+#define ABSENT UINT64_MAX
+
+static uint64_t alloc_count;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    alloc_count++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    alloc_count++;
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    alloc_count++;
+    return __real_realloc(ptr, size);
+}
+
+struct expect {
+    const char* key;
+    uint64_t value;     // ABSENT: the key must not be found
+};
+
+struct bench_case {
+    const char* name;
+    const char* file;
+    const struct expect* keys;
+    int nkeys;
+};
+
+static const struct expect node_meminfo[] = {
+    { "MemTotal", 32863468 },
+    { "MemUsed", 1663344 },
+    { "MemFree", 31200124 },
+    { "FilePages", 1200968 },
+    { "AnonHugePages", 0 },
+    { "NoSuchKey", ABSENT },
+};
+
+static const struct expect node_vmstat[] = {
+    { "nr_free_pages", 7800052 },
+    { "numa_hit", 9299219 },
+    { "numa_miss", 0 },
+    { "numa_foreign", 0 },
+    { "numa_interleave", 48 },
+    { "numa_local", 9293422 },
+    { "numa_other", 5797 },
+    { "nr_anon_pages", 19925 },
+};
+
+static const struct expect sys_vmstat[] = {
+    { "nr_free_pages", 15786659 },
+    { "numa_hit", 13815052 },
+    { "numa_pte_updates", 93864 },
+    { "numa_huge_pte_updates", 0 },
+    { "numa_pages_migrated", 6071 },
+    { "pgmigrate_success", 6071 },
+    { "pgmigrate_fail", 1 },
+    { "thp_migration_success", 0 },
+    { "thp_migration_fail", 0 },
+    { "thp_migration_split", 0 },
+    { "numa_hint_faults", 87379 },
+    { "pgpromote_success", 0 },
+    { "numa_hint", ABSENT },
+};
+
+static const struct expect sys_meminfo[] = {
+    { "MemTotal", 32863468 },
+    { "MemUsed", 1676096 },
+    { "FilePages", 1201024 },
+};
+
+// hugepages.c; the pool sizes are single-number sysfs files.
+static const struct expect hugepages[] = {
+    { "AnonHugePages", 0 },
+    { "ShmemHugePages", 0 },
+    { "FilePages", 1200968 },
+};
+
+// cgroup.c. The snapshot has "anon_thp" and "file_thp" after "anon" and
+// "file", which must not match them.
+static const struct expect cg_memstat[] = {
+    { "anon", 1133256704 },
+    { "file", 2960379904 },
+    { "numa_pages_migrated", 48213 },
+    { "numa_hint_faults", 259017 },
+    { "pgpromote_success", 0 },
+    { "pgdemote_kswapd", 0 },
+    { "pgdemote_direct", 0 },
+};
+
+// proc_numa.c
+static const struct expect proc_status[] = {
+    { "VmRSS", 8744 },
+};
+
+#define CASE(name, file, keys) { name, file, keys, sizeof(keys) / sizeof(keys[0]) }
+
+static const struct bench_case cases[] = {
+    CASE("node meminfo", "per-node-meminfo.txt", node_meminfo),
+    CASE("node vmstat", "per-node-vmstat.txt", node_vmstat),
+    CASE("vmstat", "global-vmstat.txt", sys_vmstat),
+    CASE("meminfo", "global-meminfo.txt", sys_meminfo),
+    CASE("hugepages", "per-node-meminfo.txt", hugepages),
+    CASE("cgroup memory.stat", "cgroup-memory.stat.txt", cg_memstat),
+    CASE("proc status", "proc-status.txt", proc_status),
+};
+
+// cgroup-memory.numa_stat.txt, CGROUP_NUMA_KEYS values per node.
+static const char cg_numa_nodes[] = "0,1";
+static const uint64_t cg_numa_stat[] = {
+    775995392, 2174287872, 419430400, 14692352,
+    357261312, 786092032, 209715200, 5242880,
+};
+
+// proc-numa_maps.txt, kB per node.
+static const char maps_nodes[] = "0";
+static const uint64_t maps_kb[] = { 8744 };
+
+static char* load_file(const char* dir, const char* name)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return NULL;
+    }
+
+    // One extra line in front, so the same buffer also serves as a
+    // snapshot whose layout changed.
+    static const char shift[] = "bench_inserted_line 1\n";
+    size_t cap = 1 << 16;
+    char* buf = malloc(cap);
+    if (!buf) {
+        fclose(fp);
+        return NULL;
+    }
+    size_t len = fread(buf + sizeof(shift) - 1, 1, cap - sizeof(shift), fp);
+    fclose(fp);
+    memcpy(buf, shift, sizeof(shift) - 1);
+    buf[sizeof(shift) - 1 + len] = '\0';
+    return buf;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int check(const struct bench_case* c, const uint64_t* got, int found, const char* path)
+{
+    int want_found = 0, bad = 0;
+    for (int i = 0; i < c->nkeys; i++) {
+        want_found += c->keys[i].value != ABSENT;
+        if (got[i] != c->keys[i].value) {
+            fprintf(stderr, "FAIL %s (%s): %s = %llu, expected %llu\n", c->name, path,
+                c->keys[i].key, (unsigned long long)got[i], (unsigned long long)c->keys[i].value);
+            bad = 1;
+        }
+    }
+    if (found != want_found) {
+        fprintf(stderr, "FAIL %s (%s): found %d keys, expected %d\n", c->name, path, found, want_found);
+        bad = 1;
+    }
+    return bad;
+}
+
+static int run_case(const struct bench_case* c, const char* dir, long iterations)
+{
+    char* shifted = load_file(dir, c->file);
+    if (!shifted)
+        return 1;
+    char* buf = strchr(shifted, '\n') + 1;
+
+    struct stat_key keys[32];
+    uint64_t got[32];
+    for (int i = 0; i < c->nkeys; i++) {
+        keys[i].key = c->keys[i].key;
+        keys[i].offset = i * sizeof(uint64_t);
+    }
+
+    struct stat_parser p;
+    if (stat_parser_init(&p, keys, c->nkeys) != 0) {
+        fprintf(stderr, "FAIL %s: stat_parser_init\n", c->name);
+        free(shifted);
+        return 1;
+    }
+
+    // --- Correctness: cold, cached, then a moved layout and back ---
+    int bad = 0;
+    static const char* const paths[] = { "full scan", "cached lines", "layout change", "layout change back" };
+    for (int pass = 0; pass < 4; pass++) {
+        memset(got, 0xff, sizeof(got));
+        int found = stat_parser_run(&p, pass == 2 ? shifted : buf, got);
+        bad |= check(c, got, found, paths[pass]);
+    }
+    if (bad) {
+        stat_parser_free(&p);
+        free(shifted);
+        return 1;
+    }
+
+    // --- Timing ---
+    volatile uint64_t sink = 0;
+    long cold_iterations = iterations / 10 ? iterations / 10 : 1;
+
+    uint64_t allocs = alloc_count;
+    double t0 = now_sec();
+    for (long i = 0; i < cold_iterations; i++) {
+        p.cached = 0;
+        stat_parser_run(&p, buf, got);
+        sink += got[0];
+    }
+    double t1 = now_sec();
+    for (long i = 0; i < iterations; i++) {
+        stat_parser_run(&p, buf, got);
+        sink += got[0];
+    }
+    double t2 = now_sec();
+    allocs = alloc_count - allocs;
+
+    printf("%-22s %5zu B %3d keys  full %8.1f ns  cached %8.1f ns  allocs/parse %.3f\n",
+        c->name, strlen(buf), c->nkeys,
+        (t1 - t0) * 1e9 / cold_iterations, (t2 - t1) * 1e9 / iterations,
+        (double)allocs / (double)(iterations + cold_iterations));
+
+    stat_parser_free(&p);
+    free(shifted);
+    return allocs != 0;
+}
+
+// memory.numa_stat is scanned whole on every sample.
+static int run_cgroup_numa_stat(const char* dir, long iterations)
+{
+    enum { NVALUES = sizeof(cg_numa_stat) / sizeof(cg_numa_stat[0]) };
+    char* shifted = load_file(dir, "cgroup-memory.numa_stat.txt");
+    if (!shifted)
+        return 1;
+    char* buf = strchr(shifted, '\n') + 1;
+
+    struct node_set nodes;
+    if (node_set_parse(&nodes, cg_numa_nodes) != 0) {
+        free(shifted);
+        return 1;
+    }
+
+    union cell got[NVALUES];
+    int bad = 0;
+    memset(got, 0, sizeof(got));
+    cgroup_parse_numa_stat(buf, &nodes, got);
+    for (int i = 0; i < NVALUES; i++) {
+        if (got[i].u != cg_numa_stat[i]) {
+            fprintf(stderr, "FAIL cgroup memory.numa_stat: value %d of node %d = %llu, expected %llu\n",
+                i % CGROUP_NUMA_KEYS, nodes.ids[i / CGROUP_NUMA_KEYS],
+                (unsigned long long)got[i].u, (unsigned long long)cg_numa_stat[i]);
+            bad = 1;
+        }
+    }
+
+    long n = iterations / 10 ? iterations / 10 : 1;
+    uint64_t allocs = alloc_count;
+    double t0 = now_sec();
+    for (long i = 0; i < n && !bad; i++)
+        cgroup_parse_numa_stat(buf, &nodes, got);
+    double t1 = now_sec();
+    allocs = alloc_count - allocs;
+
+    if (!bad)
+        printf("%-22s %5zu B %3d keys  full %8.1f ns  %16s  allocs/parse %.3f\n",
+            "cgroup numa_stat", strlen(buf), CGROUP_NUMA_KEYS,
+            (t1 - t0) * 1e9 / n, "", (double)allocs / (double)n);
+
+    node_set_free(&nodes);
+    free(shifted);
+    return bad || allocs != 0;
+}
+
+// numa_maps is read into the reader's own window, so this times the read()
+// calls from the page cache together with the parse.
+static int run_numa_maps(const char* dir, long iterations)
+{
+    enum { NNODES = sizeof(maps_kb) / sizeof(maps_kb[0]) };
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, "proc-numa_maps.txt");
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+
+    struct node_set nodes;
+    struct numa_maps m;
+    if (node_set_parse(&nodes, maps_nodes) != 0) {
+        close(fd);
+        return 1;
+    }
+    if (numa_maps_init(&m, &nodes) != 0) {
+        node_set_free(&nodes);
+        close(fd);
+        return 1;
+    }
+
+    uint64_t got[NNODES] = { 0 };
+    int bad = numa_maps_read(&m, fd, got) != 0;
+    for (int i = 0; i < NNODES && !bad; i++) {
+        if (got[i] != maps_kb[i]) {
+            fprintf(stderr, "FAIL numa_maps: node %d = %llu kB, expected %llu kB\n",
+                nodes.ids[i], (unsigned long long)got[i], (unsigned long long)maps_kb[i]);
+            bad = 1;
+        }
+    }
+
+    long n = iterations / 100 ? iterations / 100 : 1;
+    uint64_t allocs = alloc_count;
+    double t0 = now_sec();
+    for (long i = 0; i < n && !bad; i++) {
+        memset(got, 0, sizeof(got));
+        lseek(fd, 0, SEEK_SET);
+        bad = numa_maps_read(&m, fd, got) != 0;
+    }
+    double t1 = now_sec();
+    allocs = alloc_count - allocs;
+
+    if (!bad)
+        printf("%-22s %5lld B %3d nodes read %8.1f ns  %16s  allocs/parse %.3f\n",
+            "numa_maps", (long long)lseek(fd, 0, SEEK_END), NNODES,
+            (t1 - t0) * 1e9 / n, "", (double)allocs / (double)n);
+
+    numa_maps_free(&m);
+    node_set_free(&nodes);
+    close(fd);
+    return bad || allocs != 0;
+}
+
+// A file-backed mapping whose name is longer than two read windows, so the
+// line has to be carried across reads, between two ordinary lines; the
+// last one has no newline. The name length is varied so that read
+// boundaries fall inside every token of the counts.
+static int check_numa_maps_line(struct numa_maps* m, size_t name_len)
+{
+    static const char head[] = "00400000 default file=/usr/bin/bench mapped=3 N0=3 kernelpagesize_kB=4\n"
+                               "7f0000000000 default file=/";
+    static const char tail[] = " huge dirty=5 N0=2 N1=3 kernelpagesize_kB=2048\n"
+                               "7ffc00000000 default stack anon=7 dirty=7 N1=7 kernelpagesize_kB=4";
+    const uint64_t want[2] = { 3 * 4 + 2 * 2048, 3 * 2048 + 7 * 4 };
+
+    FILE* fp = tmpfile();
+    if (!fp) {
+        perror("tmpfile");
+        return 1;
+    }
+    fputs(head, fp);
+    for (size_t i = 0; i < name_len; i++)
+        fputc('a' + (int)(i % 26), fp);
+    fputs(tail, fp);
+    fflush(fp);
+    rewind(fp);
+
+    uint64_t got[2] = { 0, 0 };
+    int bad = numa_maps_read(m, fileno(fp), got) != 0 || got[0] != want[0] || got[1] != want[1];
+    if (bad)
+        fprintf(stderr, "FAIL numa_maps (%zu B name): N0 %llu kB, N1 %llu kB, expected %llu, %llu\n",
+            name_len, (unsigned long long)got[0], (unsigned long long)got[1],
+            (unsigned long long)want[0], (unsigned long long)want[1]);
+    fclose(fp);
+    return bad;
+}
+
+static int check_numa_maps(void)
+{
+    struct node_set nodes;
+    struct numa_maps m;
+    if (node_set_parse(&nodes, "0,1") != 0)
+        return 1;
+    if (numa_maps_init(&m, &nodes) != 0) {
+        node_set_free(&nodes);
+        return 1;
+    }
+
+    int bad = 0;
+    for (size_t extra = 0; extra < 128 && !bad; extra++)
+        bad = check_numa_maps_line(&m, 2 * NUMA_MAPS_WINDOW + extra);
+    if (!bad)
+        printf("numa_maps long lines   %zu B window grown to %zu B, counts intact\n",
+            (size_t)NUMA_MAPS_WINDOW, m.cap);
+
+    numa_maps_free(&m);
+    node_set_free(&nodes);
+    return bad;
+}
+
+int main(int argc, char* argv[])
+{
+    long iterations = 2000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n' && atol(optarg) > 0) {
+            iterations = atol(optarg);
+        }
+        else {
+            fprintf(stderr, "Usage: %s [-n iterations] [snapshot_dir]\n", argv[0]);
+            return 1;
+        }
+    }
+    const char* dir = optind < argc ? argv[optind] : "../snapshots";
+
+    size_t ncases = sizeof(cases) / sizeof(cases[0]) + 2;
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        failed += run_case(&cases[i], dir, iterations);
+    failed += run_cgroup_numa_stat(dir, iterations);
+    failed += run_numa_maps(dir, iterations);
+
+    if (failed) {
+        fprintf(stderr, "%d of %zu parser cases failed\n", failed, ncases);
+        return 1;
+    }
+    if (check_numa_maps() != 0)
+        return 1;
+    printf("All %zu parser cases match the snapshots\n", ncases);
+    return 0;
+}
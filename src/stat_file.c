@@ -0,0 +1,70 @@
+#include "stat_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// sysfs attributes are at most one page; /proc/vmstat is a few pages.
+#define STAT_FILE_INITIAL_CAP 8192
+
+int stat_file_open(struct stat_file* sf, const char* path)
+{
+    sf->fd = -1;
+    sf->len = 0;
+    sf->cap = STAT_FILE_INITIAL_CAP;
+    sf->buf = malloc(sf->cap);
+    if (!sf->buf)
+        return -1;
+    sf->buf[0] = '\0';
+
+    sf->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (sf->fd < 0) {
+        free(sf->buf);
+        sf->buf = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Re-read the whole file from offset 0. The buffer only grows when the file
+// no longer fits, which happens at most a couple of times per run.
+int stat_file_read(struct stat_file* sf)
+{
+    if (sf->fd < 0)
+        return -1;
+
+    for (;;) {
+        ssize_t n = pread(sf->fd, sf->buf, sf->cap - 1, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            sf->len = 0;
+            sf->buf[0] = '\0';
+            return -1;
+        }
+
+        if ((size_t)n < sf->cap - 1) {
+            sf->len = (size_t)n;
+            sf->buf[n] = '\0';
+            return 0;
+        }
+
+        char* grown = realloc(sf->buf, sf->cap * 2);
+        if (!grown)
+            return -1;
+        sf->buf = grown;
+        sf->cap *= 2;
+    }
+}
+
+void stat_file_close(struct stat_file* sf)
+{
+    if (sf->fd >= 0)
+        close(sf->fd);
+    free(sf->buf);
+    sf->fd = -1;
+    sf->buf = NULL;
+    sf->cap = 0;
+    sf->len = 0;
+}
@@ -0,0 +1,19 @@
+#ifndef STAT_FILE_H
+#define STAT_FILE_H
+
+#include <stddef.h>
+
+// A sysfs/procfs stat file that is opened once and re-read in place with
+// pread() every sample. The contents are kept NUL-terminated in buf.
+struct stat_file {
+    int fd;
+    char* buf;
+    size_t cap;
+    size_t len;
+};
+
+int stat_file_open(struct stat_file* sf, const char* path);
+int stat_file_read(struct stat_file* sf);
+void stat_file_close(struct stat_file* sf);
+
+#endif
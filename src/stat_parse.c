@@ -0,0 +1,258 @@
+#include "stat_parse.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SEED_TRIES 4096
+#define MAX_TABLE_SIZE (1u << 15)
+
+static uint32_t key_hash(const char* s, size_t len, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+// Skip indentation and the "Node N " prefix of per-node meminfo lines.
+static const char* skip_prefix(const char* s)
+{
+    while (*s == ' ' || *s == '\t')
+        s++;
+    if (strncmp(s, "Node ", 5) == 0) {
+        s += 5;
+        while (*s >= '0' && *s <= '9')
+            s++;
+        while (*s == ' ')
+            s++;
+    }
+    return s;
+}
+
+static int is_key_end(char c)
+{
+    return c == ':' || c == ' ' || c == '\t' || c == '\n' || c == '\0';
+}
+
+static size_t key_span(const char* s)
+{
+    size_t n = 0;
+    while (!is_key_end(s[n]))
+        n++;
+    return n;
+}
+
+static const char* decode_u64(const char* s, uint64_t* out)
+{
+    while (*s == ':' || *s == ' ' || *s == '\t')
+        s++;
+    if (*s < '0' || *s > '9')
+        return NULL;
+
+    uint64_t v = 0;
+    while (*s >= '0' && *s <= '9') {
+        v = v * 10 + (uint64_t)(*s - '0');
+        s++;
+    }
+    *out = v;
+    return s;
+}
+
+static void store(const struct stat_parser* p, int idx, void* dst, uint64_t v)
+{
+    *(uint64_t*)((char*)dst + p->keys[idx].offset) = v;
+}
+
+static int lookup(const struct stat_parser* p, const char* k, size_t len)
+{
+    int idx = p->slots[key_hash(k, len, p->seed) & p->mask];
+    if (idx < 0 || p->key_len[idx] != len || memcmp(p->keys[idx].key, k, len) != 0)
+        return -1;
+    return idx;
+}
+
+// Find a seed for which every wanted key lands in its own slot.
+static int build_perfect_hash(struct stat_parser* p)
+{
+    uint32_t size = 8;
+    while (size < (uint32_t)p->nkeys * 2)
+        size <<= 1;
+
+    for (; size <= MAX_TABLE_SIZE; size <<= 1) {
+        int16_t* slots = malloc(sizeof(int16_t) * size);
+        if (!slots)
+            return -1;
+
+        for (uint32_t seed = 0; seed < MAX_SEED_TRIES; seed++) {
+            int ok = 1;
+            memset(slots, 0xff, sizeof(int16_t) * size);
+            for (int i = 0; i < p->nkeys && ok; i++) {
+                uint32_t slot = key_hash(p->keys[i].key, p->key_len[i], seed) & (size - 1);
+                if (slots[slot] >= 0)
+                    ok = 0;
+                else
+                    slots[slot] = (int16_t)i;
+            }
+            if (ok) {
+                p->slots = slots;
+                p->seed = seed;
+                p->mask = size - 1;
+                return 0;
+            }
+        }
+
+        free(slots);
+    }
+    return -1;
+}
+
+int stat_parser_init(struct stat_parser* p, const struct stat_key* keys, int nkeys)
+{
+    memset(p, 0, sizeof(*p));
+    p->keys = keys;
+    p->nkeys = nkeys;
+    p->key_len = malloc(nkeys ? nkeys : 1);
+    p->line_of_key = malloc(sizeof(int) * (nkeys ? nkeys : 1));
+    p->order = malloc(sizeof(int) * (nkeys ? nkeys : 1));
+    if (!p->key_len || !p->line_of_key || !p->order) {
+        stat_parser_free(p);
+        return -1;
+    }
+
+    if (nkeys > INT16_MAX) {
+        stat_parser_free(p);
+        return -1;
+    }
+    for (int i = 0; i < nkeys; i++) {
+        size_t len = strlen(keys[i].key);
+        if (len == 0 || len > 255) {
+            stat_parser_free(p);
+            return -1;
+        }
+        p->key_len[i] = (unsigned char)len;
+    }
+
+    // Two equal keys collide under every seed; fail before trying them all.
+    for (int i = 0; i < nkeys; i++) {
+        for (int j = 0; j < i; j++) {
+            if (strcmp(keys[i].key, keys[j].key) == 0) {
+                stat_parser_free(p);
+                return -1;
+            }
+        }
+    }
+
+    if (build_perfect_hash(p) != 0) {
+        stat_parser_free(p);
+        return -1;
+    }
+    return 0;
+}
+
+// Scan every line once and remember where each key was found.
+static int parse_full(struct stat_parser* p, const char* buf, void* dst)
+{
+    int found = 0;
+    int line = 0;
+
+    for (int i = 0; i < p->nkeys; i++)
+        p->line_of_key[i] = -1;
+
+    const char* s = buf;
+    while (*s && found < p->nkeys) {
+        const char* k = skip_prefix(s);
+        size_t len = key_span(k);
+        int idx = lookup(p, k, len);
+        uint64_t v;
+
+        if (idx >= 0 && p->line_of_key[idx] < 0 && decode_u64(k + len, &v)) {
+            store(p, idx, dst, v);
+            p->line_of_key[idx] = line;
+            found++;
+        }
+
+        const char* nl = strchr(s, '\n');
+        if (!nl)
+            break;
+        s = nl + 1;
+        line++;
+    }
+
+    // Cache the found keys in file order for the fast path.
+    p->norder = 0;
+    for (int i = 0; i < p->nkeys; i++) {
+        if (p->line_of_key[i] < 0)
+            continue;
+        int j = p->norder++;
+        while (j > 0 && p->line_of_key[p->order[j - 1]] > p->line_of_key[i]) {
+            p->order[j] = p->order[j - 1];
+            j--;
+        }
+        p->order[j] = i;
+    }
+    p->cached = found > 0;
+
+    return found;
+}
+
+// Jump from cached line to cached line, checking that each key is still
+// where it was. Returns -1 if the layout changed.
+static int parse_cached(const struct stat_parser* p, const char* buf, void* dst)
+{
+    const char* s = buf;
+    int line = 0;
+
+    for (int i = 0; i < p->norder; i++) {
+        int idx = p->order[i];
+        int target = p->line_of_key[idx];
+
+        while (line < target) {
+            s = strchr(s, '\n');
+            if (!s)
+                return -1;
+            s++;
+            line++;
+        }
+
+        const char* k = skip_prefix(s);
+        size_t len = p->key_len[idx];
+        uint64_t v;
+        if (memcmp(k, p->keys[idx].key, len) != 0 || !is_key_end(k[len]))
+            return -1;
+        if (!decode_u64(k + len, &v))
+            return -1;
+        store(p, idx, dst, v);
+    }
+    return p->norder;
+}
+
+// Parse a NUL-terminated buffer into dst. Returns the number of keys found.
+int stat_parser_run(struct stat_parser* p, const char* buf, void* dst)
+{
+    if (p->cached) {
+        int found = parse_cached(p, buf, dst);
+        if (found >= 0)
+            return found;
+    }
+    return parse_full(p, buf, dst);
+}
+
+void stat_parser_free(struct stat_parser* p)
+{
+    free(p->key_len);
+    free(p->slots);
+    free(p->line_of_key);
+    free(p->order);
+    p->key_len = NULL;
+    p->slots = NULL;
+    p->line_of_key = NULL;
+    p->order = NULL;
+    p->nkeys = 0;
+    p->norder = 0;
+    p->cached = 0;
+}
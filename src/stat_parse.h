@@ -0,0 +1,36 @@
+#ifndef STAT_PARSE_H
+#define STAT_PARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One wanted key and where its uint64_t value lands in the destination.
+struct stat_key {
+    const char* key;
+    size_t offset;
+};
+
+// Table-driven parser for "key value" (vmstat) and "[Node N] Key: value kB"
+// (meminfo) files. Keys are looked up through a perfect hash built at init.
+// After the first complete parse the line index of every key is cached, so
+// later samples jump straight to those lines instead of scanning the file.
+struct stat_parser {
+    const struct stat_key* keys;
+    int nkeys;
+    unsigned char* key_len;
+
+    uint32_t seed;
+    uint32_t mask;
+    int16_t* slots;
+
+    int* line_of_key;
+    int* order;
+    int norder;
+    int cached;
+};
+
+int stat_parser_init(struct stat_parser* p, const struct stat_key* keys, int nkeys);
+int stat_parser_run(struct stat_parser* p, const char* buf, void* dst);
+void stat_parser_free(struct stat_parser* p);
+
+#endif
@@ -0,0 +1,88 @@
+#include "ticker.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/timerfd.h>
+
+int64_t ticker_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int ticker_parse_policy(const char* name, enum tick_policy* policy)
+{
+    if (strcmp(name, "skip") == 0)
+        *policy = TICK_SKIP;
+    else if (strcmp(name, "catchup") == 0)
+        *policy = TICK_CATCHUP;
+    else {
+        fprintf(stderr, "Unknown --missed policy '%s' (expected skip or catchup)\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+// The first tick is due immediately.
+void ticker_init(struct ticker* t, int64_t period_ns, enum tick_policy policy)
+{
+    memset(t, 0, sizeof(*t));
+    t->period_ns = period_ns;
+    t->start_ns = ticker_now_ns();
+    t->policy = policy;
+}
+
+int64_t ticker_deadline_ns(const struct ticker* t)
+{
+    return t->start_ns + (int64_t)t->next_tick * t->period_ns;
+}
+
+// Record that the pending tick fired at now_ns: its lateness becomes the
+// jitter, and the next deadline is chosen according to the missed-tick
+// policy.
+void ticker_fired(struct ticker* t, int64_t now_ns)
+{
+    t->jitter_ns = now_ns - ticker_deadline_ns(t);
+    t->missed = 0;
+    t->next_tick++;
+
+    if (t->policy == TICK_SKIP && ticker_deadline_ns(t) <= now_ns) {
+        uint64_t due = (uint64_t)((now_ns - t->start_ns) / t->period_ns) + 1;
+        t->missed = due - t->next_tick;
+        t->total_missed += t->missed;
+        t->next_tick = due;
+    }
+}
+
+// Arm a CLOCK_MONOTONIC timerfd for the pending tick. A deadline that has
+// already passed makes the timer fire immediately.
+int ticker_arm(const struct ticker* t, int timerfd)
+{
+    return ticker_arm_at(timerfd, ticker_deadline_ns(t));
+}
+
+// The same for any CLOCK_MONOTONIC deadline.
+int ticker_arm_at(int timerfd, int64_t deadline)
+{
+    struct itimerspec its = {
+        .it_value = {
+            .tv_sec = deadline / 1000000000,
+            .tv_nsec = deadline % 1000000000,
+        },
+    };
+
+    // An all-zero it_value would disarm the timer instead.
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+        its.it_value.tv_nsec = 1;
+    return timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// Stop the timer until the next ticker_arm().
+int ticker_disarm(int timerfd)
+{
+    struct itimerspec its = { 0 };
+    return timerfd_settime(timerfd, 0, &its, NULL);
+}
@@ -0,0 +1,34 @@
+#ifndef TICKER_H
+#define TICKER_H
+
+#include <stdint.h>
+
+// What to do when a sample overruns one or more tick deadlines.
+enum tick_policy {
+    TICK_SKIP,      // drop the missed ticks and wait for the next future one
+    TICK_CATCHUP,   // take the missed samples back to back until on schedule
+};
+
+// Absolute-deadline sampling clock on CLOCK_MONOTONIC. Tick k is due at
+// start + k * period, so the work done per sample never shifts later ticks.
+struct ticker {
+    int64_t period_ns;
+    int64_t start_ns;
+    uint64_t next_tick;
+    enum tick_policy policy;
+
+    int64_t jitter_ns;
+    uint64_t missed;
+    uint64_t total_missed;
+};
+
+int64_t ticker_now_ns(void);
+int ticker_parse_policy(const char* name, enum tick_policy* policy);
+void ticker_init(struct ticker* t, int64_t period_ns, enum tick_policy policy);
+int64_t ticker_deadline_ns(const struct ticker* t);
+int ticker_arm(const struct ticker* t, int timerfd);
+int ticker_arm_at(int timerfd, int64_t deadline_ns);
+int ticker_disarm(int timerfd);
+void ticker_fired(struct ticker* t, int64_t now_ns);
+
+#endif
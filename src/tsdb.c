@@ -0,0 +1,379 @@
+#include "tsdb.h"
+
+#include <endian.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_FIXED 32
+
+static void put_le32(unsigned char* p, uint32_t v)
+{
+    v = htole32(v);
+    memcpy(p, &v, 4);
+}
+
+static uint32_t get_le32(const unsigned char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return le32toh(v);
+}
+
+static void put_le64(unsigned char* p, uint64_t v)
+{
+    v = htole64(v);
+    memcpy(p, &v, 8);
+}
+
+static uint64_t get_le64(const unsigned char* p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return le64toh(v);
+}
+
+static size_t block_header_size(int ncols)
+{
+    return BLOCK_FIXED + (size_t)ncols * sizeof(struct tsdb_summary) + (size_t)(ncols + 1) * 4;
+}
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t z)
+{
+    return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+static size_t put_varint(unsigned char* p, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+// Returns the bytes used, or 0 if the varint runs past end.
+static size_t get_varint(const unsigned char* p, const unsigned char* end, uint64_t* v)
+{
+    uint64_t x = 0;
+    for (size_t n = 0; n < 10 && p + n < end; n++) {
+        x |= (uint64_t)(p[n] & 0x7f) << (7 * n);
+        if (!(p[n] & 0x80)) {
+            *v = x;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+static size_t encode_ints(unsigned char* p, const union cell* v, uint32_t n)
+{
+    size_t len = 0;
+    uint64_t prev_delta = 0;
+    for (uint32_t k = 1; k < n; k++) {
+        uint64_t delta = v[k].u - v[k - 1].u;
+        len += put_varint(p + len, zigzag((int64_t)(delta - prev_delta)));
+        prev_delta = delta;
+    }
+    return len;
+}
+
+static size_t encode_floats(unsigned char* p, const union cell* v, uint32_t n)
+{
+    size_t len = 0;
+    for (uint32_t k = 1; k < n; k++) {
+        uint64_t x = v[k].u ^ v[k - 1].u;
+        if (!x) {
+            p[len++] = 64;
+            continue;
+        }
+        int tz = __builtin_ctzll(x);
+        p[len++] = (unsigned char)tz;
+        len += put_varint(p + len, x >> tz);
+    }
+    return len;
+}
+
+// Decode n - 1 values after first into out[stride], out[2 * stride], ...
+static int decode_stream(const unsigned char* p, const unsigned char* end, int floats,
+    union cell first, uint32_t n, union cell* out, size_t stride)
+{
+    union cell prev = first;
+    uint64_t prev_delta = 0;
+    out[0] = first;
+    for (uint32_t k = 1; k < n; k++) {
+        uint64_t z;
+        size_t used;
+        if (floats) {
+            if (p >= end)
+                return -1;
+            unsigned tz = *p++;
+            if (tz == 64)
+                z = 0;
+            else if (tz > 63 || !(used = get_varint(p, end, &z)))
+                return -1;
+            else {
+                p += used;
+                z <<= tz;
+            }
+            prev.u ^= z;
+        }
+        else {
+            if (!(used = get_varint(p, end, &z)))
+                return -1;
+            p += used;
+            prev_delta += (uint64_t)unzigzag(z);
+            prev.u += prev_delta;
+        }
+        out[k * stride] = prev;
+    }
+    return 0;
+}
+
+static int cell_less(unsigned char type, union cell a, union cell b)
+{
+    if (type == CELL_I64)
+        return a.i < b.i;
+    if (type == CELL_F64)
+        return a.f < b.f || (isnan(a.f) ? 0 : isnan(b.f));
+    return a.u < b.u;
+}
+
+int tsdb_writer_init(struct tsdb_writer* w, const struct log_schema* ls, uint32_t block_rows)
+{
+    memset(w, 0, sizeof(*w));
+    w->ls = ls;
+    w->block_rows = block_rows ? block_rows : TSDB_DEFAULT_BLOCK_ROWS;
+
+    // Worst case per value: an 11-byte float (tz byte + 10-byte varint).
+    size_t ncols = (size_t)ls->ncols;
+    w->cap = block_header_size(ls->ncols) + (ncols + 1) * w->block_rows * 11;
+    w->ts = malloc(sizeof(union cell) * w->block_rows);
+    w->cols = malloc(sizeof(union cell) * w->block_rows * (ncols ? ncols : 1));
+    w->buf = malloc(w->cap);
+    if (!w->ts || !w->cols || !w->buf) {
+        tsdb_writer_free(w);
+        return -1;
+    }
+    return 0;
+}
+
+// A block must not span a change of a key column.
+static int key_changed(const struct tsdb_writer* w, const union cell* cells)
+{
+    const struct log_schema* ls = w->ls;
+    for (int i = 0; i < ls->ncols; i++)
+        if (ls->keys[i] && cells[i].u != w->cols[(size_t)i * w->block_rows + w->nrows - 1].u)
+            return 1;
+    return 0;
+}
+
+int tsdb_append(struct tsdb_writer* w, FILE* fp, int64_t ts_ns, const union cell* cells)
+{
+    if (w->nrows && key_changed(w, cells) && tsdb_flush(w, fp) != 0)
+        return -1;
+
+    w->ts[w->nrows].i = ts_ns;
+    for (int i = 0; i < w->ls->ncols; i++)
+        w->cols[(size_t)i * w->block_rows + w->nrows] = cells[i];
+    if (++w->nrows == w->block_rows)
+        return tsdb_flush(w, fp);
+    return 0;
+}
+
+// Encode and write the rows buffered so far as one block.
+int tsdb_flush(struct tsdb_writer* w, FILE* fp)
+{
+    const struct log_schema* ls = w->ls;
+    uint32_t n = w->nrows;
+    if (!n)
+        return 0;
+
+    unsigned char* h = w->buf;
+    unsigned char* sums = h + BLOCK_FIXED;
+    unsigned char* offsets = sums + (size_t)ls->ncols * sizeof(struct tsdb_summary);
+    unsigned char* payload = h + block_header_size(ls->ncols);
+
+    size_t len = encode_ints(payload, w->ts, n);
+    put_le32(offsets, 0);
+    for (int i = 0; i < ls->ncols; i++) {
+        const union cell* v = &w->cols[(size_t)i * w->block_rows];
+        unsigned char type = ls->types[i];
+        struct tsdb_summary s = { v[0], v[n - 1], v[0], v[0] };
+        for (uint32_t k = 1; k < n; k++) {
+            if (cell_less(type, v[k], s.min))
+                s.min = v[k];
+            if (cell_less(type, s.max, v[k]))
+                s.max = v[k];
+        }
+        unsigned char* p = sums + (size_t)i * sizeof(struct tsdb_summary);
+        put_le64(p, s.first.u);
+        put_le64(p + 8, s.last.u);
+        put_le64(p + 16, s.min.u);
+        put_le64(p + 24, s.max.u);
+
+        put_le32(offsets + 4 * (i + 1), (uint32_t)len);
+        len += type == CELL_F64 ? encode_floats(payload + len, v, n) : encode_ints(payload + len, v, n);
+    }
+
+    put_le32(h, TSDB_BLOCK_MAGIC);
+    put_le32(h + 4, n);
+    put_le32(h + 8, (uint32_t)len);
+    put_le32(h + 12, 0);
+    put_le64(h + 16, w->ts[0].u);
+    put_le64(h + 24, w->ts[n - 1].u);
+
+    w->nrows = 0;
+    size_t total = block_header_size(ls->ncols) + len;
+    return fwrite(h, 1, total, fp) == total ? 0 : -1;
+}
+
+void tsdb_writer_free(struct tsdb_writer* w)
+{
+    free(w->ts);
+    free(w->cols);
+    free(w->buf);
+    w->ts = NULL;
+    w->cols = NULL;
+    w->buf = NULL;
+}
+
+static int skip_bytes(FILE* fp, uint32_t n)
+{
+    if (fseek(fp, n, SEEK_CUR) == 0)
+        return 0;
+    // Not seekable (a pipe): read past it.
+    unsigned char tmp[4096];
+    while (n) {
+        size_t step = n < sizeof(tmp) ? n : sizeof(tmp);
+        if (fread(tmp, 1, step, fp) != step)
+            return -1;
+        n -= (uint32_t)step;
+    }
+    return 0;
+}
+
+// Read the next block's header, and its payload if with_payload (otherwise
+// it is skipped). Returns 1 for a block, 0 at the end of the log and -1 on
+// a corrupt block. A block cut short at the end, e.g. by a crash, ends the
+// log.
+int tsdb_read_block(FILE* fp, const struct log_schema* ls, struct tsdb_block* b, int with_payload)
+{
+    unsigned char fixed[BLOCK_FIXED];
+    size_t got = fread(fixed, 1, sizeof(fixed), fp);
+    if (got == 0)
+        return 0;
+    if (got != sizeof(fixed)) {
+        fprintf(stderr, "Ignoring truncated last block\n");
+        return 0;
+    }
+    if (get_le32(fixed) != TSDB_BLOCK_MAGIC || get_le32(fixed + 4) == 0) {
+        fprintf(stderr, "Corrupt tsdb block\n");
+        return -1;
+    }
+
+    b->nrows = get_le32(fixed + 4);
+    b->payload_size = get_le32(fixed + 8);
+    b->ts_first = (int64_t)get_le64(fixed + 16);
+    b->ts_last = (int64_t)get_le64(fixed + 24);
+
+    size_t meta = block_header_size(ls->ncols) - BLOCK_FIXED;
+    unsigned char* m = malloc(meta);
+    if (!b->sum)
+        b->sum = calloc(ls->ncols ? ls->ncols : 1, sizeof(*b->sum));
+    if (!b->offsets)
+        b->offsets = calloc(ls->ncols + 1, sizeof(*b->offsets));
+    if (!m || !b->sum || !b->offsets) {
+        free(m);
+        return -1;
+    }
+    if (fread(m, 1, meta, fp) != meta) {
+        free(m);
+        fprintf(stderr, "Ignoring truncated last block\n");
+        return 0;
+    }
+    for (int i = 0; i < ls->ncols; i++) {
+        const unsigned char* p = m + (size_t)i * sizeof(struct tsdb_summary);
+        b->sum[i].first.u = get_le64(p);
+        b->sum[i].last.u = get_le64(p + 8);
+        b->sum[i].min.u = get_le64(p + 16);
+        b->sum[i].max.u = get_le64(p + 24);
+    }
+    const unsigned char* offsets = m + (size_t)ls->ncols * sizeof(struct tsdb_summary);
+    for (int i = 0; i <= ls->ncols; i++) {
+        b->offsets[i] = get_le32(offsets + 4 * i);
+        if (b->offsets[i] > b->payload_size) {
+            free(m);
+            fprintf(stderr, "Corrupt tsdb block\n");
+            return -1;
+        }
+    }
+    free(m);
+
+    if (!with_payload) {
+        if (skip_bytes(fp, b->payload_size) != 0) {
+            fprintf(stderr, "Ignoring truncated last block\n");
+            return 0;
+        }
+        return 1;
+    }
+
+    unsigned char* payload = realloc(b->payload, b->payload_size ? b->payload_size : 1);
+    if (!payload)
+        return -1;
+    b->payload = payload;
+    if (fread(b->payload, 1, b->payload_size, fp) != b->payload_size) {
+        fprintf(stderr, "Ignoring truncated last block\n");
+        return 0;
+    }
+    return 1;
+}
+
+// Decode a block read with its payload: nrows timestamps (in .i), and nrows
+// rows of ncols cells.
+int tsdb_decode(const struct log_schema* ls, const struct tsdb_block* b, union cell* ts, union cell* rows)
+{
+    const unsigned char* end_all = b->payload + b->payload_size;
+    union cell t0 = { .i = b->ts_first };
+
+    for (int i = -1; i < ls->ncols; i++) {
+        const unsigned char* p = b->payload + b->offsets[i + 1];
+        const unsigned char* end = i + 1 < ls->ncols ? b->payload + b->offsets[i + 2] : end_all;
+        int ret = i < 0
+            ? decode_stream(p, end, 0, t0, b->nrows, ts, 1)
+            : decode_stream(p, end, ls->types[i] == CELL_F64, b->sum[i].first, b->nrows,
+                  rows + i, (size_t)ls->ncols);
+        if (ret != 0) {
+            fprintf(stderr, "Corrupt tsdb block\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Fold the summaries of a following block into *into.
+void tsdb_summary_merge(const struct log_schema* ls, struct tsdb_summary* into, const struct tsdb_summary* from)
+{
+    for (int i = 0; i < ls->ncols; i++) {
+        into[i].last = from[i].last;
+        if (cell_less(ls->types[i], from[i].min, into[i].min))
+            into[i].min = from[i].min;
+        if (cell_less(ls->types[i], into[i].max, from[i].max))
+            into[i].max = from[i].max;
+    }
+}
+
+void tsdb_block_free(struct tsdb_block* b)
+{
+    free(b->sum);
+    free(b->offsets);
+    free(b->payload);
+    memset(b, 0, sizeof(*b));
+}
@@ -0,0 +1,68 @@
+#ifndef TSDB_H
+#define TSDB_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cell.h"
+#include "logfmt.h"
+
+#define TSDB_BLOCK_MAGIC 0x4b4c4254u    // "TBLK"
+#define TSDB_DEFAULT_BLOCK_ROWS 1024
+
+// Compact time-series log (--format tsdb). The header is the binary log's
+// header with magic "NUMATSDB"; then come blocks of up to block_rows rows,
+// all integers little-endian:
+//
+//   u32 magic "TBLK", u32 nrows, u32 payload_size, u32 reserved
+//   i64 ts_first, i64 ts_last
+//   ncols x { first, last, min, max }            8-byte cells
+//   (ncols + 1) x u32 stream offset into the payload, timestamps first
+//   payload: one stream per column
+//
+// Streams are column-major and skip the first value (it is in the block
+// header). Timestamps and integer columns store zigzag varints of the delta
+// of deltas; F64 columns store the XOR with the previous value as one byte
+// of trailing zero bits (64 = unchanged) plus a varint of the rest.
+//
+// The summaries answer first/last/min/max questions without decoding, and a
+// block never spans a change of a key column (the session's run/label), so
+// per-run aggregates are merges of whole blocks.
+struct tsdb_summary {
+    union cell first;
+    union cell last;
+    union cell min;
+    union cell max;
+};
+
+struct tsdb_writer {
+    const struct log_schema* ls;
+    uint32_t block_rows;
+    uint32_t nrows;
+    union cell* ts;         // timestamps, in .i
+    union cell* cols;       // column-major, block_rows per column
+    unsigned char* buf;
+    size_t cap;
+};
+
+struct tsdb_block {
+    uint32_t nrows;
+    int64_t ts_first;
+    int64_t ts_last;
+    struct tsdb_summary* sum;
+    uint32_t* offsets;
+    unsigned char* payload;
+    uint32_t payload_size;
+};
+
+int tsdb_writer_init(struct tsdb_writer* w, const struct log_schema* ls, uint32_t block_rows);
+int tsdb_append(struct tsdb_writer* w, FILE* fp, int64_t ts_ns, const union cell* cells);
+int tsdb_flush(struct tsdb_writer* w, FILE* fp);
+void tsdb_writer_free(struct tsdb_writer* w);
+
+int tsdb_read_block(FILE* fp, const struct log_schema* ls, struct tsdb_block* b, int with_payload);
+int tsdb_decode(const struct log_schema* ls, const struct tsdb_block* b, union cell* ts, union cell* rows);
+void tsdb_summary_merge(const struct log_schema* ls, struct tsdb_summary* into, const struct tsdb_summary* from);
+void tsdb_block_free(struct tsdb_block* b);
+
+#endif
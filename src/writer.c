@@ -0,0 +1,94 @@
+#define _GNU_SOURCE
+#include "writer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// How long buffered rows may sit in the ring before the writer drains them
+// on its own. A ring that is half full wakes the writer earlier.
+#define WRITER_FLUSH_MS 100
+
+static void* writer_main(void* arg)
+{
+    struct writer* w = arg;
+
+    while (ring_wait(&w->ring, WRITER_FLUSH_MS)) {
+        uint64_t first;
+        size_t n = ring_peek(&w->ring, &first);
+        if (n == 0)
+            continue;
+
+        uint64_t t0 = prof_now_ns();
+        for (size_t i = 0; i < n; i++)
+            output_write(w->out, ring_slot(&w->ring, first + i));
+        output_flush(w->out);
+        ring_release(&w->ring, n);
+
+        uint64_t ns = prof_now_ns() - t0;
+        atomic_fetch_add_explicit(&w->write_ns, ns, memory_order_relaxed);
+        if (ns > atomic_load_explicit(&w->write_max_ns, memory_order_relaxed))
+            atomic_store_explicit(&w->write_max_ns, ns, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+int writer_start(struct writer* w, struct output* out, uint64_t capacity,
+    enum ring_overflow overflow, int ncols)
+{
+    memset(w, 0, sizeof(*w));
+    w->out = out;
+
+    size_t record_size = sizeof(struct record) + sizeof(union cell) * ncols;
+    w->scratch = calloc(1, record_size);
+    if (!w->scratch || ring_init(&w->ring, capacity, record_size, overflow) != 0) {
+        fprintf(stderr, "Failed to allocate %llu-slot output ring\n", (unsigned long long)capacity);
+        free(w->scratch);
+        w->scratch = NULL;
+        return -1;
+    }
+
+    int err = pthread_create(&w->thread, NULL, writer_main, w);
+    if (err != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        ring_free(&w->ring);
+        free(w->scratch);
+        w->scratch = NULL;
+        return -1;
+    }
+    pthread_setname_np(w->thread, "numa-writer");
+    w->running = 1;
+    return 0;
+}
+
+// The record to fill for the next sample. When the ring is full in drop
+// mode this is a scratch record that writer_commit() throws away.
+struct record* writer_reserve(struct writer* w)
+{
+    struct record* rec = ring_reserve(&w->ring);
+    return rec ? rec : w->scratch;
+}
+
+void writer_commit(struct writer* w, struct record* rec)
+{
+    if (rec != w->scratch)
+        ring_publish(&w->ring);
+}
+
+uint64_t writer_dropped(struct writer* w)
+{
+    return atomic_load_explicit(&w->ring.dropped, memory_order_relaxed);
+}
+
+// Drain whatever is still queued and stop the thread.
+void writer_stop(struct writer* w)
+{
+    if (w->running) {
+        ring_close(&w->ring);
+        pthread_join(w->thread, NULL);
+        ring_free(&w->ring);
+        w->running = 0;
+    }
+    free(w->scratch);
+    w->scratch = NULL;
+}
@@ -0,0 +1,34 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "cell.h"
+#include "output.h"
+#include "profile.h"
+#include "ring.h"
+
+// Moves output I/O off the sampling thread. The sampler fills records in
+// place in a lock-free ring; a writer thread drains the ring in batches and
+// hands each batch to stdio, which turns it into a few large write() calls.
+struct writer {
+    struct ring ring;
+    struct output* out;
+    struct record* scratch;
+    pthread_t thread;
+    int running;
+
+    // Time spent writing batches, updated by the writer thread.
+    _Atomic uint64_t write_ns;
+    _Atomic uint64_t write_max_ns;
+};
+
+int writer_start(struct writer* w, struct output* out, uint64_t capacity,
+    enum ring_overflow overflow, int ncols);
+struct record* writer_reserve(struct writer* w);
+void writer_commit(struct writer* w, struct record* rec);
+uint64_t writer_dropped(struct writer* w);
+void writer_stop(struct writer* w);
+
+#endif